@@ -20,7 +20,7 @@
 #ifndef _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_H_
 #define _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_H_ 1
 
-#include <thrift/protocol/TVirtualProtocol.h>
+#include <protocol/TVirtualProtocol.h>
 
 #include <stack>
 #include <boost/shared_ptr.hpp>
@@ -285,6 +285,6 @@ typedef TCompactProtocolFactoryT<TTransport> TCompactProtocolFactory;
 
 }}} // apache::thrift::protocol
 
-#include <thrift/protocol/TCompactProtocol.tcc>
+#include <protocol/TCompactProtocol.tcc>
 
 #endif
@@ -57,6 +57,7 @@ int main(int argc, char *argv[])
     s_loggingFilters.insert("JobQueue", false);
     s_loggingFilters.insert("Sync", true);
     s_loggingFilters.insert("Connection", true);
+    s_loggingFilters.insert("Storage", false);
     s_loggingFilters.insert("Enml", false);
     s_loggingFilters.insert("Organizer", false);
     s_loggingFilters.insert("qml", true);
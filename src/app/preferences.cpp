@@ -54,6 +54,28 @@ void Preferences::setHaveLocalUser(bool haveLocalUser)
     emit haveLocalUserChanged();
 }
 
+bool Preferences::indexRecognition() const
+{
+    return m_settings.value("indexRecognition", false).toBool();
+}
+
+void Preferences::setIndexRecognition(bool indexRecognition)
+{
+    m_settings.setValue("indexRecognition", indexRecognition);
+    emit indexRecognitionChanged();
+}
+
+bool Preferences::compressionDictionary() const
+{
+    return m_settings.value("compressionDictionary", false).toBool();
+}
+
+void Preferences::setCompressionDictionary(bool compressionDictionary)
+{
+    m_settings.setValue("compressionDictionary", compressionDictionary);
+    emit compressionDictionaryChanged();
+}
+
 QString Preferences::colorForNotebook(const QString &notebookGuid)
 {
     m_settings.beginGroup("notebookColors");
@@ -34,6 +34,12 @@ class Preferences: public QObject
     Q_OBJECT
     Q_PROPERTY(QString accountName READ accountName WRITE setAccountName NOTIFY accountNameChanged)
     Q_PROPERTY(bool haveLocalUser READ haveLocalUser WRITE setHaveLocalUser NOTIFY haveLocalUserChanged)
+    // Fetching the recognized text of images and PDFs costs a request for each of them,
+    // so it's off unless the user asks for it
+    Q_PROPERTY(bool indexRecognition READ indexRecognition WRITE setIndexRecognition NOTIFY indexRecognitionChanged)
+    // Compressing the cached notes against a trained dictionary makes the cache smaller,
+    // at the cost of training it once enough notes are cached
+    Q_PROPERTY(bool compressionDictionary READ compressionDictionary WRITE setCompressionDictionary NOTIFY compressionDictionaryChanged)
 
 public:
     Preferences(QObject *parent = 0);
@@ -43,6 +49,12 @@ public:
     bool haveLocalUser() const;
     void setHaveLocalUser(bool haveLocalUser);
 
+    bool indexRecognition() const;
+    void setIndexRecognition(bool indexRecognition);
+
+    bool compressionDictionary() const;
+    void setCompressionDictionary(bool compressionDictionary);
+
     Q_INVOKABLE QString colorForNotebook(const QString &notebookGuid);
 
     Q_INVOKABLE QString tokenForUser(const QString &user);
@@ -51,6 +63,8 @@ public:
 signals:
     void accountNameChanged();
     void haveLocalUserChanged();
+    void indexRecognitionChanged();
+    void compressionDictionaryChanged();
 
 private:
     QSettings m_settings;
@@ -454,6 +454,8 @@ MainView {
         }
 
         pagestack.push(rootTabs);
+        NotesStore.indexRecognition = Qt.binding(function() { return preferences.indexRecognition; });
+        NotesStore.compressionDictionary = Qt.binding(function() { return preferences.compressionDictionary; });
         doLogin();
 
         if (uriArgs) {
@@ -92,6 +92,25 @@ Page {
             color: theme.palette.normal.positive
             onClicked: root.oaSetup.exec()
         }
+
+        Row {
+            anchors { left: parent.left; right: parent.right; margins: units.gu(1) }
+            spacing: units.gu(1)
+
+            CheckBox {
+                id: dictionaryCheckBox
+                checked: preferences.compressionDictionary
+                onTriggered: {
+                    preferences.compressionDictionary = checked;
+                }
+            }
+            Label {
+                anchors.verticalCenter: dictionaryCheckBox.verticalCenter
+                width: parent.width - dictionaryCheckBox.width - parent.spacing
+                text: i18n.tr("Use less storage for cached notes")
+                wrapMode: Text.WordWrap
+            }
+        }
      }
 
      head.backAction: Action {
@@ -55,6 +55,9 @@ Page {
                     name: "search"
                 }
 
+                onTextChanged: {
+                    NotesStore.findNotes(searchField.text)
+                }
                 onAccepted: {
                     NotesStore.findNotes(searchField.text)
                 }
@@ -69,6 +72,25 @@ Page {
             }
         }
 
+        Row {
+            anchors { left: parent.left; right: parent.right; margins: units.gu(2) }
+            spacing: units.gu(1)
+
+            CheckBox {
+                id: recognitionCheckBox
+                checked: preferences.indexRecognition
+                onTriggered: {
+                    preferences.indexRecognition = checked;
+                }
+            }
+            Label {
+                anchors.verticalCenter: recognitionCheckBox.verticalCenter
+                width: parent.width - recognitionCheckBox.width - parent.spacing
+                text: i18n.tr("Also search text in images and PDFs")
+                wrapMode: Text.WordWrap
+            }
+        }
+
         ListView {
             anchors { left: parent.left; right: parent.right }
             height: parent.height - y
@@ -76,6 +98,7 @@ Page {
 
             model: Notes {
                 onlySearchResults: true
+                sortOrder: Notes.SortOrderRelevance
 
                 Component.onCompleted: {
                     if (count > 0) {
@@ -87,7 +110,7 @@ Page {
             delegate: NotesDelegate {
                 title: model.title
                 date: model.created
-                content: model.tagline
+                content: model.searchSnippet || model.tagline
                 resource: model.resourceUrls.length > 0 ? model.resourceUrls[0] : ""
                 notebookColor: preferences.colorForNotebook(model.notebookGuid)
                 reminder: model.reminder
@@ -506,6 +506,18 @@ void EvernoteConnection::enqueueWrite(EvernoteJob *job)
     startJobQueue();
 }
 
+bool EvernoteConnection::cancel(EvernoteJob *job)
+{
+    if (!m_highPriorityJobQueue.removeOne(job) && !m_mediumPriorityJobQueue.removeOne(job) && !m_lowPriorityJobQueue.removeOne(job)) {
+        return false;
+    }
+    qCDebug(dcJobQueue) << "Cancelling job:" << job->toString();
+    disconnect(job, &EvernoteJob::jobFinished, this, &EvernoteConnection::startNextJob);
+    // Cleans up the job and its duplicates
+    emit job->jobFinished();
+    return true;
+}
+
 bool EvernoteConnection::isConnected() const
 {
     return m_userstoreClient != nullptr &&
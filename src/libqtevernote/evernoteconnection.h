@@ -91,6 +91,11 @@ public:
     // Use this to queue write calls. They won't be deduped and will be ordered
     void enqueueWrite(EvernoteJob *job);
 
+    // Takes a job out of the queue and deletes it, along with duplicates attached to it.
+    // No jobDone signal will be emitted for it. Returns false if the job already started
+    // talking to the server, it can't be stopped any more then.
+    bool cancel(EvernoteJob *job);
+
     bool isConnected() const;
 
     QString error() const;
@@ -52,6 +52,11 @@ void FetchNotesJob::attachToDuplicate(const EvernoteJob *other)
     connect(otherJob, &FetchNotesJob::jobDone, this, &FetchNotesJob::jobDone);
 }
 
+QString FetchNotesJob::searchWords() const
+{
+    return m_searchWords;
+}
+
 QString FetchNotesJob::toString() const
 {
     return QString("%1, NotebookFilter: %2, SearchWords: %3, StartIndex: %4, ChunkSize: %5")
@@ -36,6 +36,8 @@ public:
     virtual void attachToDuplicate(const EvernoteJob *other) override;
     virtual QString toString() const override;
 
+    QString searchWords() const;
+
 signals:
     void jobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const evernote::edam::NotesMetadataList &results, const QString &filterNotebookGuid);
 
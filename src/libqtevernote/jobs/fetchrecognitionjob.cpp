@@ -0,0 +1,90 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fetchrecognitionjob.h"
+
+#include <QSet>
+#include <QXmlStreamReader>
+
+FetchRecognitionJob::FetchRecognitionJob(const QString &noteGuid, const QString &hash, QObject *parent) :
+    NotesStoreJob(parent),
+    m_noteGuid(noteGuid),
+    m_hash(hash)
+{
+}
+
+bool FetchRecognitionJob::operator==(const EvernoteJob *other) const
+{
+    const FetchRecognitionJob *otherJob = qobject_cast<const FetchRecognitionJob*>(other);
+    if (!otherJob) {
+        return false;
+    }
+    return this->m_noteGuid == otherJob->m_noteGuid && this->m_hash == otherJob->m_hash;
+}
+
+void FetchRecognitionJob::attachToDuplicate(const EvernoteJob *other)
+{
+    const FetchRecognitionJob *otherJob = static_cast<const FetchRecognitionJob*>(other);
+    connect(otherJob, &FetchRecognitionJob::jobDone, this, &FetchRecognitionJob::jobDone);
+}
+
+QString FetchRecognitionJob::toString() const
+{
+    return QString("%1, NoteGuid: %2, Hash: %3")
+            .arg(metaObject()->className())
+            .arg(m_noteGuid)
+            .arg(m_hash);
+}
+
+void FetchRecognitionJob::startJob()
+{
+    QByteArray hash = QByteArray::fromHex(m_hash.toLatin1());
+    evernote::edam::Resource result;
+    client()->getResourceByHash(result, token().toStdString(), m_noteGuid.toStdString(), std::string(hash.constData(), hash.length()), false, true, false);
+    if (result.__isset.recognition && result.recognition.__isset.body) {
+        m_text = recognizedText(QByteArray(result.recognition.body.data(), result.recognition.body.size()));
+    }
+}
+
+void FetchRecognitionJob::emitJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage)
+{
+    emit jobDone(errorCode, errorMessage, m_noteGuid, m_hash, m_text);
+}
+
+// A recoIndex holds an <item> for every area with text in it, each listing the words it
+// might be as <t> elements, weighted by how likely they are:
+// <recoIndex><item x="1" y="2" w="3" h="4"><t w="87">LIQUOR</t><t w="83">LIQUID</t></item></recoIndex>
+QString FetchRecognitionJob::recognizedText(const QByteArray &recoIndex)
+{
+    QStringList words;
+    QSet<QString> alternatives;
+    QXmlStreamReader reader(recoIndex);
+    while (!reader.atEnd()) {
+        reader.readNext();
+        if (reader.isStartElement() && reader.name() == "item") {
+            alternatives.clear();
+        } else if (reader.isStartElement() && reader.name() == "t") {
+            QString word = reader.readElementText();
+            if (!alternatives.contains(word)) {
+                alternatives.insert(word);
+                words.append(word);
+            }
+        }
+    }
+    return words.join(' ');
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FETCHRECOGNITIONJOB_H
+#define FETCHRECOGNITIONJOB_H
+
+#include "notesstorejob.h"
+
+// Fetches what the server recognized in a resource (text in images and PDFs), without the
+// resource's data. The recoIndex is parsed right away, only the recognized words are passed on.
+class FetchRecognitionJob : public NotesStoreJob
+{
+    Q_OBJECT
+public:
+    explicit FetchRecognitionJob(const QString &noteGuid, const QString &hash, QObject *parent = 0);
+
+    virtual bool operator==(const EvernoteJob *other) const override;
+    virtual void attachToDuplicate(const EvernoteJob *other) override;
+    virtual QString toString() const override;
+
+    // Returns the words in a recoIndex, with all alternatives the server came up with
+    static QString recognizedText(const QByteArray &recoIndex);
+
+signals:
+    void jobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const QString &noteGuid, const QString &hash, const QString &text);
+
+protected:
+    void startJob();
+    void emitJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage);
+
+private:
+    QString m_noteGuid;
+    QString m_hash;
+    QString m_text;
+};
+
+#endif // FETCHRECOGNITIONJOB_H
@@ -31,11 +31,12 @@
 #include <QStandardPaths>
 #include <QCryptographicHash>
 #include <QFile>
+#include <QFileInfo>
+#include <QSettings>
 
 Note::Note(const QString &guid, quint32 updateSequenceNumber, QObject *parent) :
     QObject(parent),
     m_deleted(false),
-    m_isSearchResult(false),
     m_updateSequenceNumber(updateSequenceNumber),
     m_loading(false),
     m_loaded(false),
@@ -45,30 +46,31 @@ Note::Note(const QString &guid, quint32 updateSequenceNumber, QObject *parent) :
     m_conflictingNote(nullptr)
 {
     setGuid(guid);
-    m_cacheFile.setFileName(NotesStore::instance()->storageLocation() + "note-" + guid + ".enml");
-
-    QSettings infoFile(m_infoFile, QSettings::IniFormat);
-    m_created = infoFile.value("created").toDateTime();
-    m_title = infoFile.value("title").toString();
-    m_updated = infoFile.value("updated").toDateTime();
-    m_notebookGuid = infoFile.value("notebookGuid").toString();
-    m_tagGuids = infoFile.value("tagGuids").toStringList();
-    m_reminderOrder = infoFile.value("reminderOrder").toULongLong();
-    m_reminderTime = infoFile.value("reminderTime").toDateTime();
-    m_reminderDoneTime = infoFile.value("reminderDoneTime").toDateTime();
-    m_deleted = infoFile.value("deleted").toBool();
-    m_tagline = infoFile.value("tagline").toString();
-    m_lastSyncedSequenceNumber = infoFile.value("lastSyncedSequenceNumber", 0).toUInt();
-    m_needsContentSync = infoFile.value("needsContentSync", false).toBool();
+
+    NoteInfoTable *infoTable = NotesStore::instance()->noteInfoTable();
+    if (!infoTable->contains(guid)) {
+        migrateInfoFile();
+    }
+
+    NoteInfo info = infoTable->record(guid);
+    m_created = info.created;
+    m_title = info.title;
+    m_updated = info.updated;
+    m_notebookGuid = info.notebookGuid;
+    m_tagGuids = info.tagGuids;
+    m_reminderOrder = info.reminderOrder;
+    m_reminderTime = info.reminderTime;
+    m_reminderDoneTime = info.reminderDoneTime;
+    m_deleted = info.deleted;
+    m_tagline = info.tagline;
+    m_lastSyncedSequenceNumber = info.lastSyncedSequenceNumber;
+    m_needsContentSync = info.needsContentSync;
     m_synced = m_lastSyncedSequenceNumber == m_updateSequenceNumber;
+    m_edam = info.edam;
 
-    infoFile.beginGroup("resources");
-    foreach (const QString &hash, infoFile.childGroups()) {
-        infoFile.beginGroup(hash);
-        addResource(hash, infoFile.value("fileName").toString(), infoFile.value("type").toString());
-        infoFile.endGroup();
+    foreach (const NoteResourceInfo &resource, info.resources) {
+        m_resources.insert(resource.hash, new Resource(QByteArray(), resource.hash, resource.fileName, resource.type, this));
     }
-    infoFile.endGroup();
 
     connect(NotesStore::instance(), &NotesStore::notebookGuidChanged, this, &Note::slotNotebookGuidChanged);
     connect(NotesStore::instance(), &NotesStore::tagGuidChanged, this, &Note::slotTagGuidChanged);
@@ -104,21 +106,20 @@ void Note::setGuid(const QString &guid)
     if (m_guid != guid) {
 
         bool syncToFile = false;
-        if (!m_infoFile.isEmpty()) {
-            QFile ifile(m_infoFile);
-            ifile.remove();
-
+        if (!m_guid.isEmpty()) {
+            NotesStore::instance()->noteInfoTable()->remove(m_guid);
             syncToFile = true;
         }
 
-        m_guid = guid;
-        QString newCacheFileName = NotesStore::instance()->storageLocation() + "note-" + guid + ".enml";
-        if (m_cacheFile.exists()) {
-            m_cacheFile.rename(newCacheFileName);
-        } else {
-            m_cacheFile.setFileName(newCacheFileName);
+        ContentStore *contentStore = NotesStore::instance()->contentStore();
+        if (contentStore->contains(m_guid)) {
+            contentStore->write(guid, contentStore->read(m_guid));
+            contentStore->remove(m_guid);
+        }
+        if (inSearchIndex()) {
+            NotesStore::instance()->searchIndex()->renameNote(m_guid, guid);
         }
-        m_infoFile = NotesStore::instance()->storageLocation() + "note-" + guid + ".info";
+        m_guid = guid;
 
         if (syncToFile) {
             syncToInfoFile();
@@ -156,23 +157,7 @@ void Note::setCreated(const QDateTime &created)
 
 QString Note::createdString() const
 {
-    QDate createdDate = m_created.date();
-    QDate today = QDate::currentDate();
-    if (createdDate == today) {
-        return gettext("Today");
-    }
-    if (createdDate == today.addDays(-1)) {
-        return gettext("Yesterday");
-    }
-    if (createdDate >= today.addDays(-7)) {
-        return gettext("Last week");
-    }
-    if (createdDate >= today.addDays(-14)) {
-        return gettext("Two weeks ago");
-    }
-
-    // TRANSLATORS: the first argument refers to a month name and the second to a year
-    return QString(gettext("%1 %2")).arg(QLocale::system().standaloneMonthName(createdDate.month())).arg(createdDate.year());
+    return dateString(m_created.date());
 }
 
 QDateTime Note::updated() const
@@ -190,23 +175,27 @@ void Note::setUpdated(const QDateTime &updated)
 
 QString Note::updatedString() const
 {
-    QDate updatedDate = m_updated.date();
+    return dateString(m_updated.date());
+}
+
+QString Note::dateString(const QDate &date)
+{
     QDate today = QDate::currentDate();
-    if (updatedDate == today) {
+    if (date == today) {
         return gettext("Today");
     }
-    if (updatedDate == today.addDays(-1)) {
+    if (date == today.addDays(-1)) {
         return gettext("Yesterday");
     }
-    if (updatedDate >= today.addDays(-7)) {
+    if (date >= today.addDays(-7)) {
         return gettext("Last week");
     }
-    if (updatedDate >= today.addDays(-14)) {
+    if (date >= today.addDays(-14)) {
         return gettext("Two weeks ago");
     }
 
     // TRANSLATORS: the first argument refers to a month name and the second to a year
-    return QString(gettext("%1 %2")).arg(QLocale::system().standaloneMonthName(updatedDate.month())).arg(updatedDate.year());
+    return QString(gettext("%1 %2")).arg(QLocale::system().standaloneMonthName(date.month())).arg(date.year());
 }
 
 QString Note::title() const
@@ -218,6 +207,9 @@ void Note::setTitle(const QString &title)
 {
     if (m_title != title) {
         m_title = title;
+        if (inSearchIndex()) {
+            NotesStore::instance()->searchIndex()->setTitle(m_guid, title);
+        }
         emit titleChanged();
     }
 }
@@ -244,7 +236,9 @@ void Note::setEnmlContent(const QString &enmlContent)
 {
     if (m_content.enml() != enmlContent) {
         m_content.setEnml(enmlContent);
-        m_tagline = m_content.toPlaintext().left(100);
+        QString plaintext = m_content.toPlaintext();
+        m_tagline = plaintext.left(100);
+        updateSearchIndex(plaintext);
         emit contentChanged();
 
         if (m_loaded) {
@@ -268,7 +262,9 @@ void Note::setRichTextContent(const QString &richTextContent)
 {
     if (m_content.toRichText(m_guid) != richTextContent) {
         m_content.setRichText(richTextContent);
-        m_tagline = m_content.toPlaintext().left(100);
+        QString plaintext = m_content.toPlaintext();
+        m_tagline = plaintext.left(100);
+        updateSearchIndex(plaintext);
         emit contentChanged();
 
         m_needsContentSync = true;
@@ -361,17 +357,22 @@ void Note::setReminderDone(bool reminderDone)
 
 QString Note::reminderTimeString() const
 {
-    if (m_reminderOrder == 0) {
+    return reminderTimeString(m_reminderOrder, m_reminderTime, reminderDone());
+}
+
+QString Note::reminderTimeString(qint64 reminderOrder, const QDateTime &reminderTime, bool reminderDone)
+{
+    if (reminderOrder == 0) {
         return QString();
     }
 
-    if (reminderDone()) {
+    if (reminderDone) {
         return gettext("Done");
     }
 
-    QDate reminderDate = m_reminderTime.date();
+    QDate reminderDate = reminderTime.date();
     QDate today = QDate::currentDate();
-    if (m_reminderTime.isNull()) {
+    if (reminderTime.isNull()) {
         return gettext("No date");
     }
     if (reminderDate < today) {
@@ -420,15 +421,7 @@ void Note::setDeleted(bool deleted)
 
 bool Note::isSearchResult() const
 {
-    return m_isSearchResult;
-}
-
-void Note::setIsSearchResult(bool isSearchResult)
-{
-    if (m_isSearchResult != isSearchResult) {
-        m_isSearchResult = isSearchResult;
-        emit isSearchResultChanged();
-    }
+    return NotesStore::instance()->isSearchResult(m_guid);
 }
 
 qint32 Note::updateSequenceNumber() const
@@ -440,6 +433,9 @@ void Note::setUpdateSequenceNumber(qint32 updateSequenceNumber)
 {
     if (m_updateSequenceNumber != updateSequenceNumber) {
         m_updateSequenceNumber = updateSequenceNumber;
+        if (inSearchIndex()) {
+            NotesStore::instance()->searchIndex()->setUpdateSequenceNumber(m_guid, updateSequenceNumber);
+        }
 
         m_synced = m_updateSequenceNumber == m_lastSyncedSequenceNumber;
         if (m_synced) {
@@ -481,17 +477,25 @@ QStringList Note::resourceUrls() const
 {
     QList<QString> ret;
     foreach (Resource *resource, m_resources) {
-        QUrl url("image://resource/" + resource->type());
-        QUrlQuery arguments;
-        arguments.addQueryItem("noteGuid", m_guid);
-        arguments.addQueryItem("hash", resource->hash());
-        arguments.addQueryItem("loaded", resource->isCached() ? "true" : "false");
-        url.setQuery(arguments);
-        ret << url.toString();
+        ret << resourceUrl(m_guid, resource->hash(), resource->type(), resource->hashedFilePath());
     }
     return ret;
 }
 
+QString Note::resourceUrl(const QString &noteGuid, const QString &hash, const QString &type, const QString &filePath)
+{
+    QFileInfo fileInfo(filePath);
+    QUrl url("image://resource/" + type);
+    QUrlQuery arguments;
+    arguments.addQueryItem("noteGuid", noteGuid);
+    arguments.addQueryItem("hash", hash);
+    arguments.addQueryItem("loaded", fileInfo.exists() ? "true" : "false");
+    // Lets the image provider find the file without looking up the note
+    arguments.addQueryItem("file", fileInfo.fileName());
+    url.setQuery(arguments);
+    return url.toString();
+}
+
 Resource* Note::resource(const QString &hash)
 {
     return m_resources.value(hash);
@@ -509,13 +513,7 @@ Resource* Note::addResource(const QString &hash, const QString &fileName, const
     } else {
         resource = new Resource(data, hash, fileName, type, this);
         m_resources.insert(hash, resource);
-        QSettings infoFile(m_infoFile, QSettings::IniFormat);
-        infoFile.beginGroup("resources");
-        infoFile.beginGroup(hash);
-        infoFile.setValue("fileName", fileName);
-        infoFile.setValue("type", type);
-        infoFile.endGroup();
-        infoFile.endGroup();
+        syncResourcesToInfoTable();
     }
 
     emit resourcesChanged();
@@ -527,6 +525,9 @@ Resource* Note::addResource(const QString &hash, const QString &fileName, const
 void Note::markTodo(const QString &todoId, bool checked)
 {
     m_content.markTodo(todoId, checked);
+    if (inSearchIndex()) {
+        NotesStore::instance()->searchIndex()->setTodos(m_guid, m_content.todos());
+    }
 }
 
 void Note::attachFile(int position, const QUrl &fileName)
@@ -541,13 +542,7 @@ void Note::attachFile(int position, const QUrl &fileName)
     m_resources.insert(resource->hash(), resource);
     m_content.attachFile(position, resource->hash(), resource->type());
 
-    QSettings infoFile(m_infoFile, QSettings::IniFormat);
-    infoFile.beginGroup("resources");
-    infoFile.beginGroup(resource->hash());
-    infoFile.setValue("fileName", resource->fileName());
-    infoFile.setValue("type", resource->type());
-    infoFile.endGroup();
-    infoFile.endGroup();
+    syncResourcesToInfoTable();
 
     emit resourcesChanged();
     emit contentChanged();
@@ -573,14 +568,18 @@ void Note::removeTag(const QString &tagGuid)
 void Note::insertText(int position, const QString &text)
 {
     m_content.insertText(position, text);
-    m_tagline = m_content.toPlaintext().left(100);
+    QString plaintext = m_content.toPlaintext();
+    m_tagline = plaintext.left(100);
+    updateSearchIndex(plaintext);
     emit contentChanged();
 }
 
 void Note::insertLink(int position, const QString &url)
 {
     m_content.insertLink(position, url);
-    m_tagline = m_content.toPlaintext().left(100);
+    QString plaintext = m_content.toPlaintext();
+    m_tagline = plaintext.left(100);
+    updateSearchIndex(plaintext);
     emit contentChanged();
 }
 
@@ -608,7 +607,6 @@ Note *Note::clone()
     note->setReminderOrder(m_reminderOrder);
     note->setReminderTime(m_reminderTime);
     note->setReminderDoneTime(m_reminderDoneTime);
-    note->setIsSearchResult(m_isSearchResult);
     note->setTagGuids(m_tagGuids);
     note->setUpdateSequenceNumber(m_updateSequenceNumber);
     note->setDeleted(m_deleted);
@@ -622,7 +620,7 @@ Note *Note::clone()
 
 bool Note::isCached() const
 {
-    return m_cacheFile.exists();
+    return NotesStore::instance()->contentStore()->contains(m_guid);
 }
 
 bool Note::loaded() const
@@ -658,30 +656,111 @@ void Note::setSyncError(bool syncError)
 
 void Note::syncToInfoFile()
 {
-    QSettings infoFile(m_infoFile, QSettings::IniFormat);
-    infoFile.setValue("created", m_created);
-    infoFile.setValue("title", m_title);
-    infoFile.setValue("updated", m_updated);
-    infoFile.setValue("needsContentSync", m_needsContentSync);
+    NoteInfo info;
+    info.guid = m_guid;
+    info.created = m_created;
+    info.title = m_title;
+    info.updated = m_updated;
+    info.needsContentSync = m_needsContentSync;
+
+    info.notebookGuid = m_notebookGuid;
+    info.tagGuids = m_tagGuids;
+    info.reminderOrder = m_reminderOrder;
+    info.reminderTime = m_reminderTime;
+    info.reminderDoneTime = m_reminderDoneTime;
+    info.deleted = m_deleted;
+    info.tagline = m_tagline;
+    info.updateSequenceNumber = m_updateSequenceNumber;
+    info.lastSyncedSequenceNumber = m_lastSyncedSequenceNumber;
+    info.edam = m_edam;
 
-    infoFile.setValue("notebookGuid", m_notebookGuid);
-    infoFile.setValue("tagGuids", m_tagGuids);
-    infoFile.setValue("reminderOrder", m_reminderOrder);
-    infoFile.setValue("reminderTime", m_reminderTime);
-    infoFile.setValue("reminderDoneTime", m_reminderDoneTime);
-    infoFile.setValue("deleted", m_deleted);
-    infoFile.setValue("lastSyncedSequenceNumber", m_lastSyncedSequenceNumber);
+    foreach (Resource *resource, m_resources) {
+        NoteResourceInfo resourceInfo;
+        resourceInfo.hash = resource->hash();
+        resourceInfo.fileName = resource->fileName();
+        resourceInfo.type = resource->type();
+        info.resources.append(resourceInfo);
+    }
+
+    NotesStore::instance()->noteInfoTable()->write(info);
 }
 
 void Note::syncToCacheFile()
 {
-    QSettings infoFile(m_infoFile, QSettings::IniFormat);
-    infoFile.setValue("tagline", m_tagline);
+    NoteInfoTable *infoTable = NotesStore::instance()->noteInfoTable();
+    if (infoTable->contains(m_guid)) {
+        NoteInfo info = infoTable->record(m_guid);
+        if (info.tagline != m_tagline) {
+            info.tagline = m_tagline;
+            infoTable->write(info);
+        }
+    }
+
+    NotesStore::instance()->contentStore()->write(m_guid, m_content.enml().toUtf8());
+}
+
+void Note::syncResourcesToInfoTable()
+{
+    // Only notes that are already in the table get their resources recorded. This
+    // keeps temporary notes, such as the server side copy of a conflict, out of it.
+    NoteInfoTable *infoTable = NotesStore::instance()->noteInfoTable();
+    if (!infoTable->contains(m_guid)) {
+        return;
+    }
 
-    if (m_cacheFile.open(QFile::WriteOnly | QFile::Truncate)) {
-        m_cacheFile.write(m_content.enml().toUtf8());
-        m_cacheFile.close();
+    NoteInfo info = infoTable->record(m_guid);
+    info.resources.clear();
+    foreach (Resource *resource, m_resources) {
+        NoteResourceInfo resourceInfo;
+        resourceInfo.hash = resource->hash();
+        resourceInfo.fileName = resource->fileName();
+        resourceInfo.type = resource->type();
+        info.resources.append(resourceInfo);
     }
+    infoTable->write(info);
+}
+
+void Note::migrateInfoFile()
+{
+    QString infoFileName = NotesStore::instance()->storageLocation() + "note-" + m_guid + ".info";
+    if (!QFile::exists(infoFileName)) {
+        return;
+    }
+
+    NoteInfo info;
+    {
+        QSettings infoFile(infoFileName, QSettings::IniFormat);
+        info.guid = m_guid;
+        info.created = infoFile.value("created").toDateTime();
+        info.title = infoFile.value("title").toString();
+        info.updated = infoFile.value("updated").toDateTime();
+        info.notebookGuid = infoFile.value("notebookGuid").toString();
+        info.tagGuids = infoFile.value("tagGuids").toStringList();
+        info.reminderOrder = infoFile.value("reminderOrder").toULongLong();
+        info.reminderTime = infoFile.value("reminderTime").toDateTime();
+        info.reminderDoneTime = infoFile.value("reminderDoneTime").toDateTime();
+        info.deleted = infoFile.value("deleted").toBool();
+        info.tagline = infoFile.value("tagline").toString();
+        info.updateSequenceNumber = m_updateSequenceNumber;
+        info.lastSyncedSequenceNumber = infoFile.value("lastSyncedSequenceNumber", 0).toUInt();
+        info.needsContentSync = infoFile.value("needsContentSync", false).toBool();
+
+        infoFile.beginGroup("resources");
+        foreach (const QString &hash, infoFile.childGroups()) {
+            infoFile.beginGroup(hash);
+            NoteResourceInfo resource;
+            resource.hash = hash;
+            resource.fileName = infoFile.value("fileName").toString();
+            resource.type = infoFile.value("type").toString();
+            info.resources.append(resource);
+            infoFile.endGroup();
+        }
+        infoFile.endGroup();
+    }
+
+    NotesStore::instance()->noteInfoTable()->write(info);
+    QFile::remove(infoFileName);
+    qCDebug(dcStorage) << "Migrated" << infoFileName << "to the note info table";
 }
 
 void Note::load(bool priorityHigh)
@@ -706,10 +785,10 @@ void Note::load(bool priorityHigh)
 
 void Note::loadFromCacheFile() const
 {
-    if (m_cacheFile.exists() && m_cacheFile.open(QFile::ReadOnly)) {
-        m_content.setEnml(QString::fromUtf8(m_cacheFile.readAll()).trimmed());
+    ContentStore *contentStore = NotesStore::instance()->contentStore();
+    if (contentStore->contains(m_guid)) {
+        m_content.setEnml(QString::fromUtf8(contentStore->read(m_guid)).trimmed());
         m_tagline = m_content.toPlaintext().left(100);
-        m_cacheFile.close();
         qCDebug(dcNotesStore) << "Loaded note content from disk:" << m_guid;
     } else {
         qCDebug(dcNotesStore) << "Failed attempt to load note content from disk:" << m_guid;
@@ -717,14 +796,16 @@ void Note::loadFromCacheFile() const
     m_loaded = true;
 }
 
-void Note::deleteFromCache()
+bool Note::inSearchIndex() const
 {
-    if (m_cacheFile.exists()) {
-        m_cacheFile.remove();
-    }
-    QFile f(m_infoFile);
-    if (f.exists()) {
-        f.remove();
+    return parent() == NotesStore::instance() && NotesStore::instance()->searchIndexLive();
+}
+
+void Note::updateSearchIndex(const QString &plaintext)
+{
+    if (inSearchIndex()) {
+        NotesStore::instance()->searchIndex()->setContent(m_guid, plaintext);
+        NotesStore::instance()->searchIndex()->setTodos(m_guid, m_content.todos());
     }
 }
 
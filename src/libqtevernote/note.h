@@ -23,13 +23,13 @@
 
 #include "utils/enmldocument.h"
 #include "resource.h"
+#include "utils/noteinfotable.h"
 
 #include <QObject>
 #include <QDateTime>
 #include <QStringList>
 #include <QImage>
 #include <QFile>
-#include <QSettings>
 
 class Note : public QObject
 {
@@ -142,7 +142,6 @@ public:
     bool deleted() const;
 
     bool isSearchResult() const;
-    void setIsSearchResult(bool isSearchResult);
 
     qint32 updateSequenceNumber() const;
     qint32 lastSyncedSequenceNumber() const;
@@ -173,6 +172,11 @@ public:
 
     Q_INVOKABLE void load(bool highPriority = false);
 
+    // Also used by the NotesStore for rows that don't have a Note object yet
+    static QString dateString(const QDate &date);
+    static QString reminderTimeString(qint64 reminderOrder, const QDateTime &reminderTime, bool reminderDone);
+    static QString resourceUrl(const QString &noteGuid, const QString &hash, const QString &type, const QString &filePath);
+
 public slots:
     void save();
     void remove();
@@ -213,7 +217,8 @@ private:
     void setDeleted(bool deleted);
     void syncToCacheFile();
     void syncToInfoFile();
-    void deleteFromCache();
+    void syncResourcesToInfoTable();
+    void migrateInfoFile();
     void setUpdateSequenceNumber(qint32 updateSequenceNumber);
     void setLastSyncedSequenceNumber(qint32 lastSyncedSequenceNumber);
     void setConflicting(bool conflicting);
@@ -224,6 +229,11 @@ private:
 
     void loadFromCacheFile() const;
 
+    // Only the notes owned by the NotesStore are searchable, not clones or conflicting copies.
+    // Until the index is complete, it picks up all changes when it's being built.
+    bool inSearchIndex() const;
+    void updateSearchIndex(const QString &plaintext);
+
 private:
     QString m_guid;
     QString m_notebookGuid;
@@ -237,12 +247,11 @@ private:
     QDateTime m_reminderTime;
     QDateTime m_reminderDoneTime;
     bool m_deleted;
-    bool m_isSearchResult;
     QHash<QString, Resource*> m_resources;
     qint32 m_updateSequenceNumber;
     qint32 m_lastSyncedSequenceNumber;
-    mutable QFile m_cacheFile;
-    QString m_infoFile;
+    // The note as the server sent it last, see NoteInfo::edam
+    QByteArray m_edam;
 
     bool m_loading;
     mutable bool m_loaded;
@@ -21,10 +21,14 @@
 #include "notebook.h"
 #include "notesstore.h"
 #include "note.h"
+#include "logging.h"
+#include "utils/edamcodec.h"
 
 #include <libintl.h>
 
 #include <QLocale>
+#include <QSet>
+#include <QSettings>
 #include <QStandardPaths>
 
 Notebook::Notebook(QString guid, quint32 updateSequenceNumber, QObject *parent) :
@@ -37,23 +41,28 @@ Notebook::Notebook(QString guid, quint32 updateSequenceNumber, QObject *parent)
     m_loading(false),
     m_syncError(false)
 {
-    setGuid(guid);
-    QSettings infoFile(m_infoFile, QSettings::IniFormat);
-    m_name = infoFile.value("name").toString();
-    m_published = infoFile.value("published").toBool();
-    m_lastUpdated = infoFile.value("lastUpdated").toDateTime();
-    m_lastSyncedSequenceNumber = infoFile.value("lastSyncedSequenceNumber", 0).toUInt();
-    m_isDefaultNotebook = infoFile.value("isDefaultNotebook", false).toBool();
-    m_synced = m_lastSyncedSequenceNumber == m_updateSequenceNumber;
-    m_deleted = infoFile.value("deleted", false).toBool();
+    EdamTable *table = NotesStore::instance()->notebookTable();
+    if (!table->contains(guid)) {
+        migrateInfoFile();
+    }
 
-    foreach (Note *note, NotesStore::instance()->notes()) {
-        if (note->notebookGuid() == m_guid) {
-            m_notesList.append(note->guid());
-        }
+    EdamRecord record = table->record(guid);
+    evernote::edam::Notebook notebook;
+    if (!record.edam.isEmpty()) {
+        EdamCodec::decode(record.edam, &notebook);
     }
-    connect(NotesStore::instance(), &NotesStore::noteAdded, this, &Notebook::noteAdded);
-    connect(NotesStore::instance(), &NotesStore::noteRemoved, this, &Notebook::noteRemoved);
+    m_edam = record.edam;
+    m_name = QString::fromStdString(notebook.name);
+    m_published = notebook.__isset.published && notebook.published;
+    m_lastUpdated = notebook.__isset.serviceUpdated ? QDateTime::fromMSecsSinceEpoch(notebook.serviceUpdated) : QDateTime();
+    m_isDefaultNotebook = notebook.__isset.defaultNotebook && notebook.defaultNotebook;
+    m_lastSyncedSequenceNumber = record.lastSyncedSequenceNumber;
+    m_synced = m_lastSyncedSequenceNumber == m_updateSequenceNumber;
+    m_deleted = record.deleted;
+
+    m_notesList = NotesStore::instance()->notesInNotebook(m_guid);
+    connect(NotesStore::instance(), &NotesStore::notesAdded, this, &Notebook::notesAdded);
+    connect(NotesStore::instance(), &NotesStore::notesRemoved, this, &Notebook::notesRemoved);
     connect(NotesStore::instance(), &NotesStore::noteChanged, this, &Notebook::noteChanged);
     connect(NotesStore::instance(), &NotesStore::noteGuidChanged, this, &Notebook::noteGuidChanged);
 }
@@ -158,6 +167,7 @@ Notebook *Notebook::clone()
     notebook->setLastUpdated(m_lastUpdated);
     notebook->setPublished(m_published);
     notebook->setDeleted(m_deleted);
+    notebook->m_edam = m_edam;
 
     return notebook;
 }
@@ -167,20 +177,31 @@ void Notebook::save()
     NotesStore::instance()->saveNotebook(m_guid);
 }
 
-void Notebook::noteAdded(const QString &noteGuid, const QString &notebookGuid)
+void Notebook::notesAdded(const QStringList &noteGuids)
 {
-    Q_UNUSED(noteGuid)
-    if (notebookGuid == m_guid) {
-        m_notesList.append(noteGuid);
+    int count = m_notesList.count();
+    foreach (const QString &noteGuid, noteGuids) {
+        Note *note = NotesStore::instance()->note(noteGuid);
+        if (note && note->notebookGuid() == m_guid) {
+            m_notesList.append(noteGuid);
+        }
+    }
+    if (m_notesList.count() != count) {
         emit noteCountChanged();
     }
 }
 
-void Notebook::noteRemoved(const QString &noteGuid, const QString &notebookGuid)
+void Notebook::notesRemoved(const QStringList &noteGuids)
 {
-    Q_UNUSED(noteGuid)
-    if (notebookGuid == m_guid) {
-        m_notesList.removeAll(noteGuid);
+    QSet<QString> removed = noteGuids.toSet();
+    QList<QString> notesList;
+    foreach (const QString &noteGuid, m_notesList) {
+        if (!removed.contains(noteGuid)) {
+            notesList.append(noteGuid);
+        }
+    }
+    if (notesList.count() != m_notesList.count()) {
+        m_notesList = notesList;
         emit noteCountChanged();
     }
 }
@@ -210,40 +231,68 @@ void Notebook::noteGuidChanged(const QString &oldGuid, const QString &newGuid)
 
 void Notebook::setGuid(const QString &guid)
 {
-    bool syncToFile = false;
-    if (!m_infoFile.isEmpty()) {
-        QFile ifile(m_infoFile);
-        ifile.remove();
-
-        syncToFile = true;
+    if (guid == m_guid) {
+        return;
     }
-
+    NotesStore::instance()->notebookTable()->remove(m_guid);
     m_guid = guid;
-    m_infoFile = NotesStore::instance()->storageLocation() + "notebook-" + guid + ".info";
-
-    if (syncToFile) {
-        syncToInfoFile();
-    }
+    syncToInfoFile();
     emit guidChanged();
 }
 
 void Notebook::syncToInfoFile()
 {
-    QSettings infoFile(m_infoFile, QSettings::IniFormat);
-    infoFile.setValue("name", m_name);
-    infoFile.setValue("published", m_published);
-    infoFile.value("lastUpdated", m_lastUpdated);
-    infoFile.setValue("lastSyncedSequenceNumber", m_lastSyncedSequenceNumber);
-    infoFile.setValue("isDefaultNotebook", m_isDefaultNotebook);
-    infoFile.setValue("deleted", m_deleted);
+    // Written over what the server sent, so fields we don't know about stay
+    evernote::edam::Notebook notebook;
+    if (!m_edam.isEmpty()) {
+        EdamCodec::decode(m_edam, &notebook);
+    }
+    notebook.guid = m_guid.toStdString();
+    notebook.__isset.guid = true;
+    notebook.name = m_name.toStdString();
+    notebook.__isset.name = true;
+    notebook.updateSequenceNum = m_updateSequenceNumber;
+    notebook.__isset.updateSequenceNum = true;
+    notebook.published = m_published;
+    notebook.__isset.published = true;
+    notebook.defaultNotebook = m_isDefaultNotebook;
+    notebook.__isset.defaultNotebook = true;
+    notebook.serviceUpdated = m_lastUpdated.isValid() ? m_lastUpdated.toMSecsSinceEpoch() : 0;
+    notebook.__isset.serviceUpdated = m_lastUpdated.isValid();
+
+    EdamRecord record;
+    record.guid = m_guid;
+    record.edam = EdamCodec::encode(notebook);
+    record.lastSyncedSequenceNumber = m_lastSyncedSequenceNumber;
+    record.deleted = m_deleted;
+    NotesStore::instance()->notebookTable()->write(record);
 }
 
 void Notebook::deleteInfoFile()
 {
-    QFile f(m_infoFile);
-    if (f.exists()) {
-        f.remove();
+    NotesStore::instance()->notebookTable()->remove(m_guid);
+}
+
+void Notebook::migrateInfoFile()
+{
+    QString infoFileName = NotesStore::instance()->storageLocation() + "notebook-" + m_guid + ".info";
+    if (!QFile::exists(infoFileName)) {
+        return;
     }
+
+    {
+        QSettings infoFile(infoFileName, QSettings::IniFormat);
+        m_name = infoFile.value("name").toString();
+        m_published = infoFile.value("published").toBool();
+        m_lastUpdated = infoFile.value("lastUpdated").toDateTime();
+        m_lastSyncedSequenceNumber = infoFile.value("lastSyncedSequenceNumber", 0).toUInt();
+        m_isDefaultNotebook = infoFile.value("isDefaultNotebook", false).toBool();
+        m_deleted = infoFile.value("deleted", false).toBool();
+    }
+
+    syncToInfoFile();
+    QFile::remove(infoFileName);
+    qCDebug(dcStorage) << "Migrated" << infoFileName << "to the notebook table";
 }
 
 bool Notebook::loading() const
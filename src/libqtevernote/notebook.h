@@ -22,8 +22,9 @@
 #define NOTEBOOK_H
 
 #include <QObject>
+#include <QByteArray>
 #include <QDateTime>
-#include <QSettings>
+#include <QStringList>
 
 class Notebook : public QObject
 {
@@ -92,8 +93,8 @@ signals:
     void deletedChanged();
 
 private slots:
-    void noteAdded(const QString &noteGuid, const QString &notebookGuid);
-    void noteRemoved(const QString &noteGuid, const QString &notebookGuid);
+    void notesAdded(const QStringList &noteGuids);
+    void notesRemoved(const QStringList &noteGuids);
     void noteChanged(const QString &noteGuid, const QString &notebookGuid);
     void noteGuidChanged(const QString &oldGuid, const QString &newGuid);
 
@@ -108,6 +109,7 @@ private:
 
     void syncToInfoFile();
     void deleteInfoFile();
+    void migrateInfoFile();
 
 private:
     qint32 m_updateSequenceNumber;
@@ -120,7 +122,8 @@ private:
     QList<QString> m_notesList;
     bool m_deleted;
 
-    QString m_infoFile;
+    // The notebook as the server sent it last, see EdamCodec
+    QByteArray m_edam;
 
     bool m_loading;
     bool m_synced;
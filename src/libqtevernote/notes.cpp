@@ -26,7 +26,10 @@ Notes::Notes(QObject *parent) :
     m_onlyReminders(false),
     m_onlySearchResults(false),
     m_showDeleted(true),
-    m_sortOrder(SortOrderDateUpdatedNewest)
+    m_sortOrder(SortOrderDateUpdatedNewest),
+    m_filterRowsValid(false),
+    m_filterRowsGeneration(0),
+    m_searchResultsGeneration(0)
 {
     connect(NotesStore::instance(), &NotesStore::loadingChanged, this, &Notes::loadingChanged);
     connect(NotesStore::instance(), &NotesStore::errorChanged, this, &Notes::errorChanged);
@@ -46,6 +49,7 @@ void Notes::setFilterNotebookGuid(const QString &notebookGuid)
 {
     if (m_filterNotebookGuid != notebookGuid) {
         m_filterNotebookGuid = notebookGuid;
+        m_filterRowsValid = false;
         emit filterNotebookGuidChanged();
         invalidateFilter();
         emit countChanged();
@@ -61,6 +65,7 @@ void Notes::setFilterTagGuid(const QString &tagGuid)
 {
     if (m_filterTagGuid != tagGuid) {
         m_filterTagGuid = tagGuid;
+        m_filterRowsValid = false;
         emit filterTagGuidChanged();
         invalidateFilter();
         emit countChanged();
@@ -76,6 +81,7 @@ void Notes::setOnlyReminders(bool onlyReminders)
 {
     if (m_onlyReminders != onlyReminders) {
         m_onlyReminders = onlyReminders;
+        m_filterRowsValid = false;
         emit onlyRemindersChanged();
         if (onlyReminders) {
             setSortRole(NotesStore::RoleReminderSorting);
@@ -99,6 +105,7 @@ void Notes::setOnlySearchResults(bool onlySearchResults)
 {
     if (m_onlySearchResults != onlySearchResults) {
         m_onlySearchResults = onlySearchResults;
+        m_filterRowsValid = false;
         emit onlySearchResultsChanged();
         invalidateFilter();
         emit countChanged();
@@ -114,6 +121,7 @@ void Notes::setShowDeleted(bool showDeleted)
 {
     if (m_showDeleted != showDeleted) {
         m_showDeleted = showDeleted;
+        m_filterRowsValid = false;
         emit showDeletedChanged();
         invalidateFilter();
         emit countChanged();
@@ -163,6 +171,7 @@ void Notes::setSortOrder(Notes::SortOrder sortOrder)
 {
     if (m_sortOrder != sortOrder) {
         emit layoutAboutToBeChanged();
+        m_sortOrder = sortOrder;
         switch (sortOrder) {
         case SortOrderDateCreatedNewest:
             setSortRole(NotesStore::RoleCreated);
@@ -188,8 +197,11 @@ void Notes::setSortOrder(Notes::SortOrder sortOrder)
             setSortRole(NotesStore::RoleTitle);
             sort(0, Qt::DescendingOrder);
             break;
+        case SortOrderRelevance:
+            setSortRole(NotesStore::RoleSearchScore);
+            sort(0, Qt::DescendingOrder);
+            break;
         }
-        m_sortOrder = sortOrder;
         emit sortOrderChanged();
         emit layoutChanged();
     }
@@ -197,56 +209,62 @@ void Notes::setSortOrder(Notes::SortOrder sortOrder)
 
 bool Notes::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
-    QModelIndex sourceIndex = sourceModel()->index(sourceRow, 0, sourceParent);
-    if (!m_filterNotebookGuid.isEmpty()) {
-        if (sourceModel()->data(sourceIndex, NotesStore::RoleNotebookGuid).toString() != m_filterNotebookGuid) {
-            return false;
-        }
-    }
-    if (!m_filterTagGuid.isEmpty()) {
-        if (!sourceModel()->data(sourceIndex, NotesStore::RoleTagGuids).toStringList().contains(m_filterTagGuid)) {
-            return false;
-        }
-    }
-    if (m_onlyReminders) {
-        if (!sourceModel()->data(sourceIndex, NotesStore::RoleReminder).toBool()) {
-            return false;
-        }
-    }
-    if (m_onlySearchResults) {
-        Note *note = NotesStore::instance()->note(sourceModel()->data(sourceIndex, NotesStore::RoleGuid).toString());
-        if (!note->isSearchResult()) {
-            return false;
-        }
-    }
-    if (!m_showDeleted) {
-        if (NotesStore::instance()->data(sourceIndex, NotesStore::RoleDeleted).toBool()) {
-            return false;
-        }
+    Q_UNUSED(sourceParent)
+
+    NotesStore *store = NotesStore::instance();
+    if (!m_filterRowsValid || m_filterRowsGeneration != store->attributeIndex()->filterGeneration()
+            || (m_onlySearchResults && m_searchResultsGeneration != store->searchResultsGeneration())) {
+        updateFilterRows();
     }
-    return true;
+    return sourceRow < m_filterRows.size() && m_filterRows.testBit(sourceRow);
 }
 
+// Compares the keys the attribute index keeps for every row and the store's search
+// scores, so sorting doesn't need to ask the model for anything
 bool Notes::lessThan(const QModelIndex &left, const QModelIndex &right) const
 {
-    QVariant leftValue = sourceModel()->data(left, sortRole());
-    QVariant rightValue = sourceModel()->data(right, sortRole());
-
-    switch (m_sortOrder) {
-    case SortOrderDateCreatedNewest:
-    case SortOrderDateCreatedOldest:
-    case SortOrderDateUpdatedNewest:
-    case SortOrderDateUpdatedOldest:
-        if (leftValue.toDateTime().toMSecsSinceEpoch() < rightValue.toDateTime().toMSecsSinceEpoch()) {
-            return true;
-        } else if (leftValue.toDateTime().toMSecsSinceEpoch() > rightValue.toDateTime().toMSecsSinceEpoch()) {
-            return false;
+    NotesStore *store = NotesStore::instance();
+    const NoteAttributeIndex *attributeIndex = store->attributeIndex();
+    int leftRow = left.row();
+    int rightRow = right.row();
+
+    switch (sortRole()) {
+    case NotesStore::RoleCreated:
+        return attributeIndex->date(NoteAttributeIndex::DateCreated, leftRow) < attributeIndex->date(NoteAttributeIndex::DateCreated, rightRow);
+    case NotesStore::RoleReminderSorting:
+        return attributeIndex->reminderOrder(leftRow) < attributeIndex->reminderOrder(rightRow);
+    case NotesStore::RoleTitle:
+        return attributeIndex->compareTitles(leftRow, rightRow) < 0;
+    case NotesStore::RoleSearchScore: {
+        qreal leftScore = store->searchScore(attributeIndex->guid(leftRow));
+        qreal rightScore = store->searchScore(attributeIndex->guid(rightRow));
+        if (leftScore != rightScore) {
+            return leftScore < rightScore;
         }
+        // Equally good matches show the most recently updated first
         break;
-    case SortOrderTitleAscending:
-    case SortOrderTitleDescending:
-        // fall trough
-        break;
     }
-    return leftValue.toString() < rightValue.toString();
+    }
+    return attributeIndex->date(NoteAttributeIndex::DateUpdated, leftRow) < attributeIndex->date(NoteAttributeIndex::DateUpdated, rightRow);
+}
+
+void Notes::updateFilterRows() const
+{
+    NotesStore *store = NotesStore::instance();
+    const NoteAttributeIndex *attributeIndex = store->attributeIndex();
+
+    NoteAttributeIndex::Filter filter;
+    filter.notebookGuid = m_filterNotebookGuid;
+    filter.tagGuid = m_filterTagGuid;
+    filter.onlyReminders = m_onlyReminders;
+    filter.showDeleted = m_showDeleted;
+    RowBitmap rows = attributeIndex->filter(filter);
+    if (m_onlySearchResults) {
+        rows &= store->searchResultRows();
+    }
+
+    m_filterRows = rows.toBitArray(attributeIndex->count());
+    m_filterRowsValid = true;
+    m_filterRowsGeneration = attributeIndex->filterGeneration();
+    m_searchResultsGeneration = store->searchResultsGeneration();
 }
@@ -23,6 +23,7 @@
 
 #include "notesstore.h"
 
+#include <QBitArray>
 #include <QSortFilterProxyModel>
 
 class Notes : public QSortFilterProxyModel
@@ -46,7 +47,8 @@ public:
         SortOrderDateUpdatedNewest,
         SortOrderDateUpdatedOldest,
         SortOrderTitleAscending,
-        SortOrderTitleDescending
+        SortOrderTitleDescending,
+        SortOrderRelevance
     };
 
     explicit Notes(QObject *parent = 0);
@@ -92,6 +94,9 @@ signals:
     void countChanged();
     void sortOrderChanged();
 
+private:
+    void updateFilterRows() const;
+
 private:
     QString m_filterNotebookGuid;
     QString m_filterTagGuid;
@@ -99,6 +104,14 @@ private:
     bool m_onlySearchResults;
     bool m_showDeleted;
     SortOrder m_sortOrder;
+
+    // The rows passing all filters, one bit for each row of the NotesStore. Built from
+    // its attribute index and search results whenever they or the filters change, so
+    // filtering a row only tests a bit.
+    mutable QBitArray m_filterRows;
+    mutable bool m_filterRowsValid;
+    mutable quint64 m_filterRowsGeneration;
+    mutable quint64 m_searchResultsGeneration;
 };
 
 #endif // NOTES_H
@@ -24,6 +24,7 @@
 #include "notebook.h"
 #include "note.h"
 #include "tag.h"
+#include "utils/edamcodec.h"
 #include "utils/enmldocument.h"
 #include "utils/organizeradapter.h"
 #include "userstore.h"
@@ -32,6 +33,7 @@
 #include "jobs/fetchnotesjob.h"
 #include "jobs/fetchnotebooksjob.h"
 #include "jobs/fetchnotejob.h"
+#include "jobs/fetchrecognitionjob.h"
 #include "jobs/createnotejob.h"
 #include "jobs/savenotejob.h"
 #include "jobs/savenotebookjob.h"
@@ -45,12 +47,34 @@
 
 #include "libintl.h"
 
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QGuiApplication>
 #include <QImage>
 #include <QStandardPaths>
 #include <QUuid>
 #include <QPointer>
+#include <QSet>
 #include <QDir>
 
+#include <algorithm>
+#include <functional>
+
+// Number of notes created from the cache in one go while hydrating the snapshot
+#define HYDRATE_BATCH_SIZE 200
+// Number of notes parsed and indexed in one go while the search index catches up
+#define INDEX_BATCH_SIZE 20
+// Marks a change of all roles in m_changedRows
+#define ALL_ROLES (~Q_UINT64_C(0))
+// Adding or removing at least this many notes, and more than there are left, resets the
+// model instead of telling about the rows
+#define RESET_THRESHOLD 500
+// Keeps the top ranks of either search result list from outweighing everything else
+#define SEARCH_RANK_OFFSET 60
+// Server results past this rank hardly change the fused scores, so they aren't fetched
+#define SEARCH_SERVER_RANKS 100
+
 NotesStore* NotesStore::s_instance = 0;
 
 NotesStore::NotesStore(QObject *parent) :
@@ -58,10 +82,45 @@ NotesStore::NotesStore(QObject *parent) :
     m_username("@invalid "),
     m_loading(false),
     m_notebooksLoading(false),
-    m_tagsLoading(false)
+    m_tagsLoading(false),
+    m_hydrateRow(0),
+    m_lazyLoading(true),
+    m_searchIndexLive(false),
+    m_searchResultsGeneration(0),
+    m_searchSnippetsGeneration(0),
+    m_searchQueryGeneration(0),
+    m_lastSearchGeneration(0),
+    m_indexRecognition(false),
+    m_recognitionJobRunning(false)
 {
     qCDebug(dcNotesStore) << "Creating NotesStore instance.";
     connect(UserStore::instance(), &UserStore::userChanged, this, &NotesStore::userStoreConnected);
+    connect(&m_writeQueue, &WriteBehindQueue::flushRequested, this, &NotesStore::flushCache);
+
+    m_hydrateTimer.setInterval(0);
+    connect(&m_hydrateTimer, &QTimer::timeout, this, &NotesStore::hydrateNotes);
+
+    m_indexTimer.setInterval(0);
+    connect(&m_indexTimer, &QTimer::timeout, this, &NotesStore::indexNotes);
+
+    m_dataChangedTimer.setInterval(0);
+    m_dataChangedTimer.setSingleShot(true);
+    connect(&m_dataChangedTimer, &QTimer::timeout, this, &NotesStore::flushDataChanged);
+
+    // Connected before anybody else, so the attribute index is up to date by the time
+    // proxy models filter the changed rows
+    connect(this, &NotesStore::rowsInserted, this, &NotesStore::attributeRowsInserted);
+    connect(this, &NotesStore::rowsRemoved, this, &NotesStore::attributeRowsRemoved);
+    connect(this, &NotesStore::modelReset, this, &NotesStore::attributesReset);
+    connect(this, &NotesStore::dataChanged, this, &NotesStore::attributesChanged);
+
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &NotesStore::saveSnapshot);
+    }
+    QGuiApplication *app = qobject_cast<QGuiApplication*>(QCoreApplication::instance());
+    if (app) {
+        connect(app, &QGuiApplication::applicationStateChanged, this, &NotesStore::applicationStateChanged);
+    }
 
     qRegisterMetaType<evernote::edam::NotesMetadataList>("evernote::edam::NotesMetadataList");
     qRegisterMetaType<evernote::edam::Note>("evernote::edam::Note");
@@ -105,6 +164,8 @@ void NotesStore::setUsername(const QString &username)
     }
 
     if (m_username != username) {
+        flushCache();
+        saveSnapshot();
         m_username = username;
         emit usernameChanged();
 
@@ -115,8 +176,15 @@ void NotesStore::setUsername(const QString &username)
             f.remove();
         }
 
-        m_cacheFile = storageLocation() + "notes.cache";
-        qCDebug(dcNotesStore) << "Initialized cacheFile:" << m_cacheFile;
+        m_cacheJournal.open(storageLocation() + "notes.journal", storageLocation() + "notes.cache");
+        m_noteInfoTable.open(storageLocation() + "notes.table");
+        m_notebookTable.open(storageLocation() + "notebooks.table");
+        m_tagTable.open(storageLocation() + "tags.table");
+        m_contentStore.open(storageLocation() + "notes.pack", storageLocation());
+        m_thumbnailCache.open(storageLocation());
+        m_resourceStore.open(storageLocation(), &m_noteInfoTable, &m_thumbnailCache);
+        m_searchIndex.open(storageLocation() + "search/");
+        qCDebug(dcNotesStore) << "Initialized cache journal in:" << storageLocation();
         loadFromCacheFile();
     }
 }
@@ -126,6 +194,71 @@ QString NotesStore::storageLocation()
     return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/" + m_username + "/";
 }
 
+NoteInfoTable *NotesStore::noteInfoTable()
+{
+    return &m_noteInfoTable;
+}
+
+EdamTable *NotesStore::notebookTable()
+{
+    return &m_notebookTable;
+}
+
+EdamTable *NotesStore::tagTable()
+{
+    return &m_tagTable;
+}
+
+ContentStore *NotesStore::contentStore()
+{
+    return &m_contentStore;
+}
+
+ResourceStore *NotesStore::resourceStore()
+{
+    return &m_resourceStore;
+}
+
+ThumbnailCache *NotesStore::thumbnailCache()
+{
+    return &m_thumbnailCache;
+}
+
+SearchIndex *NotesStore::searchIndex()
+{
+    return &m_searchIndex;
+}
+
+bool NotesStore::searchIndexLive() const
+{
+    return m_searchIndexLive;
+}
+
+const NoteAttributeIndex *NotesStore::attributeIndex() const
+{
+    return &m_attributeIndex;
+}
+
+RowBitmap NotesStore::searchResultRows() const
+{
+    return m_attributeIndex.rows(m_searchScores.keys().toSet());
+}
+
+quint64 NotesStore::searchResultsGeneration() const
+{
+    return m_searchResultsGeneration;
+}
+
+bool NotesStore::isSearchResult(const QString &guid) const
+{
+    return m_searchScores.contains(guid);
+}
+
+qreal NotesStore::searchScore(const QString &guid) const
+{
+    return m_searchScores.value(guid);
+}
+
 void NotesStore::userStoreConnected()
 {
     QString username = UserStore::instance()->userName();
@@ -162,6 +295,38 @@ int NotesStore::count() const
     return rowCount();
 }
 
+bool NotesStore::lazyLoading() const
+{
+    return m_lazyLoading;
+}
+
+void NotesStore::setLazyLoading(bool lazyLoading)
+{
+    if (m_lazyLoading != lazyLoading) {
+        m_lazyLoading = lazyLoading;
+        emit lazyLoadingChanged();
+
+        if (m_lazyLoading) {
+            m_hydrateTimer.stop();
+        } else if (!m_snapshotRows.isEmpty()) {
+            m_hydrateTimer.start();
+        }
+    }
+}
+
+bool NotesStore::compressionDictionary() const
+{
+    return m_contentStore.dictionaryEnabled();
+}
+
+void NotesStore::setCompressionDictionary(bool compressionDictionary)
+{
+    if (m_contentStore.dictionaryEnabled() != compressionDictionary) {
+        m_contentStore.setDictionaryEnabled(compressionDictionary);
+        emit compressionDictionaryChanged();
+    }
+}
+
 int NotesStore::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent)
@@ -170,59 +335,84 @@ int NotesStore::rowCount(const QModelIndex &parent) const
 
 QVariant NotesStore::data(const QModelIndex &index, int role) const
 {
+    Note *note = m_notes.at(index.row());
+    if (!note) {
+        switch (role) {
+        case RoleEnmlContent:
+        case RoleHtmlContent:
+        case RoleRichTextContent:
+        case RolePlaintextContent:
+            // The content isn't in the snapshot, we need the real thing. The view hears
+            // about it once it's there.
+            if (m_hydrateRequests.isEmpty()) {
+                QTimer::singleShot(0, this, SLOT(hydrateRequestedNotes()));
+            }
+            m_hydrateRequests.insert(m_snapshotRows.at(index.row()).guid);
+            return QVariant();
+        default:
+            return snapshotData(m_snapshotRows.at(index.row()), role);
+        }
+    }
+
     switch (role) {
     case RoleGuid:
-        return m_notes.at(index.row())->guid();
+        return note->guid();
     case RoleNotebookGuid:
-        return m_notes.at(index.row())->notebookGuid();
+        return note->notebookGuid();
     case RoleCreated:
-        return m_notes.at(index.row())->created();
+        return note->created();
     case RoleCreatedString:
-        return m_notes.at(index.row())->createdString();
+        return note->createdString();
     case RoleUpdated:
-        return m_notes.at(index.row())->updated();
+        return note->updated();
     case RoleUpdatedString:
-        return m_notes.at(index.row())->updatedString();
+        return note->updatedString();
     case RoleTitle:
-        return m_notes.at(index.row())->title();
+        return note->title();
     case RoleReminder:
-        return m_notes.at(index.row())->reminder();
+        return note->reminder();
     case RoleReminderTime:
-        return m_notes.at(index.row())->reminderTime();
+        return note->reminderTime();
     case RoleReminderTimeString:
-        return m_notes.at(index.row())->reminderTimeString();
+        return note->reminderTimeString();
     case RoleReminderDone:
-        return m_notes.at(index.row())->reminderDone();
+        return note->reminderDone();
     case RoleReminderDoneTime:
-        return m_notes.at(index.row())->reminderDoneTime();
+        return note->reminderDoneTime();
+    case RoleIsSearchResult:
+        return m_searchScores.contains(note->guid());
     case RoleEnmlContent:
-        return m_notes.at(index.row())->enmlContent();
+        return note->enmlContent();
     case RoleHtmlContent:
-        return m_notes.at(index.row())->htmlContent();
+        return note->htmlContent();
     case RoleRichTextContent:
-        return m_notes.at(index.row())->richTextContent();
+        return note->richTextContent();
     case RolePlaintextContent:
-        return m_notes.at(index.row())->plaintextContent();
+        return note->plaintextContent();
     case RoleTagline:
-        return m_notes.at(index.row())->tagline();
+        return note->tagline();
     case RoleResourceUrls:
-        return m_notes.at(index.row())->resourceUrls();
+        return note->resourceUrls();
     case RoleReminderSorting:
         // done reminders get +1000000000000 (this will break sorting in year 2286 :P)
-        return QVariant::fromValue(m_notes.at(index.row())->reminderTime().toMSecsSinceEpoch() +
-                (m_notes.at(index.row())->reminderDone() ? 10000000000000 : 0));
+        return QVariant::fromValue(note->reminderTime().toMSecsSinceEpoch() +
+                (note->reminderDone() ? 10000000000000 : 0));
     case RoleTagGuids:
-        return m_notes.at(index.row())->tagGuids();
+        return note->tagGuids();
     case RoleDeleted:
-        return m_notes.at(index.row())->deleted();
+        return note->deleted();
     case RoleSynced:
-        return m_notes.at(index.row())->synced();
+        return note->synced();
     case RoleLoading:
-        return m_notes.at(index.row())->loading();
+        return note->loading();
     case RoleSyncError:
-        return m_notes.at(index.row())->syncError();
+        return note->syncError();
     case RoleConflicting:
-        return m_notes.at(index.row())->conflicting();
+        return note->conflicting();
+    case RoleSearchScore:
+        return m_searchScores.value(note->guid());
+    case RoleSearchSnippet:
+        return searchSnippet(note->guid());
     }
     return QVariant();
 }
@@ -254,26 +444,75 @@ QHash<int, QByteArray> NotesStore::roleNames() const
     roles.insert(RoleSynced, "synced");
     roles.insert(RoleSyncError, "syncError");
     roles.insert(RoleConflicting, "conflicting");
+    roles.insert(RoleSearchScore, "searchScore");
+    roles.insert(RoleSearchSnippet, "searchSnippet");
     return roles;
 }
 
 NotesStore::~NotesStore()
 {
+    // Cancelled queries may still be finishing up
+    foreach (SearchIndexQuery *query, findChildren<SearchIndexQuery*>()) {
+        query->cancel();
+        query->wait();
+    }
+
+    // Resources unregister from the resource store when they go away
+    qDeleteAll(m_notes);
+    m_notes.clear();
 }
 
-QList<Note*> NotesStore::notes() const
+QList<Note*> NotesStore::notes()
 {
+    hydrateAllNotes();
     return m_notes;
 }
 
-Note *NotesStore::note(int index) const
+Note *NotesStore::note(int index)
 {
-    return m_notes.at(index);
+    Note *note = m_notes.at(index);
+    if (!note) {
+        note = hydrateNote(index);
+        queueDataChanged(index);
+    }
+    return note;
 }
 
 Note *NotesStore::note(const QString &guid)
 {
-    return m_notesHash.value(guid);
+    return findNote(guid);
+}
+
+QStringList NotesStore::notesInNotebook(const QString &notebookGuid) const
+{
+    QStringList guids;
+    for (int i = 0; i < m_notes.count(); i++) {
+        Note *note = m_notes.at(i);
+        if (note) {
+            if (note->notebookGuid() == notebookGuid) {
+                guids.append(note->guid());
+            }
+        } else if (m_snapshotRows.at(i).notebookGuid == notebookGuid) {
+            guids.append(m_snapshotRows.at(i).guid);
+        }
+    }
+    return guids;
+}
+
+QStringList NotesStore::notesWithTag(const QString &tagGuid) const
+{
+    QStringList guids;
+    for (int i = 0; i < m_notes.count(); i++) {
+        Note *note = m_notes.at(i);
+        if (note) {
+            if (note->tagGuids().contains(tagGuid)) {
+                guids.append(note->guid());
+            }
+        } else if (m_snapshotRows.at(i).tagGuids.contains(tagGuid)) {
+            guids.append(m_snapshotRows.at(i).guid);
+        }
+    }
+    return guids;
 }
 
 QList<Notebook *> NotesStore::notebooks() const
@@ -340,6 +579,7 @@ void NotesStore::createNotebookJobDone(EvernoteConnection::ErrorCode errorCode,
     qCDebug(dcNotesStore) << "Changing notebook guid. Old guid:" << tmpGuid << "New guid:" << guid;
 
     m_notebooksHash.insert(guid, notebook);
+    notebook->m_edam = EdamCodec::encode(result);
     notebook->setGuid(QString::fromStdString(result.guid));
     emit notebookGuidChanged(tmpGuid, notebook->guid());
     m_notebooksHash.remove(tmpGuid);
@@ -349,10 +589,7 @@ void NotesStore::createNotebookJobDone(EvernoteConnection::ErrorCode errorCode,
     notebook->setName(QString::fromStdString(result.name));
     emit notebookChanged(notebook->guid());
 
-    QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
-    cacheFile.beginGroup("notebooks");
-    cacheFile.remove(tmpGuid);
-    cacheFile.endGroup();
+    m_cacheJournal.removeEntry(CacheJournal::KindNotebook, tmpGuid);
 
     syncToCacheFile(notebook);
 
@@ -464,7 +701,7 @@ void NotesStore::expungeNotebook(const QString &guid)
 
         while (notebook->noteCount() > 0) {
             QString noteGuid = notebook->noteAt(0);
-            Note *note = m_notesHash.value(noteGuid);
+            Note *note = findNote(noteGuid);
             if (!note) {
                 qCWarning(dcNotesStore) << "Notebook holds a noteGuid which cannot be found in notes store";
                 Q_ASSERT(false);
@@ -484,10 +721,7 @@ void NotesStore::expungeNotebook(const QString &guid)
         m_notebooksHash.remove(notebook->guid());
         emit notebookRemoved(notebook->guid());
 
-        QSettings settings(m_cacheFile, QSettings::IniFormat);
-        settings.beginGroup("notebooks");
-        settings.remove(notebook->guid());
-        settings.endGroup();
+        m_cacheJournal.removeEntry(CacheJournal::KindNotebook, notebook->guid());
 
         notebook->deleteInfoFile();
         notebook->deleteLater();
@@ -562,6 +796,7 @@ void NotesStore::createTagJobDone(EvernoteConnection::ErrorCode errorCode, const
 
     QString guid = QString::fromStdString(result.guid);
     m_tagsHash.insert(guid, tag);
+    tag->m_edam = EdamCodec::encode(result);
     tag->setGuid(QString::fromStdString(result.guid));
     emit tagGuidChanged(tmpGuid, guid);
     m_tagsHash.remove(tmpGuid);
@@ -570,10 +805,7 @@ void NotesStore::createTagJobDone(EvernoteConnection::ErrorCode errorCode, const
     tag->setLastSyncedSequenceNumber(result.updateSequenceNum);
     emit tagChanged(tag->guid());
 
-    QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
-    cacheFile.beginGroup("tags");
-    cacheFile.remove(tmpGuid);
-    cacheFile.endGroup();
+    m_cacheJournal.removeEntry(CacheJournal::KindTag, tmpGuid);
 
     syncToCacheFile(tag);
 
@@ -599,6 +831,7 @@ void NotesStore::saveTagJobDone(EvernoteConnection::ErrorCode errorCode, const Q
         return;
     }
 
+    tag->m_edam = EdamCodec::encode(result);
     tag->setName(QString::fromStdString(result.name));
     tag->setUpdateSequenceNumber(result.updateSequenceNum);
     tag->setLastSyncedSequenceNumber(result.updateSequenceNum);
@@ -623,10 +856,7 @@ void NotesStore::expungeTagJobDone(EvernoteConnection::ErrorCode errorCode, cons
     Tag *tag = m_tagsHash.take(guid);
     m_tags.removeAll(tag);
 
-    QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
-    cacheFile.beginGroup("tags");
-    cacheFile.remove(guid);
-    cacheFile.endGroup();
+    m_cacheJournal.removeEntry(CacheJournal::KindTag, guid);
     tag->syncToInfoFile();
 
     tag->deleteInfoFile();
@@ -635,7 +865,7 @@ void NotesStore::expungeTagJobDone(EvernoteConnection::ErrorCode errorCode, cons
 
 void NotesStore::tagNote(const QString &noteGuid, const QString &tagGuid)
 {
-    Note *note = m_notesHash.value(noteGuid);
+    Note *note = findNote(noteGuid);
     if (!note) {
         qCWarning(dcNotesStore) << "No such note" << noteGuid;
         return;
@@ -658,7 +888,7 @@ void NotesStore::tagNote(const QString &noteGuid, const QString &tagGuid)
 
 void NotesStore::untagNote(const QString &noteGuid, const QString &tagGuid)
 {
-    Note *note = m_notesHash.value(noteGuid);
+    Note *note = findNote(noteGuid);
     if (!note) {
         qCWarning(dcNotesStore) << "No such note" << noteGuid;
         return;
@@ -693,7 +923,7 @@ void NotesStore::refreshNotes(const QString &filterNotebookGuid, int startIndex)
         emit loadingChanged();
 
         if (startIndex == 0) {
-            m_unhandledNotes = m_notesHash.keys();
+            m_unhandledNotes = m_notesHash.keys() + m_pendingNotes.keys();
         }
 
         FetchNotesJob *job = new FetchNotesJob(filterNotebookGuid, QString(), startIndex);
@@ -712,82 +942,7 @@ void NotesStore::fetchNotesJobDone(EvernoteConnection::ErrorCode errorCode, cons
         return;
     }
 
-    for (unsigned int i = 0; i < results.notes.size(); ++i) {
-        evernote::edam::NoteMetadata result = results.notes.at(i);
-        Note *note = m_notesHash.value(QString::fromStdString(result.guid));
-        m_unhandledNotes.removeAll(QString::fromStdString(result.guid));
-        QVector<int> changedRoles;
-        bool newNote = note == 0;
-        if (newNote) {
-            qCDebug(dcSync) << "Found new note on server. Creating local copy:" << QString::fromStdString(result.guid);
-            note = new Note(QString::fromStdString(result.guid), 0, this);
-            connect(note, &Note::reminderChanged, this, &NotesStore::emitDataChanged);
-            connect(note, &Note::reminderDoneChanged, this, &NotesStore::emitDataChanged);
-
-            updateFromEDAM(result, note);
-            beginInsertRows(QModelIndex(), m_notes.count(), m_notes.count());
-            m_notesHash.insert(note->guid(), note);
-            m_notes.append(note);
-            endInsertRows();
-            emit noteAdded(note->guid(), note->notebookGuid());
-            emit countChanged();
-            syncToCacheFile(note);
-
-        } else if (note->synced()) {
-            // Local note did not change. Check if we need to refresh from server.
-            if (note->updateSequenceNumber() < result.updateSequenceNum) {
-                qCDebug(dcSync) << "refreshing note from network. suequence number changed: " << note->updateSequenceNumber() << "->" << result.updateSequenceNum;
-                changedRoles = updateFromEDAM(result, note);
-                refreshNoteContent(note->guid(), FetchNoteJob::LoadContent, EvernoteJob::JobPriorityMedium);
-                syncToCacheFile(note);
-            }
-        } else {
-            // Local note changed. See if we can push our changes.
-            if (note->lastSyncedSequenceNumber() == result.updateSequenceNum) {
-                qCDebug(dcSync) << "Local note" << note->guid() << "has changed while server note did not. Pushing changes.";
-
-                // Make sure we have everything loaded from cache before saving to server
-                if (!note->loaded() && note->isCached()) {
-                    note->loadFromCacheFile();
-                }
-
-                note->setLoading(true);
-                changedRoles << RoleLoading;
-                SaveNoteJob *job = new SaveNoteJob(note, this);
-                connect(job, &SaveNoteJob::jobDone, this, &NotesStore::saveNoteJobDone);
-                EvernoteConnection::instance()->enqueue(job);
-            } else {
-                qCWarning(dcSync) << "********************************************************";
-                qCWarning(dcSync) << "* CONFLICT: Note has been changed on server and locally!";
-                qCWarning(dcSync) << "* local note sequence:" << note->updateSequenceNumber();
-                qCWarning(dcSync) << "* last synced sequence:" << note->lastSyncedSequenceNumber();
-                qCWarning(dcSync) << "* remote update sequence:" << result.updateSequenceNum;
-                qCWarning(dcSync) << "********************************************************";
-                note->setConflicting(true);
-                changedRoles << RoleConflicting;
-
-                // Not setting parent as we don't want to squash the reply.
-                FetchNoteJob::LoadWhatFlags flags = 0x0;
-                flags |= FetchNoteJob::LoadContent;
-                flags |= FetchNoteJob::LoadResources;
-                FetchNoteJob *fetchNoteJob = new FetchNoteJob(note->guid(), flags);
-                fetchNoteJob->setJobPriority(EvernoteJob::JobPriorityMedium);
-                connect(fetchNoteJob, &FetchNoteJob::resultReady, this, &NotesStore::fetchConflictingNoteJobDone);
-                EvernoteConnection::instance()->enqueue(fetchNoteJob);
-            }
-        }
-
-        if (!results.searchedWords.empty()) {
-            note->setIsSearchResult(true);
-            changedRoles << RoleIsSearchResult;
-        }
-
-        if (changedRoles.count() > 0) {
-            QModelIndex noteIndex = index(m_notes.indexOf(note));
-            emit dataChanged(noteIndex, noteIndex, changedRoles);
-            emit noteChanged(note->guid(), note->notebookGuid());
-        }
-    }
+    updateFromEDAM(results);
 
     if (results.startIndex + (int32_t)results.notes.size() < results.totalNotes) {
         qCDebug(dcSync) << "Not all notes fetched yet. Fetching next batch.";
@@ -795,12 +950,18 @@ void NotesStore::fetchNotesJobDone(EvernoteConnection::ErrorCode errorCode, cons
     } else {
         qCDebug(dcSync) << "Fetched all notes from Evernote. Starting sync of local-only notes.";
         m_organizerAdapter->startSync();
+        if (m_indexRecognition) {
+            for (int i = 0; i < m_notes.count(); i++) {
+                queueRecognition(m_notes.at(i) ? m_notes.at(i)->guid() : m_snapshotRows.at(i).guid);
+            }
+        }
         m_loading = false;
         emit loadingChanged();
 
 
+        QStringList deletedGuids;
         foreach (const QString &unhandledGuid, m_unhandledNotes) {
-            Note *note = m_notesHash.value(unhandledGuid);
+            Note *note = findNote(unhandledGuid);
             if (!note) {
                 continue; // Note might be deleted locally by now
             }
@@ -832,14 +993,13 @@ void NotesStore::fetchNotesJobDone(EvernoteConnection::ErrorCode errorCode, cons
                     note->loadFromCacheFile();
                 }
 
-                QModelIndex idx = index(m_notes.indexOf(note));
                 note->setLoading(true);
-                emit dataChanged(idx, idx, QVector<int>() << RoleLoading);
+                queueDataChanged(m_noteRows.row(note->guid()), QVector<int>() << RoleLoading);
                 CreateNoteJob *job = new CreateNoteJob(note, this);
                 connect(job, &CreateNoteJob::jobDone, this, &NotesStore::createNoteJobDone);
                 EvernoteConnection::instance()->enqueue(job);
             } else {
-                int idx = m_notes.indexOf(note);
+                int idx = m_noteRows.row(note->guid());
                 if (idx == -1) {
                     qCWarning(dcSync) << "Should sync unhandled note but it is gone by now...";
                     continue;
@@ -847,7 +1007,7 @@ void NotesStore::fetchNotesJobDone(EvernoteConnection::ErrorCode errorCode, cons
 
                 if (note->synced()) {
                     qCDebug(dcSync) << "Note has been deleted from the server and not changed locally. Deleting local note:" << note->guid();
-                    removeNote(note->guid());
+                    deletedGuids.append(note->guid());
                 } else {
                     qCDebug(dcSync) << "CONFLICT: Note has been deleted from the server but we have unsynced local changes for note:" << note->guid();
                     FetchNoteJob::LoadWhatFlags flags = 0x0;
@@ -858,17 +1018,99 @@ void NotesStore::fetchNotesJobDone(EvernoteConnection::ErrorCode errorCode, cons
                     EvernoteConnection::instance()->enqueue(job);
 
                     note->setConflicting(true);
-                    emit dataChanged(index(idx), index(idx), QVector<int>() << RoleConflicting);
+                    queueDataChanged(idx, QVector<int>() << RoleConflicting);
                 }
             }
         }
+        removeNotes(deletedGuids);
         qCDebug(dcSync) << "Local-only notes synced.";
     }
 }
 
+// Creates notes the server knows about and we don't, and syncs those that changed
+void NotesStore::updateFromEDAM(const evernote::edam::NotesMetadataList &results)
+{
+    QList<Note*> newNotes;
+    for (unsigned int i = 0; i < results.notes.size(); ++i) {
+        evernote::edam::NoteMetadata result = results.notes.at(i);
+        m_unhandledNotes.removeAll(QString::fromStdString(result.guid));
+
+        // Notes that haven't been created yet have no local changes. If the server
+        // doesn't have anything new either, there's no need to create them now.
+        QHash<QString, qint32>::const_iterator pending = m_pendingNotes.constFind(QString::fromStdString(result.guid));
+        if (pending != m_pendingNotes.constEnd() && pending.value() >= result.updateSequenceNum && results.searchedWords.empty()) {
+            continue;
+        }
+
+        Note *note = findNote(QString::fromStdString(result.guid));
+        QVector<int> changedRoles;
+        bool newNote = note == 0;
+        if (newNote) {
+            qCDebug(dcSync) << "Found new note on server. Creating local copy:" << QString::fromStdString(result.guid);
+            note = new Note(QString::fromStdString(result.guid), 0, this);
+            connect(note, &Note::reminderChanged, this, &NotesStore::emitDataChanged);
+            connect(note, &Note::reminderDoneChanged, this, &NotesStore::emitDataChanged);
+
+            updateFromEDAM(result, note);
+            // Added to the model all at once below
+            newNotes.append(note);
+            syncToCacheFile(note);
+
+        } else if (note->synced()) {
+            // Local note did not change. Check if we need to refresh from server.
+            if (note->updateSequenceNumber() < result.updateSequenceNum) {
+                qCDebug(dcSync) << "refreshing note from network. suequence number changed: " << note->updateSequenceNumber() << "->" << result.updateSequenceNum;
+                changedRoles = updateFromEDAM(result, note);
+                refreshNoteContent(note->guid(), FetchNoteJob::LoadContent, EvernoteJob::JobPriorityMedium);
+                syncToCacheFile(note);
+            }
+        } else {
+            // Local note changed. See if we can push our changes.
+            if (note->lastSyncedSequenceNumber() == result.updateSequenceNum) {
+                qCDebug(dcSync) << "Local note" << note->guid() << "has changed while server note did not. Pushing changes.";
+
+                // Make sure we have everything loaded from cache before saving to server
+                if (!note->loaded() && note->isCached()) {
+                    note->loadFromCacheFile();
+                }
+
+                note->setLoading(true);
+                changedRoles << RoleLoading;
+                SaveNoteJob *job = new SaveNoteJob(note, this);
+                connect(job, &SaveNoteJob::jobDone, this, &NotesStore::saveNoteJobDone);
+                EvernoteConnection::instance()->enqueue(job);
+            } else {
+                qCWarning(dcSync) << "********************************************************";
+                qCWarning(dcSync) << "* CONFLICT: Note has been changed on server and locally!";
+                qCWarning(dcSync) << "* local note sequence:" << note->updateSequenceNumber();
+                qCWarning(dcSync) << "* last synced sequence:" << note->lastSyncedSequenceNumber();
+                qCWarning(dcSync) << "* remote update sequence:" << result.updateSequenceNum;
+                qCWarning(dcSync) << "********************************************************";
+                note->setConflicting(true);
+                changedRoles << RoleConflicting;
+
+                // Not setting parent as we don't want to squash the reply.
+                FetchNoteJob::LoadWhatFlags flags = 0x0;
+                flags |= FetchNoteJob::LoadContent;
+                flags |= FetchNoteJob::LoadResources;
+                FetchNoteJob *fetchNoteJob = new FetchNoteJob(note->guid(), flags);
+                fetchNoteJob->setJobPriority(EvernoteJob::JobPriorityMedium);
+                connect(fetchNoteJob, &FetchNoteJob::resultReady, this, &NotesStore::fetchConflictingNoteJobDone);
+                EvernoteConnection::instance()->enqueue(fetchNoteJob);
+            }
+        }
+
+        if (changedRoles.count() > 0) {
+            queueDataChanged(m_noteRows.row(note->guid()), changedRoles);
+            emit noteChanged(note->guid(), note->notebookGuid());
+        }
+    }
+    appendNotes(newNotes);
+}
+
 void NotesStore::refreshNoteContent(const QString &guid, FetchNoteJob::LoadWhat what, EvernoteJob::JobPriority priority)
 {
-    Note *note = m_notesHash.value(guid);
+    Note *note = findNote(guid);
     if (!note) {
         qCWarning(dcSync) << "RefreshNoteContent: Can't refresn note content. Note guid not found:" << guid;
         return;
@@ -882,8 +1124,8 @@ void NotesStore::refreshNoteContent(const QString &guid, FetchNoteJob::LoadWhat
 
         if (!note->loading()) {
             note->setLoading(true);
-            int idx = m_notes.indexOf(note);
-            emit dataChanged(index(idx), index(idx), QVector<int>() << RoleLoading);
+            int idx = m_noteRows.row(note->guid());
+            queueDataChanged(idx, QVector<int>() << RoleLoading);
         }
     }
 }
@@ -891,7 +1133,7 @@ void NotesStore::refreshNoteContent(const QString &guid, FetchNoteJob::LoadWhat
 void NotesStore::fetchNoteJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const evernote::edam::Note &result, FetchNoteJob::LoadWhatFlags what)
 {
     FetchNoteJob *job = static_cast<FetchNoteJob*>(sender());
-    Note *note = m_notesHash.value(QString::fromStdString(result.guid));
+    Note *note = findNote(QString::fromStdString(result.guid));
     if (!note) {
         qCWarning(dcSync) << "can't find note for this update... ignoring...";
         return;
@@ -901,7 +1143,7 @@ void NotesStore::fetchNoteJobDone(EvernoteConnection::ErrorCode errorCode, const
         return;
     }
 
-    QModelIndex noteIndex = index(m_notes.indexOf(note));
+    int noteRow = m_noteRows.row(note->guid());
     QVector<int> roles;
 
     handleUserError(errorCode);
@@ -911,7 +1153,7 @@ void NotesStore::fetchNoteJobDone(EvernoteConnection::ErrorCode errorCode, const
         roles << RoleLoading;
         note->setSyncError(true);
         roles << RoleSyncError;
-        emit dataChanged(noteIndex, noteIndex, roles);
+        queueDataChanged(noteRow, roles);
         return;
     }
 
@@ -920,6 +1162,7 @@ void NotesStore::fetchNoteJobDone(EvernoteConnection::ErrorCode errorCode, const
         removeNote(note->guid());
         return;
     }
+    note->m_edam = EdamCodec::encode(result);
 
     if (note->notebookGuid() != QString::fromStdString(result.notebookGuid)) {
         note->setNotebookGuid(QString::fromStdString(result.notebookGuid));
@@ -981,6 +1224,12 @@ void NotesStore::fetchNoteJobDone(EvernoteConnection::ErrorCode errorCode, const
         note->setUpdateSequenceNumber(result.updateSequenceNum);
         note->setLastSyncedSequenceNumber(result.updateSequenceNum);
         roles << RoleHtmlContent << RoleEnmlContent << RoleTagline << RolePlaintextContent;
+
+        // Resources might have come or gone
+        if (m_searchIndexLive) {
+            m_searchIndex.setRecognition(note->guid(), recognizedText(note->guid()));
+        }
+        queueRecognition(note->guid());
     }
     bool syncReminders = false;
     if (note->reminderOrder() != result.attributes.reminderOrder) {
@@ -1014,7 +1263,7 @@ void NotesStore::fetchNoteJobDone(EvernoteConnection::ErrorCode errorCode, const
     roles << RoleLoading;
 
     emit noteChanged(note->guid(), note->notebookGuid());
-    emit dataChanged(noteIndex, noteIndex, roles);
+    queueDataChanged(noteRow, roles);
 
     if (refreshWithResourceData) {
         qCDebug(dcSync) << "Fetching Note resources:" << note->guid();
@@ -1022,14 +1271,14 @@ void NotesStore::fetchNoteJobDone(EvernoteConnection::ErrorCode errorCode, const
         refreshNoteContent(note->guid(), FetchNoteJob::LoadResources, newPriority);
     }
     syncToCacheFile(note); // Syncs into the list cache
-    note->syncToCacheFile(); // Syncs note's content into notes cache
+    m_writeQueue.markDirty(WriteBehindQueue::KindNoteContent, note->guid()); // Syncs note's content into notes cache
 }
 
 void NotesStore::fetchConflictingNoteJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const evernote::edam::Note &result, FetchNoteJob::LoadWhatFlags what)
 {
     Q_UNUSED(what) // We always fetch everything when sensing a conflict
 
-    Note *note = m_notesHash.value(QString::fromStdString(result.guid));
+    Note *note = findNote(QString::fromStdString(result.guid));
     if (!note) {
         qCWarning(dcSync) << "Fetched conflicting note from server but local note can't be found any more:" << QString::fromStdString(result.guid);
         return;
@@ -1064,6 +1313,7 @@ void NotesStore::fetchConflictingNoteJobDone(EvernoteConnection::ErrorCode error
     serverNote->setReminderDoneTime(QDateTime::fromMSecsSinceEpoch(result.attributes.reminderDoneTime));
 
     serverNote->setEnmlContent(QString::fromStdString(result.content));
+    serverNote->m_edam = EdamCodec::encode(result);
 
     foreach (const evernote::edam::Resource &resource, result.resources) {
         serverNote->addResource(QString::fromStdString(resource.data.bodyHash), QString::fromStdString(resource.attributes.fileName), QString::fromStdString(resource.mime));
@@ -1161,10 +1411,7 @@ void NotesStore::fetchNotebooksJobDone(EvernoteConnection::ErrorCode errorCode,
             m_notebooksHash.remove(notebook->guid());
             emit notebookRemoved(notebook->guid());
 
-            QSettings settings(m_cacheFile, QSettings::IniFormat);
-            settings.beginGroup("notebooks");
-            settings.remove(notebook->guid());
-            settings.endGroup();
+            m_cacheJournal.removeEntry(CacheJournal::KindNotebook, notebook->guid());
 
             notebook->deleteInfoFile();
             notebook->deleteLater();
@@ -1214,6 +1461,7 @@ void NotesStore::fetchTagsJobDone(EvernoteConnection::ErrorCode errorCode, const
         bool newTag = tag == 0;
         if (newTag) {
             tag = new Tag(QString::fromStdString(result.guid), result.updateSequenceNum, this);
+            tag->m_edam = EdamCodec::encode(result);
             tag->setLastSyncedSequenceNumber(result.updateSequenceNum);
             qCDebug(dcSync) << "got new tag with seq:" << result.updateSequenceNum << tag->synced() << tag->updateSequenceNumber() << tag->lastSyncedSequenceNumber();
             tag->setName(QString::fromStdString(result.name));
@@ -1223,6 +1471,7 @@ void NotesStore::fetchTagsJobDone(EvernoteConnection::ErrorCode errorCode, const
             syncToCacheFile(tag);
         } else if (tag->synced()) {
             if (tag->updateSequenceNumber() < result.updateSequenceNum) {
+                tag->m_edam = EdamCodec::encode(result);
                 tag->setName(QString::fromStdString(result.name));
                 tag->setUpdateSequenceNumber(result.updateSequenceNum);
                 tag->setLastSyncedSequenceNumber(result.updateSequenceNum);
@@ -1303,13 +1552,7 @@ Note* NotesStore::createNote(const QString &title, const QString &notebookGuid,
     note->setCreated(QDateTime::currentDateTime());
     note->setUpdated(note->created());
 
-    beginInsertRows(QModelIndex(), m_notes.count(), m_notes.count());
-    m_notesHash.insert(note->guid(), note);
-    m_notes.append(note);
-    endInsertRows();
-
-    emit countChanged();
-    emit noteAdded(note->guid(), note->notebookGuid());
+    appendNotes(QList<Note*>() << note);
     emit noteCreated(note->guid(), note->notebookGuid());
 
     syncToCacheFile(note);
@@ -1324,12 +1567,12 @@ Note* NotesStore::createNote(const QString &title, const QString &notebookGuid,
 
 void NotesStore::createNoteJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const QString &tmpGuid, const evernote::edam::Note &result)
 {
-    Note *note = m_notesHash.value(tmpGuid);
+    Note *note = findNote(tmpGuid);
     if (!note) {
         qCWarning(dcSync) << "Cannot find temporary note after create operation!";
         return;
     }
-    int idx = m_notes.indexOf(note);
+    int idx = m_noteRows.row(note->guid());
     QVector<int> roles;
 
     note->setLoading(false);
@@ -1340,7 +1583,7 @@ void NotesStore::createNoteJobDone(EvernoteConnection::ErrorCode errorCode, cons
         qCWarning(dcSync) << "Error creating note on server:" << tmpGuid << errorMessage;
         note->setSyncError(true);
         roles << RoleSyncError;
-        emit dataChanged(index(idx), index(idx), roles);
+        queueDataChanged(idx, roles);
         return;
     }
 
@@ -1350,8 +1593,10 @@ void NotesStore::createNoteJobDone(EvernoteConnection::ErrorCode errorCode, cons
     }
 
     QString guid = QString::fromStdString(result.guid);
+    note->m_edam = EdamCodec::encode(result);
     qCDebug(dcSync) << "Note created on server. Old guid:" << tmpGuid << "New guid:" << guid;
     m_notesHash.insert(guid, note);
+    m_noteRows.setGuid(idx, guid);
     note->setGuid(guid);
     m_notesHash.remove(tmpGuid);
     emit noteGuidChanged(tmpGuid, guid);
@@ -1382,19 +1627,16 @@ void NotesStore::createNoteJobDone(EvernoteConnection::ErrorCode errorCode, cons
         note->setEnmlContent(QString::fromStdString(result.content));
         roles << RoleEnmlContent << RoleRichTextContent << RoleTagline << RolePlaintextContent;
     }
-    emit dataChanged(index(idx), index(idx), roles);
+    queueDataChanged(idx, roles);
 
-    QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
-    cacheFile.beginGroup("notes");
-    cacheFile.remove(tmpGuid);
-    cacheFile.endGroup();
+    m_cacheJournal.removeEntry(CacheJournal::KindNote, tmpGuid);
 
     syncToCacheFile(note);
 }
 
 void NotesStore::saveNote(const QString &guid)
 {
-    Note *note = m_notesHash.value(guid);
+    Note *note = findNote(guid);
     if (!note) {
         qCWarning(dcNotesStore) << "Can't save note. Guid not found:" << guid;
         return;
@@ -1403,7 +1645,7 @@ void NotesStore::saveNote(const QString &guid)
     note->setUpdateSequenceNumber(note->updateSequenceNumber()+1);
     note->setUpdated(QDateTime::currentDateTime());
     syncToCacheFile(note);
-    note->syncToCacheFile();
+    m_writeQueue.markDirty(WriteBehindQueue::KindNoteContent, note->guid());
 
     if (EvernoteConnection::instance()->isConnected()) {
         note->setLoading(true);
@@ -1419,8 +1661,8 @@ void NotesStore::saveNote(const QString &guid)
         }
     }
 
-    int idx = m_notes.indexOf(note);
-    emit dataChanged(index(idx), index(idx));
+    int idx = m_noteRows.row(note->guid());
+    queueDataChanged(idx);
     emit noteChanged(guid, note->notebookGuid());
 
     m_organizerAdapter->startSync();
@@ -1429,28 +1671,28 @@ void NotesStore::saveNote(const QString &guid)
 void NotesStore::saveNoteJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const evernote::edam::Note &result)
 {
     qCDebug(dcSync) << "Note saved to server:" << QString::fromStdString(result.guid);
-    Note *note = m_notesHash.value(QString::fromStdString(result.guid));
+    Note *note = findNote(QString::fromStdString(result.guid));
     if (!note) {
         qCWarning(dcSync) << "Got a save note job result, but note has disappeared locally.";
         return;
     }
 
-    int idx = m_notes.indexOf(note);
+    int idx = m_noteRows.row(note->guid());
     note->setLoading(false);
-    QModelIndex noteIndex = index(idx);
 
     handleUserError(errorCode);
     if (errorCode != EvernoteConnection::ErrorCodeNoError) {
         qCWarning(dcSync) << "Unhandled error saving note:" << errorCode << "Message:" << errorMessage;
         note->setSyncError(true);
-        emit dataChanged(noteIndex, noteIndex, QVector<int>() << RoleLoading << RoleSyncError);
+        queueDataChanged(idx, QVector<int>() << RoleLoading << RoleSyncError);
         return;
     }
 
     note->setLastSyncedSequenceNumber(result.updateSequenceNum);
+    note->m_edam = EdamCodec::encode(result);
     syncToCacheFile(note);
 
-    emit dataChanged(noteIndex, noteIndex);
+    queueDataChanged(idx);
     emit noteChanged(note->guid(), note->notebookGuid());
 }
 
@@ -1481,13 +1723,13 @@ void NotesStore::saveNotebookJobDone(EvernoteConnection::ErrorCode errorCode, co
 
 void NotesStore::deleteNote(const QString &guid)
 {
-    Note *note = m_notesHash.value(guid);
+    Note *note = findNote(guid);
     if (!note) {
         qCWarning(dcNotesStore) << "Note not found. Can't delete";
         return;
     }
 
-    int idx = m_notes.indexOf(note);
+    int idx = m_noteRows.row(note->guid());
 
     if (note->lastSyncedSequenceNumber() == 0) {
         removeNote(guid);
@@ -1496,7 +1738,7 @@ void NotesStore::deleteNote(const QString &guid)
         qCDebug(dcNotesStore) << "Setting note to deleted:" << note->guid();
         note->setDeleted(true);
         note->setUpdateSequenceNumber(note->updateSequenceNumber()+1);
-        emit dataChanged(index(idx), index(idx), QVector<int>() << RoleDeleted);
+        queueDataChanged(idx, QVector<int>() << RoleDeleted);
 
         syncToCacheFile(note);
         if (EvernoteConnection::instance()->isConnected()) {
@@ -1511,46 +1753,492 @@ void NotesStore::deleteNote(const QString &guid)
     }
 }
 
-void NotesStore::findNotes(const QString &searchWords)
+bool NotesStore::indexRecognition() const
 {
-    if (EvernoteConnection::instance()->isConnected()) {
-        clearSearchResults();
-        FetchNotesJob *job = new FetchNotesJob(QString(), searchWords + "*");
-        connect(job, &FetchNotesJob::jobDone, this, &NotesStore::fetchNotesJobDone);
-        EvernoteConnection::instance()->enqueue(job);
-    } else {
-        foreach (Note *note, m_notes) {
-            bool matches = note->title().contains(searchWords, Qt::CaseInsensitive);
-            matches |= note->plaintextContent().contains(searchWords, Qt::CaseInsensitive);
-            note->setIsSearchResult(matches);
-        }
-        emit dataChanged(index(0), index(m_notes.count()-1), QVector<int>() << RoleIsSearchResult);
-    }
+    return m_indexRecognition;
 }
 
-void NotesStore::clearSearchResults()
+void NotesStore::setIndexRecognition(bool indexRecognition)
 {
-    foreach (Note *note, m_notes) {
-        note->setIsSearchResult(false);
+    if (m_indexRecognition == indexRecognition) {
+        return;
     }
-    emit dataChanged(index(0), index(m_notes.count()-1), QVector<int>() << RoleIsSearchResult);
-}
+    m_indexRecognition = indexRecognition;
+    emit indexRecognitionChanged();
 
-void NotesStore::deleteNoteJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const QString &guid)
-{
-    handleUserError(errorCode);
-    if (errorCode != EvernoteConnection::ErrorCodeNoError) {
-        qCWarning(dcSync) << "Cannot delete note from server:" << errorMessage;
+    if (!m_indexRecognition) {
+        m_recognitionQueue.clear();
+        m_queuedRecognition.clear();
         return;
     }
-    removeNote(guid);
+    for (int i = 0; i < m_notes.count(); i++) {
+        queueRecognition(m_notes.at(i) ? m_notes.at(i)->guid() : m_snapshotRows.at(i).guid);
+    }
 }
 
-void NotesStore::expungeNotebookJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const QString &guid)
+bool NotesStore::searching() const
 {
-    handleUserError(errorCode);
-    if (errorCode != EvernoteConnection::ErrorCodeNoError) {
-        qCWarning(dcSync) << "Error expunging notebook:" << errorMessage;
+    return m_searchJob || m_searchQuery;
+}
+
+// Hits from the local index show up right away, the server's are merged in as they arrive.
+// The results of the previous search stay until then.
+void NotesStore::findNotes(const QString &searchWords)
+{
+    if (searchWords.trimmed().isEmpty()) {
+        clearSearchResults();
+        return;
+    }
+
+    cancelSearch();
+    m_searchWords = searchWords;
+    m_localSearchRanks.clear();
+    m_serverSearchRanks.clear();
+    m_searchSnippetWords = SearchGrammar(searchWords).words();
+    m_searchSnippets.clear();
+
+    buildSearchIndex();
+    startSearchIndexQuery(searchWords);
+    if (EvernoteConnection::instance()->isConnected()) {
+        startSearchJob(0);
+    }
+    emit searchingChanged();
+}
+
+// Filters like notebook: or todo: narrow down the notes the words are searched in. Only
+// queries of plain words can narrow down the results of the previous search.
+void NotesStore::startSearchIndexQuery(const QString &searchWords)
+{
+    // Filters are evaluated on the attribute index, which follows dataChanged
+    flushDataChanged();
+
+    SearchGrammar grammar(searchWords);
+    bool refines = grammar.isPlain() && SearchIndex::refines(searchWords, m_lastSearchWords)
+            && m_lastSearchGeneration == m_searchIndex.generation();
+    if (refines && m_lastSearchResults.isEmpty()) {
+        qCDebug(dcNotesStore) << "Search for" << searchWords << "can't have any local results";
+        m_lastSearchWords = searchWords;
+        setSearchIndexResults(QHash<QString, qreal>());
+        return;
+    }
+
+    m_searchQuery = new SearchIndexQuery(&m_searchIndex, grammar.words(), this);
+    m_searchQuery->setExcludedQueries(grammar.excludedWords());
+    m_searchQuery->setPhrases(grammar.phrases());
+    m_searchQuery->setExcludedPhrases(grammar.excludedPhrases());
+    if (refines) {
+        m_searchQuery->setCandidates(m_lastSearchResults);
+    } else if (grammar.hasFilters() || SearchIndex::tokenize(grammar.words()).isEmpty()) {
+        QElapsedTimer timer;
+        timer.start();
+        QVector<quint32> rows = searchFilter(grammar).rows();
+        QSet<QString> candidates;
+        candidates.reserve(rows.count());
+        foreach (quint32 row, rows) {
+            candidates.insert(m_attributeIndex.guid(row));
+        }
+        m_searchQuery->setCandidates(candidates);
+        qCDebug(dcNotesStore) << "Filters of" << searchWords << "match" << candidates.count() << "notes in" << timer.elapsed() << "ms";
+    }
+    m_searchQueryGeneration = m_searchIndex.generation();
+    connect(m_searchQuery.data(), &SearchIndexQuery::finished, this, &NotesStore::searchIndexQueryDone);
+    connect(m_searchQuery.data(), &SearchIndexQuery::finished, m_searchQuery.data(), &SearchIndexQuery::deleteLater);
+    m_searchQuery->start();
+}
+
+void NotesStore::startSearchJob(int startIndex)
+{
+    m_searchJob = new FetchNotesJob(QString(), serverSearchWords(), startIndex);
+    connect(m_searchJob.data(), &FetchNotesJob::jobDone, this, &NotesStore::searchNotesJobDone);
+    EvernoteConnection::instance()->enqueue(m_searchJob.data());
+}
+
+// The server matches the last word as a prefix, just like the index does with short words
+QString NotesStore::serverSearchWords() const
+{
+    return SearchGrammar(m_searchWords).endsWithWord() ? m_searchWords + "*" : m_searchWords;
+}
+
+// Snippets come from the plaintext kept in the search index, so the notes don't need to
+// be loaded or their ENML parsed. They're only made for rows which are actually shown.
+QString NotesStore::searchSnippet(const QString &guid) const
+{
+    if (!m_searchScores.contains(guid)) {
+        return QString();
+    }
+    if (m_searchSnippetsGeneration != m_searchIndex.generation()) {
+        m_searchSnippets.clear();
+        m_searchSnippetsGeneration = m_searchIndex.generation();
+    }
+    QHash<QString, QString>::const_iterator it = m_searchSnippets.constFind(guid);
+    if (it != m_searchSnippets.constEnd()) {
+        return it.value();
+    }
+    QString snippet = m_searchIndex.snippet(guid, m_searchSnippetWords);
+    m_searchSnippets.insert(guid, snippet);
+    return snippet;
+}
+
+NoteAttributeIndex::Attributes NotesStore::noteAttributes(int row) const
+{
+    NoteAttributeIndex::Attributes attributes;
+    Note *note = m_notes.at(row);
+    if (note) {
+        attributes.guid = note->guid();
+        attributes.title = note->title();
+        attributes.notebookGuid = note->notebookGuid();
+        attributes.tagGuids = note->tagGuids();
+        attributes.reminder = note->reminder();
+        attributes.deleted = note->deleted();
+        attributes.dates[NoteAttributeIndex::DateCreated] = note->created();
+        attributes.dates[NoteAttributeIndex::DateUpdated] = note->updated();
+        attributes.dates[NoteAttributeIndex::DateReminderTime] = note->reminderTime();
+        attributes.dates[NoteAttributeIndex::DateReminderDoneTime] = note->reminderDoneTime();
+    } else {
+        const NoteSnapshot::Row &snapshotRow = m_snapshotRows.at(row);
+        attributes.guid = snapshotRow.guid;
+        attributes.title = snapshotRow.title;
+        attributes.notebookGuid = snapshotRow.notebookGuid;
+        attributes.tagGuids = snapshotRow.tagGuids;
+        attributes.reminder = snapshotRow.reminderOrder > 0;
+        attributes.deleted = snapshotRow.deleted;
+        attributes.dates[NoteAttributeIndex::DateCreated] = snapshotRow.created;
+        attributes.dates[NoteAttributeIndex::DateUpdated] = snapshotRow.updated;
+        attributes.dates[NoteAttributeIndex::DateReminderTime] = snapshotRow.reminderTime;
+        attributes.dates[NoteAttributeIndex::DateReminderDoneTime] = snapshotRow.reminderDoneTime;
+    }
+    foreach (const NoteResourceInfo &resource, resources(attributes.guid)) {
+        attributes.resourceTypes.append(resource.type);
+    }
+    return attributes;
+}
+
+// Returns the rows matching all terms of grammar but the words
+RowBitmap NotesStore::searchFilter(const SearchGrammar &grammar)
+{
+    RowBitmap result = m_attributeIndex.all();
+    foreach (const SearchGrammar::Term &term, grammar.terms()) {
+        RowBitmap rows;
+        switch (term.type) {
+        case SearchGrammar::TypeWords:
+            continue;
+        case SearchGrammar::TypeNotebook:
+            foreach (Notebook *notebook, m_notebooks) {
+                if (SearchGrammar::matches(term.value, notebook->name())) {
+                    rows |= m_attributeIndex.notebook(notebook->guid());
+                }
+            }
+            break;
+        case SearchGrammar::TypeTag:
+            if (term.value == "*") {
+                rows = m_attributeIndex.tagged();
+                break;
+            }
+            foreach (Tag *tag, m_tags) {
+                if (SearchGrammar::matches(term.value, tag->name())) {
+                    rows |= m_attributeIndex.tag(tag->guid());
+                }
+            }
+            break;
+        case SearchGrammar::TypeResource:
+            foreach (const QString &type, m_attributeIndex.resourceTypes()) {
+                if (SearchGrammar::matches(term.value, type)) {
+                    rows |= m_attributeIndex.resourceType(type);
+                }
+            }
+            break;
+        case SearchGrammar::TypeReminderOrder:
+            rows = m_attributeIndex.reminders();
+            break;
+        case SearchGrammar::TypeTodo:
+            if (term.value != "false") {
+                rows |= m_attributeIndex.rows(m_searchIndex.notesWithTodos(true));
+            }
+            if (term.value != "true") {
+                rows |= m_attributeIndex.rows(m_searchIndex.notesWithTodos(false));
+            }
+            break;
+        case SearchGrammar::TypeCreated:
+        case SearchGrammar::TypeUpdated:
+        case SearchGrammar::TypeReminderTime:
+        case SearchGrammar::TypeReminderDoneTime:
+            rows = m_attributeIndex.dated(dateField(term.type), term.time);
+            if (term.negated && term.time.isValid()) {
+                // Before the date, which doesn't include notes without it
+                RowBitmap before = m_attributeIndex.dated(dateField(term.type));
+                before -= rows;
+                result &= before;
+                continue;
+            }
+            break;
+        }
+        if (term.negated) {
+            result -= rows;
+        } else {
+            result &= rows;
+        }
+    }
+    return result;
+}
+
+NoteAttributeIndex::DateField NotesStore::dateField(SearchGrammar::Type type)
+{
+    switch (type) {
+    case SearchGrammar::TypeUpdated:
+        return NoteAttributeIndex::DateUpdated;
+    case SearchGrammar::TypeReminderTime:
+        return NoteAttributeIndex::DateReminderTime;
+    case SearchGrammar::TypeReminderDoneTime:
+        return NoteAttributeIndex::DateReminderDoneTime;
+    default:
+        return NoteAttributeIndex::DateCreated;
+    }
+}
+
+void NotesStore::cancelSearch()
+{
+    if (m_searchQuery) {
+        m_searchQuery->cancel();
+        m_searchQuery.clear();
+    }
+    if (m_searchJob) {
+        // If it's running already, its results are dropped when they arrive
+        EvernoteConnection::instance()->cancel(m_searchJob.data());
+        m_searchJob.clear();
+    }
+    m_searchWords.clear();
+}
+
+void NotesStore::searchIndexQueryDone()
+{
+    SearchIndexQuery *query = static_cast<SearchIndexQuery*>(sender());
+    if (query != m_searchQuery || query->isCancelled()) {
+        return;
+    }
+    m_searchQuery.clear();
+
+    if (m_searchIndex.generation() == m_searchQueryGeneration) {
+        m_lastSearchWords = m_searchWords;
+        m_lastSearchResults = query->results().keys().toSet();
+        m_lastSearchGeneration = m_searchQueryGeneration;
+    } else {
+        m_lastSearchWords.clear();
+    }
+    setSearchIndexResults(query->results());
+    emit searchingChanged();
+}
+
+void NotesStore::setSearchIndexResults(const QHash<QString, qreal> &scores)
+{
+    QVector<QPair<qreal, QString> > ranking;
+    ranking.reserve(scores.count());
+    QHash<QString, qreal>::const_iterator it = scores.constBegin();
+    for (; it != scores.constEnd(); ++it) {
+        ranking.append(qMakePair(it.value(), it.key()));
+    }
+    std::sort(ranking.begin(), ranking.end(), std::greater<QPair<qreal, QString> >());
+
+    m_localSearchRanks.clear();
+    for (int i = 0; i < ranking.count(); i++) {
+        m_localSearchRanks.insert(ranking.at(i).second, i + 1);
+    }
+    updateSearchResults();
+}
+
+void NotesStore::searchNotesJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const evernote::edam::NotesMetadataList &results, const QString &filterNotebookGuid)
+{
+    Q_UNUSED(filterNotebookGuid)
+
+    FetchNotesJob *job = static_cast<FetchNotesJob*>(sender());
+    if (m_searchWords.isEmpty() || job->searchWords() != serverSearchWords()) {
+        qCDebug(dcNotesStore) << "Dropping results of an outdated search for" << job->searchWords();
+        return;
+    }
+    m_searchJob.clear();
+
+    handleUserError(errorCode);
+    if (errorCode != EvernoteConnection::ErrorCodeNoError) {
+        qCWarning(dcSync) << "Failed to search notes on server:" << errorMessage << errorCode;
+        emit searchingChanged();
+        return;
+    }
+
+    updateFromEDAM(results);
+
+    // The server sends its results in order of relevance
+    for (unsigned int i = 0; i < results.notes.size(); ++i) {
+        QString guid = QString::fromStdString(results.notes.at(i).guid);
+        if (!m_serverSearchRanks.contains(guid)) {
+            m_serverSearchRanks.insert(guid, results.startIndex + i + 1);
+        }
+    }
+    updateSearchResults();
+
+    int nextIndex = results.startIndex + results.notes.size();
+    if (nextIndex < results.totalNotes && nextIndex < SEARCH_SERVER_RANKS) {
+        startSearchJob(nextIndex);
+    }
+    emit searchingChanged();
+}
+
+// Local and server results are merged with reciprocal rank fusion. A note gets
+// 1 / (SEARCH_RANK_OFFSET + rank) for each list it's in, so notes both agree on go first.
+void NotesStore::updateSearchResults()
+{
+    QHash<QString, qreal> scores;
+    QHash<QString, int>::const_iterator it;
+    for (it = m_localSearchRanks.constBegin(); it != m_localSearchRanks.constEnd(); ++it) {
+        scores[it.key()] += 1.0 / (SEARCH_RANK_OFFSET + it.value());
+    }
+    for (it = m_serverSearchRanks.constBegin(); it != m_serverSearchRanks.constEnd(); ++it) {
+        scores[it.key()] += 1.0 / (SEARCH_RANK_OFFSET + it.value());
+    }
+    setSearchScores(scores);
+}
+
+void NotesStore::setSearchScores(const QHash<QString, qreal> &scores)
+{
+    // Notes answer isSearchResult from the scores. Only those created already need to
+    // hear about it, results are never created just for that.
+    QSet<QString> oldResults = m_searchScores.keys().toSet();
+    QSet<QString> newResults = scores.keys().toSet();
+    QSet<QString> changed = (oldResults - newResults) | (newResults - oldResults);
+    m_searchScores = scores;
+    foreach (const QString &guid, changed) {
+        Note *note = m_notesHash.value(guid);
+        if (note) {
+            emit note->isSearchResultChanged();
+        }
+    }
+    m_searchResultsGeneration++;
+
+    // Any old or new result might have a different score now
+    QVector<int> roles = QVector<int>() << RoleIsSearchResult << RoleSearchScore << RoleSearchSnippet;
+    foreach (const QString &guid, oldResults | newResults) {
+        queueDataChanged(m_noteRows.row(guid), roles);
+    }
+}
+
+void NotesStore::clearSearchResults()
+{
+    cancelSearch();
+    m_localSearchRanks.clear();
+    m_serverSearchRanks.clear();
+    m_lastSearchWords.clear();
+    m_searchSnippets.clear();
+    emit searchingChanged();
+
+    setSearchScores(QHash<QString, qreal>());
+}
+
+QList<NoteResourceInfo> NotesStore::resources(const QString &guid) const
+{
+    Note *note = m_notesHash.value(guid);
+    if (!note) {
+        return m_noteInfoTable.record(guid).resources;
+    }
+    QList<NoteResourceInfo> resources;
+    foreach (Resource *resource, note->resources()) {
+        NoteResourceInfo info;
+        info.hash = resource->hash();
+        info.fileName = resource->fileName();
+        info.type = resource->type();
+        resources.append(info);
+    }
+    return resources;
+}
+
+QString NotesStore::recognizedText(const QString &guid) const
+{
+    QStringList texts;
+    foreach (const NoteResourceInfo &resource, resources(guid)) {
+        QFile file(Resource::recognitionFilePathFor(resource.hash));
+        if (file.open(QFile::ReadOnly)) {
+            texts.append(QString::fromUtf8(file.readAll()));
+        }
+    }
+    return texts.join(' ');
+}
+
+// Recognition data is fetched one resource at a time with low priority, so it never gets
+// in the way of syncing. Resources are only fetched once. What was recognized is kept next
+// to the resource, even when nothing was.
+void NotesStore::queueRecognition(const QString &guid)
+{
+    if (!m_indexRecognition) {
+        return;
+    }
+    Note *note = m_notesHash.value(guid);
+    qint32 lastSyncedSequenceNumber = note ? note->lastSyncedSequenceNumber() : m_noteInfoTable.record(guid).lastSyncedSequenceNumber;
+    if (lastSyncedSequenceNumber == 0) {
+        return; // Not on the server yet
+    }
+
+    foreach (const NoteResourceInfo &resource, resources(guid)) {
+        // The server only recognizes text in images and PDFs
+        if (!resource.type.startsWith("image/") && resource.type != "application/pdf") {
+            continue;
+        }
+        if (m_queuedRecognition.contains(resource.hash) || QFile::exists(Resource::recognitionFilePathFor(resource.hash))) {
+            continue;
+        }
+        m_queuedRecognition.insert(resource.hash);
+        m_recognitionQueue.append(qMakePair(guid, resource.hash));
+    }
+    startRecognitionJob();
+}
+
+void NotesStore::startRecognitionJob()
+{
+    if (m_recognitionJobRunning || m_recognitionQueue.isEmpty() || !EvernoteConnection::instance()->isConnected()) {
+        return;
+    }
+    QPair<QString, QString> next = m_recognitionQueue.takeFirst();
+    FetchRecognitionJob *job = new FetchRecognitionJob(next.first, next.second);
+    job->setJobPriority(EvernoteJob::JobPriorityLow);
+    connect(job, &FetchRecognitionJob::jobDone, this, &NotesStore::fetchRecognitionJobDone);
+    m_recognitionJobRunning = true;
+    EvernoteConnection::instance()->enqueue(job);
+}
+
+void NotesStore::fetchRecognitionJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const QString &noteGuid, const QString &hash, const QString &text)
+{
+    m_recognitionJobRunning = false;
+    m_queuedRecognition.remove(hash);
+
+    if (errorCode != EvernoteConnection::ErrorCodeNoError) {
+        // Tried again after the next sync
+        qCWarning(dcSync) << "Cannot fetch recognition data for resource" << hash << "of note" << noteGuid << ":" << errorMessage;
+        startRecognitionJob();
+        return;
+    }
+
+    QSaveFile file(Resource::recognitionFilePathFor(hash));
+    if (!file.open(QFile::WriteOnly) || file.write(text.toUtf8()) < 0 || !file.commit()) {
+        qCWarning(dcStorage) << "Cannot write recognition data" << file.fileName() << file.errorString();
+    } else if (m_searchIndexLive && m_searchIndex.contains(noteGuid)) {
+        m_searchIndex.setRecognition(noteGuid, recognizedText(noteGuid));
+        // Nothing would index it again once the file is there
+        m_searchIndex.commit();
+    }
+    startRecognitionJob();
+}
+
+void NotesStore::deleteNoteJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const QString &guid)
+{
+    handleUserError(errorCode);
+    if (errorCode != EvernoteConnection::ErrorCodeNoError) {
+        qCWarning(dcSync) << "Cannot delete note from server:" << errorMessage;
+        return;
+    }
+    removeNote(guid);
+}
+
+void NotesStore::expungeNotebookJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const QString &guid)
+{
+    handleUserError(errorCode);
+    if (errorCode != EvernoteConnection::ErrorCodeNoError) {
+        qCWarning(dcSync) << "Error expunging notebook:" << errorMessage;
         return;
     }
 
@@ -1563,10 +2251,7 @@ void NotesStore::expungeNotebookJobDone(EvernoteConnection::ErrorCode errorCode,
     Notebook *notebook = m_notebooksHash.take(guid);
     m_notebooks.removeAll(notebook);
 
-    QSettings settings(m_cacheFile, QSettings::IniFormat);
-    settings.beginGroup("notebooks");
-    settings.remove(notebook->guid());
-    settings.endGroup();
+    m_cacheJournal.removeEntry(CacheJournal::KindNotebook, notebook->guid());
 
     notebook->deleteInfoFile();
     notebook->deleteLater();
@@ -1578,21 +2263,102 @@ void NotesStore::emitDataChanged()
     if (!note) {
         return;
     }
-    int idx = m_notes.indexOf(note);
-    emit dataChanged(index(idx), index(idx));
+    int idx = m_noteRows.row(note->guid());
+    queueDataChanged(idx);
+}
+
+// Syncing changes notes one at a time, often several times each. Every dataChanged
+// makes the proxy models filter and sort again, so the changes are collected and
+// announced once per event loop iteration, merging neighbouring rows into one range.
+void NotesStore::queueDataChanged(int row, const QVector<int> &roles)
+{
+    if (row < 0 || row >= m_notes.count()) {
+        return;
+    }
+    quint64 mask = roles.isEmpty() ? ALL_ROLES : 0;
+    foreach (int role, roles) {
+        if (role < 0 || role >= 64) {
+            mask = ALL_ROLES;
+            break;
+        }
+        mask |= Q_UINT64_C(1) << role;
+    }
+    m_changedRows[row] |= mask;
+    if (!m_dataChangedTimer.isActive()) {
+        m_dataChangedTimer.start();
+    }
+}
+
+void NotesStore::flushDataChanged()
+{
+    m_dataChangedTimer.stop();
+    QMap<int, quint64> changedRows;
+    changedRows.swap(m_changedRows);
+
+    QMap<int, quint64>::const_iterator it = changedRows.constBegin();
+    while (it != changedRows.constEnd()) {
+        int first = it.key();
+        int last = first;
+        quint64 mask = it.value();
+        for (++it; it != changedRows.constEnd() && it.key() == last + 1; ++it) {
+            last = it.key();
+            mask |= it.value();
+        }
+
+        QVector<int> roles;
+        if (mask != ALL_ROLES) {
+            for (int role = 0; role < 64; role++) {
+                if (mask & (Q_UINT64_C(1) << role)) {
+                    roles.append(role);
+                }
+            }
+        }
+        emit dataChanged(index(first), index(last), roles);
+    }
 }
 
 void NotesStore::clear()
 {
+    m_hydrateTimer.stop();
+    m_indexTimer.stop();
+    m_indexQueue.clear();
+    m_hydrateRequests.clear();
+    m_dataChangedTimer.stop();
+    m_changedRows.clear();
+
     beginResetModel();
-    foreach (Note *note, m_notes) {
-        emit noteRemoved(note->guid(), note->notebookGuid());
-        note->deleteLater();
+    QStringList guids;
+    for (int i = 0; i < m_notes.count(); i++) {
+        Note *note = m_notes.at(i);
+        if (note) {
+            guids.append(note->guid());
+            note->deleteLater();
+        } else {
+            guids.append(m_snapshotRows.at(i).guid);
+        }
+    }
+    if (!guids.isEmpty()) {
+        emit notesRemoved(guids);
     }
     m_notes.clear();
     m_notesHash.clear();
+    m_noteRows.clear();
+    m_snapshotRows.clear();
+    m_pendingNotes.clear();
+    m_hydrateRow = 0;
     endResetModel();
 
+    m_searchIndexLive = false;
+    cancelSearch();
+    m_searchScores.clear();
+    m_searchResultsGeneration++;
+    m_localSearchRanks.clear();
+    m_serverSearchRanks.clear();
+    m_searchSnippets.clear();
+    m_lastSearchWords.clear();
+    m_recognitionQueue.clear();
+    m_queuedRecognition.clear();
+
     while (!m_notebooks.isEmpty()) {
         Notebook *notebook = m_notebooks.takeFirst();
         m_notebooksHash.remove(notebook->guid());
@@ -1606,89 +2372,538 @@ void NotesStore::clear()
     }
 }
 
+// Rows are only ever appended
+void NotesStore::attributeRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+    Q_UNUSED(first)
+    Q_UNUSED(last)
+
+    for (int row = m_attributeIndex.count(); row < m_notes.count(); row++) {
+        m_attributeIndex.append(noteAttributes(row));
+    }
+}
+
+void NotesStore::attributeRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+
+    for (int row = last; row >= first; row--) {
+        m_attributeIndex.removeRow(row);
+    }
+}
+
+void NotesStore::attributesReset()
+{
+    m_attributeIndex.clear();
+    for (int row = 0; row < m_notes.count(); row++) {
+        m_attributeIndex.append(noteAttributes(row));
+    }
+}
+
+void NotesStore::attributesChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    // Search results change a lot and aren't part of the attributes
+    static const QVector<int> attributeRoles = QVector<int>() << RoleGuid << RoleTitle << RoleNotebookGuid << RoleCreated << RoleUpdated
+            << RoleReminder << RoleReminderTime << RoleReminderDone << RoleReminderDoneTime << RoleResourceUrls << RoleTagGuids
+            << RoleDeleted;
+    bool changed = roles.isEmpty();
+    foreach (int role, roles) {
+        changed |= attributeRoles.contains(role);
+    }
+    if (!changed) {
+        return;
+    }
+    for (int row = topLeft.row(); row <= bottomRight.row() && row < m_attributeIndex.count(); row++) {
+        m_attributeIndex.setAttributes(row, noteAttributes(row));
+    }
+}
+
 void NotesStore::syncToCacheFile(Note *note)
 {
-    qCDebug(dcNotesStore) << "Syncing note to disk:" << note->guid();
-    QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
-    cacheFile.beginGroup("notes");
-    cacheFile.setValue(note->guid(), note->updateSequenceNumber());
-    cacheFile.endGroup();
-    note->syncToInfoFile();
+    m_writeQueue.markDirty(WriteBehindQueue::KindNote, note->guid());
 }
 
-void NotesStore::deleteFromCacheFile(Note *note)
+void NotesStore::deleteFromCacheFile(const QString &guid)
 {
-    QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
-    cacheFile.beginGroup("notes");
-    cacheFile.remove(note->guid());
-    cacheFile.endGroup();
-    note->deleteFromCache();
+    m_writeQueue.forget(WriteBehindQueue::KindNote, guid);
+    m_writeQueue.forget(WriteBehindQueue::KindNoteContent, guid);
+    m_cacheJournal.removeEntry(CacheJournal::KindNote, guid);
+    m_contentStore.remove(guid);
+    m_noteInfoTable.remove(guid);
+    m_resourceStore.collectGarbage();
 }
 
 void NotesStore::syncToCacheFile(Notebook *notebook)
 {
-    QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
-    cacheFile.beginGroup("notebooks");
-    cacheFile.setValue(notebook->guid(), notebook->updateSequenceNumber());
-    cacheFile.endGroup();
-    notebook->syncToInfoFile();
+    m_writeQueue.markDirty(WriteBehindQueue::KindNotebook, notebook->guid());
 }
 
 void NotesStore::syncToCacheFile(Tag *tag)
 {
-    QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
-    cacheFile.beginGroup("tags");
-    cacheFile.setValue(tag->guid(), tag->updateSequenceNumber());
-    cacheFile.endGroup();
-    tag->syncToInfoFile();
+    m_writeQueue.markDirty(WriteBehindQueue::KindTag, tag->guid());
+}
+
+void NotesStore::flushCache()
+{
+    if (m_writeQueue.isEmpty()) {
+        return;
+    }
+
+    // Things might have been removed or changed their guid since they've been marked dirty
+    int count = 0;
+    foreach (const QString &guid, m_writeQueue.takeDirty(WriteBehindQueue::KindNotebook)) {
+        Notebook *notebook = m_notebooksHash.value(guid);
+        if (notebook && notebook->guid() == guid) {
+            m_cacheJournal.setEntry(CacheJournal::KindNotebook, notebook->guid(), notebook->updateSequenceNumber());
+            notebook->syncToInfoFile();
+            count++;
+        }
+    }
+    foreach (const QString &guid, m_writeQueue.takeDirty(WriteBehindQueue::KindTag)) {
+        Tag *tag = m_tagsHash.value(guid);
+        if (tag && tag->guid() == guid) {
+            m_cacheJournal.setEntry(CacheJournal::KindTag, tag->guid(), tag->updateSequenceNumber());
+            tag->syncToInfoFile();
+            count++;
+        }
+    }
+    foreach (const QString &guid, m_writeQueue.takeDirty(WriteBehindQueue::KindNote)) {
+        Note *note = m_notesHash.value(guid);
+        if (note && note->guid() == guid) {
+            m_cacheJournal.setEntry(CacheJournal::KindNote, note->guid(), note->updateSequenceNumber());
+            note->syncToInfoFile();
+            count++;
+        }
+    }
+    foreach (const QString &guid, m_writeQueue.takeDirty(WriteBehindQueue::KindNoteContent)) {
+        Note *note = m_notesHash.value(guid);
+        if (note && note->guid() == guid) {
+            note->syncToCacheFile();
+            count++;
+        }
+    }
+
+    m_cacheJournal.sync();
+    m_noteInfoTable.sync();
+    m_notebookTable.sync();
+    m_tagTable.sync();
+    m_contentStore.sync();
+    // The index goes after the cache. If we don't get that far, the notes' update
+    // sequence numbers tell what needs to be indexed again.
+    m_searchIndex.commit();
+    qCDebug(dcStorage) << "Flushed" << count << "cache writes to disk";
 }
 
 void NotesStore::loadFromCacheFile()
 {
     clear();
-    QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
 
-    cacheFile.beginGroup("notebooks");
-    if (cacheFile.allKeys().count() > 0) {
-        foreach (const QString &key, cacheFile.allKeys()) {
-            Notebook *notebook = new Notebook(key, cacheFile.value(key).toUInt(), this);
-            m_notebooksHash.insert(key, notebook);
-            m_notebooks.append(notebook);
-            emit notebookAdded(key);
+    QElapsedTimer loadTimer;
+    loadTimer.start();
+
+    // The rows are filled from the snapshot of the last session and from the note info
+    // table, without creating any notes. The notes are created when someone asks for
+    // them, or in the background if we're not lazy loading.
+    QHash<QString, qint32> cachedNotes = m_cacheJournal.entries(CacheJournal::KindNote);
+    QHash<QString, qint32> notesToLoad = cachedNotes;
+    QVector<NoteSnapshot::Row> snapshotRows;
+    // Notes may stay uncreated for the whole session now, so don't trust a snapshot
+    // if the cache has been written after it.
+    QFileInfo snapshotInfo(storageLocation() + "notes.snapshot");
+    if (snapshotInfo.exists() && snapshotInfo.lastModified() >= QFileInfo(storageLocation() + "notes.table").lastModified()) {
+        NoteSnapshot::read(snapshotInfo.absoluteFilePath(), &snapshotRows);
+    } else if (snapshotInfo.exists()) {
+        qCDebug(dcNotesStore) << "Note snapshot is older than the cache. Not using it.";
+    }
+    int snapshotCount = 0;
+    foreach (const NoteSnapshot::Row &row, snapshotRows) {
+        if (notesToLoad.contains(row.guid)) {
+            m_pendingNotes.insert(row.guid, notesToLoad.take(row.guid));
+            m_snapshotRows.append(row);
+            snapshotCount++;
+        }
+    }
+    QHash<QString, qint32>::const_iterator it = notesToLoad.constBegin();
+    for (; it != notesToLoad.constEnd(); ++it) {
+        if (m_noteInfoTable.contains(it.key())) {
+            NoteSnapshot::Row row = snapshotRow(m_noteInfoTable.record(it.key()));
+            m_pendingNotes.insert(row.guid, it.value());
+            m_snapshotRows.append(row);
         }
     }
-    cacheFile.endGroup();
-    qCDebug(dcNotesStore) << "Loaded" << m_notebooks.count() << "notebooks from disk.";
 
-    cacheFile.beginGroup("tags");
-    if (cacheFile.allKeys().count() > 0) {
-        foreach (const QString &key, cacheFile.allKeys()) {
-            Tag *tag = new Tag(key, cacheFile.value(key).toUInt(), this);
-            m_tagsHash.insert(key, tag);
-            m_tags.append(tag);
-            emit tagAdded(key);
+    if (cachedNotes.count() > 0) {
+        beginInsertRows(QModelIndex(), 0, cachedNotes.count()-1);
+        for (int i = 0; i < m_snapshotRows.count(); i++) {
+            m_noteRows.append(m_snapshotRows.at(i).guid);
+            m_notes.append(nullptr);
+        }
+        // Notes still stored in the old .info files are migrated right away
+        for (it = notesToLoad.constBegin(); it != notesToLoad.constEnd(); ++it) {
+            if (!m_pendingNotes.contains(it.key())) {
+                Note *note = new Note(it.key(), it.value(), this);
+                m_notesHash.insert(it.key(), note);
+                m_noteRows.append(it.key());
+                m_notes.append(note);
+            }
+        }
+        endInsertRows();
+    }
+
+    // Notes with local changes are needed for the next sync anyway. The rows tell which
+    // ones those are, so the records of the others aren't decoded before the first paint.
+    for (int i = 0; i < m_snapshotRows.count(); i++) {
+        if (!m_snapshotRows.at(i).synced) {
+            hydrateNote(i);
         }
     }
-    cacheFile.endGroup();
+    qCDebug(dcNotesStore) << "Loaded" << m_notes.count() << "notes from disk." << snapshotCount << "rows from the snapshot," << m_pendingNotes.count() << "notes not created yet.";
+
+    // Notebooks and tags look up their notes when created, so they come after the notes
+    QHash<QString, qint32> cachedNotebooks = m_cacheJournal.entries(CacheJournal::KindNotebook);
+    for (it = cachedNotebooks.constBegin(); it != cachedNotebooks.constEnd(); ++it) {
+        Notebook *notebook = new Notebook(it.key(), it.value(), this);
+        m_notebooksHash.insert(it.key(), notebook);
+        m_notebooks.append(notebook);
+        emit notebookAdded(it.key());
+    }
+    qCDebug(dcNotesStore) << "Loaded" << m_notebooks.count() << "notebooks from disk.";
+
+    QHash<QString, qint32> cachedTags = m_cacheJournal.entries(CacheJournal::KindTag);
+    for (it = cachedTags.constBegin(); it != cachedTags.constEnd(); ++it) {
+        Tag *tag = new Tag(it.key(), it.value(), this);
+        m_tagsHash.insert(it.key(), tag);
+        m_tags.append(tag);
+        emit tagAdded(it.key());
+    }
     qCDebug(dcNotesStore) << "Loaded" << m_tags.count() << "tags from disk.";
 
-    cacheFile.beginGroup("notes");
-    if (cacheFile.allKeys().count() > 0) {
-        beginInsertRows(QModelIndex(), 0, cacheFile.allKeys().count()-1);
-        foreach (const QString &key, cacheFile.allKeys()) {
-            if (m_notesHash.contains(key)) {
-                qCWarning(dcNotesStore) << "already have note. Not reloading from cache.";
-                continue;
+    // Drop anything left behind by notes that aren't in the cache any more
+    foreach (const QString &guid, m_noteInfoTable.guids()) {
+        if (!cachedNotes.contains(guid)) {
+            m_noteInfoTable.remove(guid);
+        }
+    }
+    foreach (const QString &guid, m_notebookTable.guids()) {
+        if (!cachedNotebooks.contains(guid)) {
+            m_notebookTable.remove(guid);
+        }
+    }
+    foreach (const QString &guid, m_tagTable.guids()) {
+        if (!cachedTags.contains(guid)) {
+            m_tagTable.remove(guid);
+        }
+    }
+    foreach (const QString &guid, m_contentStore.guids()) {
+        if (!cachedNotes.contains(guid)) {
+            m_contentStore.remove(guid);
+        }
+    }
+    m_resourceStore.collectGarbage();
+
+    // Only bring a stored search index up to date. Building it from scratch can wait
+    // until it's needed.
+    if (m_searchIndex.count() > 0) {
+        buildSearchIndex();
+    }
+
+    if (!m_lazyLoading && !m_snapshotRows.isEmpty()) {
+        m_hydrateTimer.start();
+    }
+    qCDebug(dcNotesStore) << "Cache loaded in" << loadTimer.elapsed() << "ms";
+}
+
+Note *NotesStore::findNote(const QString &guid)
+{
+    Note *note = m_notesHash.value(guid);
+    if (!note && m_pendingNotes.contains(guid)) {
+        int row = m_noteRows.row(guid);
+        if (row >= 0 && !m_notes.at(row)) {
+            note = hydrateNote(row);
+            queueDataChanged(row);
+        }
+    }
+    return note;
+}
+
+Note *NotesStore::hydrateNote(int row)
+{
+    const NoteSnapshot::Row &snapshot = m_snapshotRows.at(row);
+    Note *note = new Note(snapshot.guid, m_pendingNotes.take(snapshot.guid), this);
+    m_notes[row] = note;
+    m_notesHash.insert(note->guid(), note);
+
+    // The snapshot might be older than the cache if we didn't get to write it last time
+    if (note->notebookGuid() != snapshot.notebookGuid || note->tagGuids() != snapshot.tagGuids) {
+        emit noteChanged(note->guid(), note->notebookGuid());
+    }
+    return note;
+}
+
+void NotesStore::hydrateNotes()
+{
+    int first = -1;
+    int last = -1;
+    int hydrated = 0;
+    while (m_hydrateRow < m_snapshotRows.count() && hydrated < HYDRATE_BATCH_SIZE) {
+        if (!m_notes.at(m_hydrateRow)) {
+            hydrateNote(m_hydrateRow);
+            if (first == -1) {
+                first = m_hydrateRow;
             }
-            Note *note = new Note(key, cacheFile.value(key).toUInt(), this);
-            m_notesHash.insert(key, note);
-            m_notes.append(note);
-            emit noteAdded(note->guid(), note->notebookGuid());
+            last = m_hydrateRow;
+            hydrated++;
         }
-        endInsertRows();
+        m_hydrateRow++;
+    }
+    if (first != -1) {
+        emit dataChanged(index(first), index(last));
+    }
+
+    if (m_hydrateRow >= m_snapshotRows.count()) {
+        qCDebug(dcNotesStore) << "All" << m_snapshotRows.count() << "notes from the snapshot are loaded.";
+        m_hydrateTimer.stop();
+        m_snapshotRows.clear();
+        m_pendingNotes.clear();
+        m_hydrateRow = 0;
+    }
+}
+
+void NotesStore::hydrateRequestedNotes()
+{
+    foreach (const QString &guid, m_hydrateRequests) {
+        int row = m_noteRows.row(guid);
+        if (row >= 0 && !m_notes.at(row)) {
+            hydrateNote(row);
+            queueDataChanged(row);
+        }
+    }
+    m_hydrateRequests.clear();
+}
+
+void NotesStore::hydrateAllNotes()
+{
+    while (!m_snapshotRows.isEmpty()) {
+        hydrateNotes();
+    }
+}
+
+void NotesStore::buildSearchIndex()
+{
+    if (m_searchIndexLive) {
+        return;
+    }
+
+    // Changes to notes are indexed as they happen and the index is stored next to the
+    // cache. This only needs to catch up with notes that have changed while the index
+    // wasn't looking, which is all of them the first time. That means parsing their
+    // content, so it's done a few notes at a time by indexNotes(). Changes made in the
+    // meantime go to the index right away, and searches find whatever is in there.
+    QSet<QString> staleGuids = QSet<QString>::fromList(m_searchIndex.guids());
+    m_indexQueue.clear();
+    m_indexQueue.reserve(m_notes.count());
+    for (int i = 0; i < m_notes.count(); i++) {
+        QString guid = m_notes.at(i) ? m_notes.at(i)->guid() : m_snapshotRows.at(i).guid;
+        staleGuids.remove(guid);
+        m_indexQueue.append(guid);
+    }
+    foreach (const QString &guid, staleGuids) {
+        m_searchIndex.removeNote(guid);
+    }
+
+    m_searchIndexLive = true;
+    m_indexTimer.start();
+}
+
+void NotesStore::indexNotes()
+{
+    int indexed = 0;
+    while (!m_indexQueue.isEmpty() && indexed < INDEX_BATCH_SIZE) {
+        QString guid = m_indexQueue.takeFirst();
+        int row = m_noteRows.row(guid);
+        if (row < 0) {
+            // Removed in the meantime, which took it out of the index too
+            continue;
+        }
+        Note *note = m_notes.at(row);
+        qint32 updateSequenceNumber = note ? note->updateSequenceNumber() : m_pendingNotes.value(guid);
+        bool synced = note ? note->synced() : m_snapshotRows.at(row).synced;
+
+        // Local changes don't get a new update sequence number until they're uploaded
+        if (synced && m_searchIndex.updateSequenceNumber(guid) == updateSequenceNumber) {
+            continue;
+        }
+
+        m_searchIndex.setTitle(guid, note ? note->title() : m_snapshotRows.at(row).title);
+        EnmlDocument content;
+        if (note && note->loaded()) {
+            content.setEnml(note->enmlContent());
+        } else if (m_contentStore.contains(guid)) {
+            content.setEnml(QString::fromUtf8(m_contentStore.read(guid)));
+        }
+        m_searchIndex.setContent(guid, content.toPlaintext());
+        m_searchIndex.setTodos(guid, content.todos());
+        m_searchIndex.setRecognition(guid, recognizedText(guid));
+        m_searchIndex.setUpdateSequenceNumber(guid, updateSequenceNumber);
+        indexed++;
+    }
+
+    if (m_indexQueue.isEmpty()) {
+        m_indexTimer.stop();
+        m_searchIndex.commit();
+        qCDebug(dcNotesStore) << "Search index is up to date with" << m_notes.count() << "notes";
+
+        // The local results so far came from a partial index
+        if (!m_searchWords.isEmpty()) {
+            if (m_searchQuery) {
+                m_searchQuery->cancel();
+                m_searchQuery.clear();
+            }
+            startSearchIndexQuery(m_searchWords);
+            emit searchingChanged();
+        }
+    }
+}
+
+NoteSnapshot::Row NotesStore::snapshotRow(int row) const
+{
+    Note *note = m_notes.at(row);
+    if (!note) {
+        return m_snapshotRows.at(row);
+    }
+
+    NoteSnapshot::Row snapshot;
+    snapshot.guid = note->guid();
+    snapshot.notebookGuid = note->notebookGuid();
+    snapshot.title = note->title();
+    snapshot.tagline = note->tagline();
+    snapshot.created = note->created();
+    snapshot.updated = note->updated();
+    snapshot.tagGuids = note->tagGuids();
+    snapshot.resourceUrls = note->resourceUrls();
+    snapshot.reminderOrder = note->reminderOrder();
+    snapshot.reminderTime = note->reminderTime();
+    snapshot.reminderDoneTime = note->reminderDoneTime();
+    snapshot.deleted = note->deleted();
+    snapshot.synced = note->synced();
+    return snapshot;
+}
+
+NoteSnapshot::Row NotesStore::snapshotRow(const NoteInfo &info) const
+{
+    NoteSnapshot::Row snapshot;
+    snapshot.guid = info.guid;
+    snapshot.notebookGuid = info.notebookGuid;
+    snapshot.title = info.title;
+    snapshot.tagline = info.tagline;
+    snapshot.created = info.created;
+    snapshot.updated = info.updated;
+    snapshot.tagGuids = info.tagGuids;
+    // The resource urls are left out. Checking which resources are on disk costs a stat()
+    // per resource, so snapshotResourceUrls() does that once the row is actually shown.
+    snapshot.reminderOrder = info.reminderOrder;
+    snapshot.reminderTime = info.reminderTime;
+    snapshot.reminderDoneTime = info.reminderDoneTime;
+    snapshot.deleted = info.deleted;
+    snapshot.synced = info.lastSyncedSequenceNumber == info.updateSequenceNumber;
+    return snapshot;
+}
+
+QStringList NotesStore::snapshotResourceUrls(const QString &guid) const
+{
+    QStringList urls;
+    NoteInfo info = m_noteInfoTable.record(guid);
+    foreach (const NoteResourceInfo &resource, info.resources) {
+        QString filePath = Resource::filePathFor(resource.hash, resource.fileName, resource.type);
+        urls << Note::resourceUrl(guid, resource.hash, resource.type, filePath);
+    }
+    return urls;
+}
+
+QVariant NotesStore::snapshotData(const NoteSnapshot::Row &row, int role) const
+{
+    switch (role) {
+    case RoleGuid:
+        return row.guid;
+    case RoleNotebookGuid:
+        return row.notebookGuid;
+    case RoleCreated:
+        return row.created;
+    case RoleCreatedString:
+        return Note::dateString(row.created.date());
+    case RoleUpdated:
+        return row.updated;
+    case RoleUpdatedString:
+        return Note::dateString(row.updated.date());
+    case RoleTitle:
+        return row.title;
+    case RoleReminder:
+        return row.reminderOrder > 0;
+    case RoleReminderTime:
+        return row.reminderTime;
+    case RoleReminderTimeString:
+        return Note::reminderTimeString(row.reminderOrder, row.reminderTime, !row.reminderDoneTime.isNull());
+    case RoleReminderDone:
+        return !row.reminderDoneTime.isNull();
+    case RoleReminderDoneTime:
+        return row.reminderDoneTime;
+    case RoleTagline:
+        return row.tagline;
+    case RoleResourceUrls:
+        if (row.resourceUrls.isEmpty()) {
+            return snapshotResourceUrls(row.guid);
+        }
+        return row.resourceUrls;
+    case RoleReminderSorting:
+        return QVariant::fromValue(row.reminderTime.toMSecsSinceEpoch() +
+                (!row.reminderDoneTime.isNull() ? 10000000000000 : 0));
+    case RoleTagGuids:
+        return row.tagGuids;
+    case RoleDeleted:
+        return row.deleted;
+    case RoleSynced:
+        return row.synced;
+    case RoleIsSearchResult:
+        return m_searchScores.contains(row.guid);
+    case RoleLoading:
+    case RoleSyncError:
+    case RoleConflicting:
+        return false;
+    case RoleSearchScore:
+        return m_searchScores.value(row.guid);
+    case RoleSearchSnippet:
+        return searchSnippet(row.guid);
+    }
+    return QVariant();
+}
+
+void NotesStore::saveSnapshot()
+{
+    QString fileName = storageLocation() + "notes.snapshot";
+    if (m_notes.isEmpty() && !QFile::exists(fileName)) {
+        return;
+    }
+
+    QElapsedTimer saveTimer;
+    saveTimer.start();
+
+    QVector<NoteSnapshot::Row> rows;
+    rows.reserve(m_notes.count());
+    for (int i = 0; i < m_notes.count(); i++) {
+        rows.append(snapshotRow(i));
+    }
+    if (NoteSnapshot::write(fileName, rows)) {
+        qCDebug(dcStorage) << "Wrote snapshot of" << rows.count() << "notes in" << saveTimer.elapsed() << "ms";
+    }
+}
+
+void NotesStore::applicationStateChanged(Qt::ApplicationState state)
+{
+    // We might get killed without further notice while suspended
+    if (state == Qt::ApplicationSuspended || state == Qt::ApplicationHidden) {
+        saveSnapshot();
     }
-    cacheFile.endGroup();
-    qCDebug(dcNotesStore) << "Loaded" << m_notes.count() << "notes from disk.";
 }
 
 QVector<int> NotesStore::updateFromEDAM(const evernote::edam::NoteMetadata &evNote, Note *note)
@@ -1762,6 +2977,7 @@ QVector<int> NotesStore::updateFromEDAM(const evernote::edam::NoteMetadata &evNo
 
 void NotesStore::updateFromEDAM(const evernote::edam::Notebook &evNotebook, Notebook *notebook)
 {
+    notebook->m_edam = EdamCodec::encode(evNotebook);
     if (evNotebook.__isset.guid && QString::fromStdString(evNotebook.guid) != notebook->guid()) {
         notebook->setGuid(QString::fromStdString(evNotebook.guid));
     }
@@ -1804,23 +3020,117 @@ bool NotesStore::handleUserError(EvernoteConnection::ErrorCode errorCode)
 
 void NotesStore::removeNote(const QString &guid)
 {
-    Note *note = m_notesHash.value(guid);
-    int idx = m_notes.indexOf(note);
+    removeNotes(QStringList() << guid);
+}
 
-    emit noteRemoved(note->guid(), note->notebookGuid());
+// Notes are always added at the end
+void NotesStore::appendNotes(const QList<Note *> &notes)
+{
+    if (notes.isEmpty()) {
+        return;
+    }
+
+    // Telling about every row costs more than starting over when most of them are new,
+    // like on the first sync
+    bool reset = notes.count() >= RESET_THRESHOLD && notes.count() > m_notes.count();
+    if (reset) {
+        beginResetModel();
+    } else {
+        beginInsertRows(QModelIndex(), m_notes.count(), m_notes.count() + notes.count() - 1);
+    }
+    QStringList guids;
+    foreach (Note *note, notes) {
+        m_notesHash.insert(note->guid(), note);
+        m_noteRows.append(note->guid());
+        m_notes.append(note);
+        guids.append(note->guid());
+    }
+    if (reset) {
+        endResetModel();
+    } else {
+        endInsertRows();
+    }
 
-    beginRemoveRows(QModelIndex(), idx, idx);
-    m_notes.removeAt(idx);
-    m_notesHash.remove(note->guid());
-    endRemoveRows();
+    emit notesAdded(guids);
     emit countChanged();
+}
 
-    QSettings settings(m_cacheFile, QSettings::IniFormat);
-    settings.beginGroup("notes");
-    settings.remove(note->guid());
-    settings.endGroup();
+void NotesStore::removeNotes(const QStringList &guids)
+{
+    QList<Note*> notes;
+    QList<int> rows;
+    QStringList removedGuids;
+    foreach (const QString &guid, guids) {
+        // Rows that haven't been hydrated yet are removed without creating their Note
+        int row = m_noteRows.row(guid);
+        if (row < 0) {
+            qCWarning(dcNotesStore) << "Note not found. Can't remove" << guid;
+            continue;
+        }
+        if (m_notes.at(row)) {
+            notes.append(m_notes.at(row));
+        }
+        m_pendingNotes.remove(guid);
+        rows.append(row);
+        removedGuids.append(guid);
+    }
+    if (rows.isEmpty()) {
+        return;
+    }
+
+    emit notesRemoved(removedGuids);
+
+    // The queued rows are about to move
+    flushDataChanged();
+    bool reset = rows.count() >= RESET_THRESHOLD && rows.count() > m_notes.count() - rows.count();
+    if (reset) {
+        beginResetModel();
+    }
+
+    // From the last row on, so the rows still to remove don't move. Neighbouring rows are
+    // removed as one range.
+    std::sort(rows.begin(), rows.end(), std::greater<int>());
+    int i = 0;
+    while (i < rows.count()) {
+        int last = rows.at(i);
+        int first = last;
+        while (i + 1 < rows.count() && rows.at(i + 1) == first - 1) {
+            first--;
+            i++;
+        }
+        i++;
+
+        if (!reset) {
+            beginRemoveRows(QModelIndex(), first, last);
+        }
+        for (int row = last; row >= first; row--) {
+            m_notesHash.remove(m_noteRows.guid(row));
+            m_noteRows.removeRow(row);
+            m_notes.removeAt(row);
+            if (row < m_snapshotRows.count()) {
+                m_snapshotRows.removeAt(row);
+                if (row < m_hydrateRow) {
+                    m_hydrateRow--;
+                }
+            }
+        }
+        if (!reset) {
+            endRemoveRows();
+        }
+    }
+
+    if (reset) {
+        endResetModel();
+    }
+    emit countChanged();
 
-    note->deleteLater();
+    foreach (const QString &guid, removedGuids) {
+        m_searchIndex.removeNote(guid);
+        deleteFromCacheFile(guid);
+    }
+    foreach (Note *note, notes) {
+        note->deleteLater();
+    }
 }
 
 void NotesStore::expungeTag(const QString &guid)
@@ -1846,7 +3156,7 @@ void NotesStore::expungeTag(const QString &guid)
 
     while (tag->noteCount() > 0) {
         QString noteGuid = tag->noteAt(0);
-        Note *note = m_notesHash.value(noteGuid);
+        Note *note = findNote(noteGuid);
         if (!note) {
             qCWarning(dcNotesStore) << "Tag holds note" << noteGuid << "which hasn't been found in Notes Store";
             Q_ASSERT(false);
@@ -1860,10 +3170,7 @@ void NotesStore::expungeTag(const QString &guid)
         m_tagsHash.remove(guid);
         m_tags.removeAll(tag);
 
-        QSettings cacheFile(m_cacheFile, QSettings::IniFormat);
-        cacheFile.beginGroup("tags");
-        cacheFile.remove(guid);
-        cacheFile.endGroup();
+        m_cacheJournal.removeEntry(CacheJournal::KindTag, guid);
         tag->syncToInfoFile();
 
         tag->deleteInfoFile();
@@ -1885,7 +3192,7 @@ void NotesStore::expungeTag(const QString &guid)
 
 void NotesStore::resolveConflict(const QString &noteGuid, NotesStore::ConflictResolveMode mode)
 {
-    Note *note = m_notesHash.value(noteGuid);
+    Note *note = findNote(noteGuid);
     if (!note) {
         qCWarning(dcNotesStore) << "Should resolve a conflict but can't find note for guid:" << noteGuid;
         return;
@@ -1906,11 +3213,22 @@ void NotesStore::resolveConflict(const QString &noteGuid, NotesStore::ConflictRe
         // Conflicting notes have their guid prefixed, lets correct that
         newNote->setGuid(note->guid());
         newNote->setConflicting(false);
-        int idx = m_notes.indexOf(note);
+        int idx = m_noteRows.row(note->guid());
         m_notesHash[note->guid()] = newNote;
         m_notes.replace(idx, newNote);
+        if (m_searchIndexLive) {
+            // The index still holds what the local note said
+            EnmlDocument content;
+            content.setEnml(newNote->enmlContent());
+            m_searchIndex.setTitle(newNote->guid(), newNote->title());
+            m_searchIndex.setContent(newNote->guid(), content.toPlaintext());
+            m_searchIndex.setTodos(newNote->guid(), content.todos());
+            m_searchIndex.setRecognition(newNote->guid(), recognizedText(newNote->guid()));
+            m_searchIndex.setUpdateSequenceNumber(newNote->guid(), newNote->updateSequenceNumber());
+            m_searchIndex.commit();
+        }
         emit noteChanged(newNote->guid(), newNote->notebookGuid());
-        emit dataChanged(index(idx), index(idx));
+        queueDataChanged(idx);
         saveNote(note->guid());
     }
 }
@@ -23,6 +23,18 @@
 
 #include "evernoteconnection.h"
 #include "utils/enmldocument.h"
+#include "utils/noteattributeindex.h"
+#include "utils/cachejournal.h"
+#include "utils/contentstore.h"
+#include "utils/guidrowindex.h"
+#include "utils/noteinfotable.h"
+#include "utils/edamtable.h"
+#include "utils/notesnapshot.h"
+#include "utils/resourcestore.h"
+#include "utils/searchgrammar.h"
+#include "utils/searchindex.h"
+#include "utils/thumbnailcache.h"
+#include "utils/writebehindqueue.h"
 #include "jobs/fetchnotejob.h"
 
 // Thrift
@@ -39,8 +51,12 @@
 
 #include <QAbstractListModel>
 #include <QHash>
-#include <QSettings>
+#include <QMap>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
 
+class FetchNotesJob;
 class Notebook;
 class Note;
 class Tag;
@@ -61,6 +77,17 @@ class NotesStore : public QAbstractListModel
     Q_PROPERTY(bool notebooksLoading READ notebooksLoading NOTIFY notebooksLoadingChanged)
     Q_PROPERTY(QString error READ error NOTIFY errorChanged)
     Q_PROPERTY(int count READ count NOTIFY countChanged)
+    // When lazy loading (the default), a Note is only created from the cache once it is
+    // asked for. Otherwise all notes are created in the background after loading the cache.
+    Q_PROPERTY(bool lazyLoading READ lazyLoading WRITE setLazyLoading NOTIFY lazyLoadingChanged)
+    // When set, note content is compressed against a dictionary trained from the cached
+    // notes, which makes the cache smaller. Off by default, using plain zlib.
+    Q_PROPERTY(bool compressionDictionary READ compressionDictionary WRITE setCompressionDictionary NOTIFY compressionDictionaryChanged)
+    // When set, the words the server recognized in images and PDFs are fetched in the
+    // background and indexed for offline search
+    Q_PROPERTY(bool indexRecognition READ indexRecognition WRITE setIndexRecognition NOTIFY indexRecognitionChanged)
+    // True while results for the last findNotes() call are still on their way
+    Q_PROPERTY(bool searching READ searching NOTIFY searchingChanged)
 
 public:
     enum Role {
@@ -89,7 +116,11 @@ public:
         RoleLoading,
         RoleSynced,
         RoleSyncError,
-        RoleConflicting
+        RoleConflicting,
+        // The local and server rankings of a note combined by reciprocal rank fusion,
+        // not the BM25 score of the search index
+        RoleSearchScore,
+        RoleSearchSnippet
     };
 
     enum ConflictResolveMode {
@@ -104,6 +135,23 @@ public:
     Q_SLOT void setUsername(const QString &username);
 
     QString storageLocation();
+    NoteInfoTable *noteInfoTable();
+    EdamTable *notebookTable();
+    EdamTable *tagTable();
+    ContentStore *contentStore();
+    ResourceStore *resourceStore();
+    ThumbnailCache *thumbnailCache();
+    SearchIndex *searchIndex();
+    // Whether changes to the notes go to the search index as they happen
+    bool searchIndexLive() const;
+    const NoteAttributeIndex *attributeIndex() const;
+    // The rows of the current search results
+    RowBitmap searchResultRows() const;
+    // Changes whenever the search results do
+    quint64 searchResultsGeneration() const;
+    bool isSearchResult(const QString &guid) const;
+    // How well a note matches the current search, 0 if it doesn't
+    qreal searchScore(const QString &guid) const;
 
     bool loading() const;
     bool notebooksLoading() const;
@@ -113,19 +161,39 @@ public:
 
     int count() const;
 
+    bool lazyLoading() const;
+    void setLazyLoading(bool lazyLoading);
+
+    bool compressionDictionary() const;
+    void setCompressionDictionary(bool compressionDictionary);
+
+    bool indexRecognition() const;
+    void setIndexRecognition(bool indexRecognition);
+
+    bool searching() const;
+
     // reimplemented from QAbstractListModel
     int rowCount(const QModelIndex &parent = QModelIndex()) const;
     QVariant data(const QModelIndex &index, int role) const;
     QHash<int, QByteArray> roleNames() const;
 
-    QList<Note*> notes() const;
-    Q_INVOKABLE Note* note(int index) const;
+    // Creates any notes that are still only known from their cached records
+    QList<Note*> notes();
+    Q_INVOKABLE Note* note(int index);
+
+    // Guids of the notes in a notebook or with a tag, without creating the notes
+    QStringList notesInNotebook(const QString &notebookGuid) const;
+    QStringList notesWithTag(const QString &tagGuid) const;
 
     Q_INVOKABLE Note* note(const QString &guid);
     Q_INVOKABLE Note* createNote(const QString &title, const QString &notebookGuid = QString(), const QString &richTextContent = QString());
     Note *createNote(const QString &title, const QString &notebookGuid, const EnmlDocument &content);
     Q_INVOKABLE void saveNote(const QString &guid);
     Q_INVOKABLE void deleteNote(const QString &guid);
+    // Searches run in the background. Starting a new search cancels the previous one,
+    // and when it only adds to the previous search, its results are narrowed down.
+    // Notes found in the local index show up first. When online, the server's results
+    // are merged in as they arrive.
     Q_INVOKABLE void findNotes(const QString &searchWords);
     Q_INVOKABLE void clearSearchResults();
 
@@ -164,12 +232,17 @@ signals:
     void tagsLoadingChanged();
     void errorChanged();
     void countChanged();
+    void lazyLoadingChanged();
+    void compressionDictionaryChanged();
+    void indexRecognitionChanged();
+    void searchingChanged();
 
     void noteCreated(const QString &guid, const QString &notebookGuid);
     void noteUpdated(const QString &guid, const QString &notebookGuid);
-    void noteAdded(const QString &guid, const QString &notebookGuid);
+    // Sent once for all notes added or removed together, like in a sync
+    void notesAdded(const QStringList &guids);
     void noteChanged(const QString &guid, const QString &notebookGuid);
-    void noteRemoved(const QString &guid, const QString &notebookGuid);
+    void notesRemoved(const QStringList &guids);
     void noteGuidChanged(const QString &oldGuid, const QString &newGuid);
 
     void notebookAdded(const QString &guid);
@@ -187,6 +260,9 @@ signals:
 
 private slots:
     void fetchNotesJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const evernote::edam::NotesMetadataList &results, const QString &filterNotebookGuid);
+    void searchNotesJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const evernote::edam::NotesMetadataList &results, const QString &filterNotebookGuid);
+    void searchIndexQueryDone();
+    void fetchRecognitionJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const QString &noteGuid, const QString &hash, const QString &text);
     void fetchNotebooksJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const std::vector<evernote::edam::Notebook> &results);
     void fetchNoteJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const evernote::edam::Note &result, FetchNoteJob::LoadWhatFlags what);
     void fetchConflictingNoteJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const evernote::edam::Note &result, FetchNoteJob::LoadWhatFlags what);
@@ -202,22 +278,62 @@ private slots:
     void expungeTagJobDone(EvernoteConnection::ErrorCode errorCode, const QString &errorMessage, const QString &guid);
 
     void syncToCacheFile(Note *note);
-    void deleteFromCacheFile(Note* note);
+    void deleteFromCacheFile(const QString &guid);
     void syncToCacheFile(Notebook *notebook);
     void syncToCacheFile(Tag *tag);
     void loadFromCacheFile();
+    void flushCache();
+    void saveSnapshot();
+    void hydrateNotes();
+    void indexNotes();
+    void hydrateRequestedNotes();
+    void applicationStateChanged(Qt::ApplicationState state);
 
     void userStoreConnected();
     void emitDataChanged();
+    void flushDataChanged();
     void clear();
+    void attributeRowsInserted(const QModelIndex &parent, int first, int last);
+    void attributeRowsRemoved(const QModelIndex &parent, int first, int last);
+    void attributesReset();
+    void attributesChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
 
 private:
     QVector<int>    updateFromEDAM(const evernote::edam::NoteMetadata &evNote, Note *note);
     void updateFromEDAM(const evernote::edam::Notebook &evNotebook, Notebook *notebook);
+    void updateFromEDAM(const evernote::edam::NotesMetadataList &results);
 
     bool handleUserError(EvernoteConnection::ErrorCode errorCode);
 
     void removeNote(const QString &guid);
+    void appendNotes(const QList<Note*> &notes);
+    void removeNotes(const QStringList &guids);
+    // Announces changes to a row with the next flushDataChanged(). No roles means all.
+    void queueDataChanged(int row, const QVector<int> &roles = QVector<int>());
+
+    Note *findNote(const QString &guid);
+    Note *hydrateNote(int row);
+    void hydrateAllNotes();
+    NoteSnapshot::Row snapshotRow(int row) const;
+    NoteSnapshot::Row snapshotRow(const NoteInfo &info) const;
+    QStringList snapshotResourceUrls(const QString &guid) const;
+    QVariant snapshotData(const NoteSnapshot::Row &row, int role) const;
+    void buildSearchIndex();
+    void startSearchIndexQuery(const QString &searchWords);
+    void startSearchJob(int startIndex);
+    QString serverSearchWords() const;
+    QString searchSnippet(const QString &guid) const;
+    NoteAttributeIndex::Attributes noteAttributes(int row) const;
+    RowBitmap searchFilter(const SearchGrammar &grammar);
+    static NoteAttributeIndex::DateField dateField(SearchGrammar::Type type);
+    void setSearchIndexResults(const QHash<QString, qreal> &scores);
+    void updateSearchResults();
+    void setSearchScores(const QHash<QString, qreal> &scores);
+    void cancelSearch();
+    QList<NoteResourceInfo> resources(const QString &guid) const;
+    QString recognizedText(const QString &guid) const;
+    void queueRecognition(const QString &guid);
+    void startRecognitionJob();
 
 private:
     explicit NotesStore(QObject *parent = 0);
@@ -231,6 +347,8 @@ private:
 
     QStringList m_errorQueue;
 
+    // Notes that haven't been created yet are nullptr. They are all within the first
+    // rows, which are served from m_snapshotRows, one entry for each of these rows.
     QList<Note*> m_notes;
     QList<Notebook*> m_notebooks;
     QList<Tag*> m_tags;
@@ -239,12 +357,67 @@ private:
     QHash<QString, Note*> m_notesHash;
     QHash<QString, Notebook*> m_notebooksHash;
     QHash<QString, Tag*> m_tagsHash;
+    // The row of every note, created or not
+    GuidRowIndex m_noteRows;
 
     QStringList m_unhandledNotes;
 
+    QVector<NoteSnapshot::Row> m_snapshotRows;
+    QHash<QString, qint32> m_pendingNotes;
+    int m_hydrateRow;
+    QTimer m_hydrateTimer;
+    // Notes whose content has been asked for by data(), created on the next event loop
+    // pass since data() can't change the model
+    mutable QSet<QString> m_hydrateRequests;
+    bool m_lazyLoading;
+
+    // Rows changed since the last flushDataChanged(), with a bit for each changed role
+    QMap<int, quint64> m_changedRows;
+    QTimer m_dataChangedTimer;
+
     OrganizerAdapter *m_organizerAdapter;
 
-    QString m_cacheFile;
+    CacheJournal m_cacheJournal;
+    NoteInfoTable m_noteInfoTable;
+    EdamTable m_notebookTable;
+    EdamTable m_tagTable;
+    ContentStore m_contentStore;
+    ResourceStore m_resourceStore;
+    ThumbnailCache m_thumbnailCache;
+    WriteBehindQueue m_writeQueue;
+    SearchIndex m_searchIndex;
+    bool m_searchIndexLive;
+    // Notes still to be checked by the index catching up, a few on every timer tick
+    QStringList m_indexQueue;
+    QTimer m_indexTimer;
+    // Follows every change to the rows, for filtering and the non-text parts of searches
+    NoteAttributeIndex m_attributeIndex;
+    // Relevance of the current search results by guid, merged from their ranks in the
+    // local index and on the server
+    QHash<QString, qreal> m_searchScores;
+    quint64 m_searchResultsGeneration;
+    QHash<QString, int> m_localSearchRanks;
+    QHash<QString, int> m_serverSearchRanks;
+    // Snippets of the current search results, made as the rows get shown
+    QString m_searchSnippetWords;
+    mutable QHash<QString, QString> m_searchSnippets;
+    mutable quint64 m_searchSnippetsGeneration;
+
+    // The running search
+    QString m_searchWords;
+    QPointer<FetchNotesJob> m_searchJob;
+    QPointer<SearchIndexQuery> m_searchQuery;
+    quint64 m_searchQueryGeneration;
+    // The last completed local search, used to narrow down the next one
+    QString m_lastSearchWords;
+    QSet<QString> m_lastSearchResults;
+    quint64 m_lastSearchGeneration;
+
+    // Resources waiting for their recognition data, as note guid and resource hash
+    bool m_indexRecognition;
+    QList<QPair<QString, QString> > m_recognitionQueue;
+    QSet<QString> m_queuedRecognition;
+    bool m_recognitionJobRunning;
 };
 
 #endif // NOTESSTORE_H
@@ -38,7 +38,8 @@ Resource::Resource(const QByteArray &data, const QString &hash, const QString &f
         // TRANSLATORS: A default file name if we don't get one from the server. Avoid weird characters.
         m_fileName = tr("Unnamed") + "." + m_type.split("/").last();
     }
-    m_filePath = NotesStore::instance()->storageLocation() + hash + "." + m_fileName.split('.').last();
+    m_filePath = filePathFor(hash, m_fileName, m_type);
+    NotesStore::instance()->resourceStore()->ref(m_hash);
 
     QFile file(m_filePath);
     if (!data.isEmpty() && !file.exists()) {
@@ -58,6 +59,13 @@ Resource::Resource(const QString &hash, const QString &fileName, const QString &
 
 }
 
+Resource::~Resource()
+{
+    if (!m_hash.isEmpty()) {
+        NotesStore::instance()->resourceStore()->unref(m_hash);
+    }
+}
+
 bool Resource::isCached()
 {
     QFileInfo fi(m_filePath);
@@ -89,6 +97,7 @@ Resource::Resource(const QString &path, QObject *parent):
     }
 
     m_filePath = NotesStore::instance()->storageLocation() + m_hash + "." + m_fileName.split('.').last();
+    NotesStore::instance()->resourceStore()->ref(m_hash);
 
     QFile copy(m_filePath);
     if (!copy.exists()) {
@@ -117,30 +126,29 @@ QString Resource::hashedFilePath() const
     return m_filePath;
 }
 
+QString Resource::filePathFor(const QString &hash, const QString &fileName, const QString &type)
+{
+    QString extension = fileName.isEmpty() ? type.split("/").last() : fileName.split('.').last();
+    return NotesStore::instance()->storageLocation() + hash + "." + extension;
+}
+
+QString Resource::recognitionFilePathFor(const QString &hash)
+{
+    // Named like the resource itself, so it goes away with it
+    return NotesStore::instance()->storageLocation() + hash + ".reco";
+}
+
 QByteArray Resource::imageData(const QSize &size)
 {
     if (!m_type.startsWith("image/")) {
         return QByteArray();
     }
 
-    QString finalFilePath = m_filePath;
     if (size.isValid() && !size.isNull()) {
-        finalFilePath = m_filePath + "_" + QString::number(size.width()) + "x" + QString::number(size.height()) + ".jpg";
-        QFileInfo fi(finalFilePath);
-        if (!fi.exists()) {
-            QImage image(m_filePath);
-            if (size.height() > 0 && size.width() > 0) {
-                image = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-            } else if (size.height() > 0) {
-                image = image.scaledToHeight(size.height(), Qt::SmoothTransformation);
-            } else {
-                image = image.scaledToWidth(size.width(), Qt::SmoothTransformation);
-            }
-            image.save(finalFilePath);
-        }
+        return NotesStore::instance()->thumbnailCache()->imageData(m_filePath, size);
     }
 
-    QFile file(finalFilePath);
+    QFile file(m_filePath);
     if (file.open(QFile::ReadOnly)) {
         return file.readAll();
     }
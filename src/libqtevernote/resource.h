@@ -38,6 +38,7 @@ public:
     Resource(const QString &path, QObject *parent = 0);
     Resource(const QByteArray &data, const QString &hash, const QString &fileName, const QString &type, QObject *parent = 0);
     Resource(const QString &hash, const QString &fileName, const QString &type, QObject *parent = 0);
+    ~Resource();
 
     bool isCached();
 
@@ -50,6 +51,11 @@ public:
 
     QByteArray imageData(const QSize &size = QSize());
 
+    // Where the resource is stored, without having to create a Resource for it
+    static QString filePathFor(const QString &hash, const QString &fileName, const QString &type);
+    // Where the words the server recognized in the resource are stored
+    static QString recognitionFilePathFor(const QString &hash);
+
 private:
     QString m_hash;
     QString m_fileName;
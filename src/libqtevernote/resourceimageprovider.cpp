@@ -18,12 +18,12 @@ QImage ResourceImageProvider::requestImage(const QString &id, QSize *size, const
 {
     QString mediaType = id.split("?").first();
     QUrlQuery arguments(id.split('?').last());
-    QString noteGuid = arguments.queryItemValue("noteGuid");
-    QString resourceHash = arguments.queryItemValue("hash");
     bool isLoaded = arguments.queryItemValue("loaded") == "true";
-    Note *note = NotesStore::instance()->note(noteGuid);
-    if (!note) {
-        qCWarning(dcNotesStore) << "Unable to find note for resource:" << id;
+    // We're called from the image loader threads. Don't touch the notes in here, they
+    // might not even be created yet while the list is still served from the snapshot.
+    QString fileName = QFileInfo(arguments.queryItemValue("file")).fileName();
+    if (fileName.isEmpty()) {
+        qCWarning(dcNotesStore) << "Unable to find file for resource:" << id;
         return QImage();
     }
 
@@ -34,7 +34,8 @@ QImage ResourceImageProvider::requestImage(const QString &id, QSize *size, const
             if (!requestedSize.isValid() || requestedSize.width() > 1024 || requestedSize.height() > 1024) {
                 tmpSize = QSize(1024, 1024);
             }
-            image = QImage::fromData(NotesStore::instance()->note(noteGuid)->resource(resourceHash)->imageData(tmpSize));
+            QString filePath = NotesStore::instance()->storageLocation() + fileName;
+            image = QImage::fromData(NotesStore::instance()->thumbnailCache()->imageData(filePath, tmpSize));
         } else {
             image = loadIcon("image-x-generic-symbolic", requestedSize);
         }
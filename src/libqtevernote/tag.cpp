@@ -22,7 +22,11 @@
 #include "note.h"
 
 #include "notesstore.h"
+#include "logging.h"
+#include "utils/edamcodec.h"
 
+#include <QSet>
+#include <QSettings>
 #include <QStandardPaths>
 
 Tag::Tag(const QString &guid, quint32 updateSequenceNumber, QObject *parent) :
@@ -33,20 +37,25 @@ Tag::Tag(const QString &guid, quint32 updateSequenceNumber, QObject *parent) :
     m_loading(false),
     m_syncError(false)
 {
-    setGuid(guid);
-    QSettings infoFile(m_infoFile, QSettings::IniFormat);
-    m_name = infoFile.value("name").toString();
-    m_deleted = infoFile.value("deleted").toBool();
-    m_lastSyncedSequenceNumber = infoFile.value("lastSyncedSequenceNumber", 0).toUInt();
-    m_synced = m_lastSyncedSequenceNumber == m_updateSequenceNumber;
+    EdamTable *table = NotesStore::instance()->tagTable();
+    if (!table->contains(guid)) {
+        migrateInfoFile();
+    }
 
-    foreach (Note *note, NotesStore::instance()->notes()) {
-        if (note->tagGuids().contains(m_guid)) {
-            m_notesList.append(note->guid());
-        }
+    EdamRecord record = table->record(guid);
+    evernote::edam::Tag tag;
+    if (!record.edam.isEmpty()) {
+        EdamCodec::decode(record.edam, &tag);
     }
-    connect(NotesStore::instance(), &NotesStore::noteAdded, this, &Tag::noteAdded);
-    connect(NotesStore::instance(), &NotesStore::noteRemoved, this, &Tag::noteRemoved);
+    m_edam = record.edam;
+    m_name = QString::fromStdString(tag.name);
+    m_deleted = record.deleted;
+    m_lastSyncedSequenceNumber = record.lastSyncedSequenceNumber;
+    m_synced = m_lastSyncedSequenceNumber == m_updateSequenceNumber;
+
+    m_notesList = NotesStore::instance()->notesWithTag(m_guid);
+    connect(NotesStore::instance(), &NotesStore::notesAdded, this, &Tag::notesAdded);
+    connect(NotesStore::instance(), &NotesStore::notesRemoved, this, &Tag::notesRemoved);
     connect(NotesStore::instance(), &NotesStore::noteChanged, this, &Tag::noteChanged);
     connect(NotesStore::instance(), &NotesStore::noteGuidChanged, this, &Tag::noteGuidChanged);
 }
@@ -62,20 +71,12 @@ QString Tag::guid() const
 
 void Tag::setGuid(const QString &guid)
 {
-    bool syncToFile = false;
-    if (!m_infoFile.isEmpty()) {
-        QFile ifile(m_infoFile);
-        ifile.remove();
-
-        syncToFile = true;
+    if (guid == m_guid) {
+        return;
     }
-
+    NotesStore::instance()->tagTable()->remove(m_guid);
     m_guid = guid;
-    m_infoFile = NotesStore::instance()->storageLocation() + "tag-" + guid + ".info";
-
-    if (syncToFile) {
-        syncToInfoFile();
-    }
+    syncToInfoFile();
     emit guidChanged();
 }
 
@@ -132,23 +133,34 @@ Tag *Tag::clone()
     Tag *tag = new Tag(m_guid, m_updateSequenceNumber);
     tag->setName(m_name);
     tag->setDeleted(m_deleted);
+    tag->m_edam = m_edam;
     return tag;
 }
 
-void Tag::noteAdded(const QString &noteGuid, const QString &notebookGuid)
+void Tag::notesAdded(const QStringList &noteGuids)
 {
-    Q_UNUSED(notebookGuid)
-    if (NotesStore::instance()->note(noteGuid)->tagGuids().contains(m_guid)) {
-        m_notesList.append(noteGuid);
+    int count = m_notesList.count();
+    foreach (const QString &noteGuid, noteGuids) {
+        if (NotesStore::instance()->note(noteGuid)->tagGuids().contains(m_guid)) {
+            m_notesList.append(noteGuid);
+        }
+    }
+    if (m_notesList.count() != count) {
         emit noteCountChanged();
     }
 }
 
-void Tag::noteRemoved(const QString &noteGuid, const QString &notebookGuid)
+void Tag::notesRemoved(const QStringList &noteGuids)
 {
-    Q_UNUSED(notebookGuid)
-    if (m_notesList.contains(noteGuid)) {
-        m_notesList.removeAll(noteGuid);
+    QSet<QString> removed = noteGuids.toSet();
+    QList<QString> notesList;
+    foreach (const QString &noteGuid, m_notesList) {
+        if (!removed.contains(noteGuid)) {
+            notesList.append(noteGuid);
+        }
+    }
+    if (notesList.count() != m_notesList.count()) {
+        m_notesList = notesList;
         emit noteCountChanged();
     }
 }
@@ -179,18 +191,48 @@ void Tag::noteGuidChanged(const QString &oldGuid, const QString &newGuid)
 
 void Tag::syncToInfoFile()
 {
-    QSettings infoFile(m_infoFile, QSettings::IniFormat);
-    infoFile.setValue("name", m_name);
-    infoFile.setValue("deleted", m_deleted);
-    infoFile.setValue("lastSyncedSequenceNumber", m_lastSyncedSequenceNumber);
+    // Written over what the server sent, so fields we don't know about stay
+    evernote::edam::Tag tag;
+    if (!m_edam.isEmpty()) {
+        EdamCodec::decode(m_edam, &tag);
+    }
+    tag.guid = m_guid.toStdString();
+    tag.__isset.guid = true;
+    tag.name = m_name.toStdString();
+    tag.__isset.name = true;
+    tag.updateSequenceNum = m_updateSequenceNumber;
+    tag.__isset.updateSequenceNum = true;
+
+    EdamRecord record;
+    record.guid = m_guid;
+    record.edam = EdamCodec::encode(tag);
+    record.lastSyncedSequenceNumber = m_lastSyncedSequenceNumber;
+    record.deleted = m_deleted;
+    NotesStore::instance()->tagTable()->write(record);
 }
 
 void Tag::deleteInfoFile()
 {
-    QFile f(m_infoFile);
-    if (f.exists()) {
-        f.remove();
+    NotesStore::instance()->tagTable()->remove(m_guid);
+}
+
+void Tag::migrateInfoFile()
+{
+    QString infoFileName = NotesStore::instance()->storageLocation() + "tag-" + m_guid + ".info";
+    if (!QFile::exists(infoFileName)) {
+        return;
     }
+
+    {
+        QSettings infoFile(infoFileName, QSettings::IniFormat);
+        m_name = infoFile.value("name").toString();
+        m_deleted = infoFile.value("deleted").toBool();
+        m_lastSyncedSequenceNumber = infoFile.value("lastSyncedSequenceNumber", 0).toUInt();
+    }
+
+    syncToInfoFile();
+    QFile::remove(infoFileName);
+    qCDebug(dcStorage) << "Migrated" << infoFileName << "to the tag table";
 }
 
 bool Tag::loading() const
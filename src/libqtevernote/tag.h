@@ -28,7 +28,7 @@
 #include <QDateTime>
 #include <QStringList>
 #include <QImage>
-#include <QSettings>
+#include <QByteArray>
 
 class Tag: public QObject
 {
@@ -80,14 +80,15 @@ signals:
     void deletedChanged();
 
 private slots:
-    void noteAdded(const QString &noteGuid, const QString &notebookGuid);
-    void noteRemoved(const QString &noteGuid, const QString &notebookGuid);
+    void notesAdded(const QStringList &noteGuids);
+    void notesRemoved(const QStringList &noteGuids);
     void noteChanged(const QString &noteGuid, const QString &notebookGuid);
     void noteGuidChanged(const QString &oldGuid, const QString &newGuid);
 
 private:
     void syncToInfoFile();
     void deleteInfoFile();
+    void migrateInfoFile();
     void setLastSyncedSequenceNumber(qint32 lastSyncedSequenceNumber);
     void setLoading(bool loading);
     void setSyncError(bool syncError);
@@ -102,7 +103,8 @@ private:
 
     QList<QString> m_notesList;
 
-    QString m_infoFile;
+    // The tag as the server sent it last, see EdamCodec
+    QByteArray m_edam;
 
     bool m_loading;
     bool m_synced;
@@ -0,0 +1,285 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cachejournal.h"
+#include "logging.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+
+#include <unistd.h>
+
+#define JOURNAL_MAGIC 0x524e4a4c // "RNJL"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE 8
+
+// Don't bother compacting small journals
+#define JOURNAL_MIN_COMPACT_RECORDS 1024
+
+CacheJournal::CacheJournal():
+    m_recordCount(0)
+{
+}
+
+CacheJournal::~CacheJournal()
+{
+    close();
+}
+
+bool CacheJournal::open(const QString &fileName, const QString &legacyFileName)
+{
+    close();
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    if (!QFile::exists(fileName) && !legacyFileName.isEmpty() && QFile::exists(legacyFileName)) {
+        migrate(legacyFileName);
+        if (writeJournal(fileName)) {
+            qCDebug(dcStorage) << "Migrated" << legacyFileName << "to" << fileName;
+            QFile::remove(legacyFileName);
+        }
+        for (int i = KindNote; i <= KindTag; i++) {
+            m_entries[i].clear();
+        }
+        m_recordCount = 0;
+    }
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::ReadWrite)) {
+        qCWarning(dcStorage) << "Cannot open cache journal" << fileName << m_file.errorString();
+        return false;
+    }
+
+    QByteArray data = m_file.readAll();
+    if (data.length() < JOURNAL_HEADER_SIZE || !data.startsWith(header())) {
+        if (!data.isEmpty()) {
+            qCWarning(dcStorage) << "Cache journal header invalid. Discarding journal" << fileName;
+        }
+        m_file.resize(0);
+        m_file.seek(0);
+        m_file.write(header());
+        m_file.flush();
+    } else {
+        replay(data);
+    }
+    m_file.seek(m_file.size());
+
+    qCDebug(dcStorage) << "Opened cache journal" << fileName << "with" << m_recordCount << "records";
+
+    if (m_recordCount > qMax(JOURNAL_MIN_COMPACT_RECORDS, liveEntryCount() * 2)) {
+        compact();
+    }
+    return true;
+}
+
+void CacheJournal::close()
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    for (int i = KindNote; i <= KindTag; i++) {
+        m_entries[i].clear();
+    }
+    m_recordCount = 0;
+}
+
+QHash<QString, qint32> CacheJournal::entries(CacheJournal::Kind kind) const
+{
+    return m_entries[kind];
+}
+
+void CacheJournal::setEntry(CacheJournal::Kind kind, const QString &guid, qint32 updateSequenceNumber)
+{
+    QHash<QString, qint32>::const_iterator it = m_entries[kind].constFind(guid);
+    if (it != m_entries[kind].constEnd() && it.value() == updateSequenceNumber) {
+        return;
+    }
+    m_entries[kind].insert(guid, updateSequenceNumber);
+    append(kind, OperationSet, guid, updateSequenceNumber);
+}
+
+void CacheJournal::removeEntry(CacheJournal::Kind kind, const QString &guid)
+{
+    if (m_entries[kind].remove(guid) == 0) {
+        return;
+    }
+    append(kind, OperationRemove, guid, 0);
+}
+
+void CacheJournal::sync()
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+    m_file.flush();
+    if (fsync(m_file.handle()) != 0) {
+        qCWarning(dcStorage) << "Error syncing cache journal to disk:" << m_file.fileName();
+    }
+}
+
+void CacheJournal::compact()
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    QString fileName = m_file.fileName();
+    int oldRecordCount = m_recordCount;
+    m_file.close();
+
+    if (writeJournal(fileName)) {
+        qCDebug(dcStorage) << "Compacted cache journal from" << oldRecordCount << "to" << m_recordCount << "records";
+    }
+
+    if (!m_file.open(QFile::ReadWrite)) {
+        qCWarning(dcStorage) << "Cannot reopen cache journal after compacting" << fileName << m_file.errorString();
+        return;
+    }
+    m_file.seek(m_file.size());
+}
+
+void CacheJournal::replay(const QByteArray &data)
+{
+    QDataStream stream(data);
+    stream.skipRawData(JOURNAL_HEADER_SIZE);
+
+    int validLength = JOURNAL_HEADER_SIZE;
+    while (!stream.atEnd()) {
+        quint8 kind;
+        quint8 operation;
+        qint32 updateSequenceNumber;
+        quint16 guidLength;
+        stream >> kind >> operation >> updateSequenceNumber >> guidLength;
+
+        QByteArray guid(guidLength, Qt::Uninitialized);
+        if (stream.status() != QDataStream::Ok || stream.readRawData(guid.data(), guidLength) != guidLength) {
+            break;
+        }
+
+        quint16 checksum;
+        stream >> checksum;
+        int recordLength = 8 + guidLength;
+        if (stream.status() != QDataStream::Ok
+                || checksum != qChecksum(data.constData() + validLength, recordLength)
+                || kind > KindTag) {
+            break;
+        }
+
+        if (operation == OperationSet) {
+            m_entries[kind].insert(QString::fromUtf8(guid), updateSequenceNumber);
+        } else {
+            m_entries[kind].remove(QString::fromUtf8(guid));
+        }
+        validLength += recordLength + 2;
+        m_recordCount++;
+    }
+
+    if (validLength < data.length()) {
+        // Most likely we've been killed while writing the last record. Drop the partial tail.
+        qCWarning(dcStorage) << "Cache journal contains" << data.length() - validLength << "invalid bytes at the end. Truncating.";
+        m_file.resize(validLength);
+    }
+}
+
+void CacheJournal::migrate(const QString &legacyFileName)
+{
+    QSettings legacyFile(legacyFileName, QSettings::IniFormat);
+
+    const QString groups[] = { "notes", "notebooks", "tags" };
+    for (int i = KindNote; i <= KindTag; i++) {
+        legacyFile.beginGroup(groups[i]);
+        foreach (const QString &key, legacyFile.childKeys()) {
+            m_entries[i].insert(key, legacyFile.value(key).toInt());
+        }
+        legacyFile.endGroup();
+    }
+}
+
+void CacheJournal::append(CacheJournal::Kind kind, CacheJournal::Operation operation, const QString &guid, qint32 updateSequenceNumber)
+{
+    if (!m_file.isOpen()) {
+        qCWarning(dcStorage) << "Cache journal not opened. Cannot write entry for" << guid;
+        return;
+    }
+
+    QByteArray data = record(kind, operation, guid, updateSequenceNumber);
+    if (m_file.write(data) != data.length()) {
+        qCWarning(dcStorage) << "Error writing to cache journal:" << m_file.errorString();
+    }
+    m_file.flush();
+    m_recordCount++;
+
+    if (m_recordCount > qMax(JOURNAL_MIN_COMPACT_RECORDS, liveEntryCount() * 2)) {
+        compact();
+    }
+}
+
+bool CacheJournal::writeJournal(const QString &fileName)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        qCWarning(dcStorage) << "Cannot write cache journal" << fileName << file.errorString();
+        return false;
+    }
+
+    QByteArray data = header();
+    int recordCount = 0;
+    for (int i = KindNote; i <= KindTag; i++) {
+        QHash<QString, qint32>::const_iterator it = m_entries[i].constBegin();
+        for (; it != m_entries[i].constEnd(); ++it) {
+            data.append(record((Kind)i, OperationSet, it.key(), it.value()));
+            recordCount++;
+        }
+    }
+    file.write(data);
+
+    if (!file.commit()) {
+        qCWarning(dcStorage) << "Error committing cache journal" << fileName << file.errorString();
+        return false;
+    }
+    m_recordCount = recordCount;
+    return true;
+}
+
+int CacheJournal::liveEntryCount() const
+{
+    return m_entries[KindNote].count() + m_entries[KindNotebook].count() + m_entries[KindTag].count();
+}
+
+QByteArray CacheJournal::header()
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << (quint32)JOURNAL_MAGIC << (quint16)JOURNAL_VERSION;
+    stream << qChecksum(data.constData(), data.length());
+    return data;
+}
+
+QByteArray CacheJournal::record(CacheJournal::Kind kind, CacheJournal::Operation operation, const QString &guid, qint32 updateSequenceNumber)
+{
+    QByteArray guidData = guid.toUtf8();
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << (quint8)kind << (quint8)operation << updateSequenceNumber << (quint16)guidData.length();
+    stream.writeRawData(guidData.constData(), guidData.length());
+    stream << qChecksum(data.constData(), data.length());
+    return data;
+}
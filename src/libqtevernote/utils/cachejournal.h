@@ -0,0 +1,90 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CACHEJOURNAL_H
+#define CACHEJOURNAL_H
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+// The CacheJournal keeps the list of cached notes, notebooks and tags together with
+// their update sequence numbers. It replaces the QSettings based notes.cache file.
+//
+// Changes are appended as small binary records to the end of the file, so writing
+// an entry costs one short write instead of rewriting the whole index. When opened,
+// the journal is replayed with a single sequential read. Once the amount of
+// superseded records exceeds the live ones, the journal is compacted into a new file.
+//
+// File layout (all integers big endian):
+// Header: quint32 magic, quint16 version, quint16 checksum (over magic and version)
+// Record: quint8 kind, quint8 operation, qint32 updateSequenceNumber,
+//         quint16 guid length, guid (utf8), quint16 checksum (over the record)
+class CacheJournal
+{
+public:
+    enum Kind {
+        KindNote,
+        KindNotebook,
+        KindTag
+    };
+
+    CacheJournal();
+    ~CacheJournal();
+
+    // Opens and replays the journal. If there is no journal at fileName yet, but a
+    // legacy notes.cache file exists at legacyFileName, its entries are migrated into
+    // a new journal and the legacy file is removed.
+    bool open(const QString &fileName, const QString &legacyFileName = QString());
+    void close();
+
+    QHash<QString, qint32> entries(Kind kind) const;
+
+    void setEntry(Kind kind, const QString &guid, qint32 updateSequenceNumber);
+    void removeEntry(Kind kind, const QString &guid);
+
+    // Makes sure everything written so far has hit the disk
+    void sync();
+
+    // Rewrites the journal with only the live entries.
+    void compact();
+
+private:
+    enum Operation {
+        OperationSet,
+        OperationRemove
+    };
+
+    void replay(const QByteArray &data);
+    void migrate(const QString &legacyFileName);
+    void append(Kind kind, Operation operation, const QString &guid, qint32 updateSequenceNumber);
+    bool writeJournal(const QString &fileName);
+    int liveEntryCount() const;
+
+    static QByteArray header();
+    static QByteArray record(Kind kind, Operation operation, const QString &guid, qint32 updateSequenceNumber);
+
+private:
+    QFile m_file;
+    QHash<QString, qint32> m_entries[3];
+
+    // Number of records in the file. Anything above liveEntryCount() is garbage.
+    int m_recordCount;
+};
+
+#endif // CACHEJOURNAL_H
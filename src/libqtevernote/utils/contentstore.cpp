@@ -0,0 +1,672 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "contentstore.h"
+#include "logging.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMap>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define PACK_MAGIC 0x524e4350 // "RNCP"
+#define PACK_VERSION 1
+#define PACK_HEADER_SIZE 16
+
+#define RECORD_MAGIC 0x524e4352 // "RNCR"
+#define RECORD_HEADER_SIZE 16
+
+#define RECORD_FLAG_REMOVED 0x1
+#define RECORD_FLAG_COMPRESSED 0x2
+
+// Don't bother compacting small packs
+#define PACK_MIN_COMPACT_BYTES (1024 * 1024)
+
+// Train the dictionary once we have this many notes. It is trained from at most
+// DICTIONARY_SAMPLE_BYTES of content and zlib can't make use of more than 32k of it.
+#define DICTIONARY_MIN_NOTES 32
+#define DICTIONARY_SAMPLE_BYTES (2 * 1024 * 1024)
+#define DICTIONARY_MAX_SIZE (32 * 1024)
+#define DICTIONARY_MAX_TOKEN_SIZE 256
+
+ContentStore::ContentStore(QObject *parent):
+    QObject(parent),
+    m_map(nullptr),
+    m_mapSize(0),
+    m_deadBytes(0),
+    m_compactor(nullptr),
+    m_dictionaryEnabled(false),
+    m_dictionaryId(0)
+{
+}
+
+ContentStore::~ContentStore()
+{
+    close();
+}
+
+bool ContentStore::open(const QString &fileName, const QString &legacyDirectory)
+{
+    close();
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    // We might have been killed while replacing the pack with a compacted one
+    QString compactFileName = fileName + ".compact";
+    if (QFile::exists(compactFileName)) {
+        if (!QFile::exists(fileName)) {
+            QFile::rename(compactFileName, fileName);
+        } else {
+            QFile::remove(compactFileName);
+        }
+    }
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::ReadWrite)) {
+        qCWarning(dcStorage) << "Cannot open content store" << fileName << m_file.errorString();
+        return false;
+    }
+
+    if (m_file.size() < PACK_HEADER_SIZE || m_file.read(PACK_HEADER_SIZE) != header()) {
+        if (m_file.size() > 0) {
+            qCWarning(dcStorage) << "Content store header invalid. Discarding content store" << fileName;
+        }
+        m_file.resize(0);
+        m_file.seek(0);
+        m_file.write(header());
+        m_file.flush();
+    } else {
+        scan();
+    }
+
+    m_dictionaryFileName = fileName + ".dict";
+    loadDictionary();
+
+    if (!legacyDirectory.isEmpty()) {
+        migrate(legacyDirectory);
+    }
+
+    if (m_entries.count() >= DICTIONARY_MIN_NOTES) {
+        trainDictionary();
+    }
+
+    qCDebug(dcStorage) << "Opened content store" << fileName << "with" << m_entries.count() << "notes," << m_deadBytes << "of" << m_file.size() << "bytes unused";
+    compactIfNeeded();
+    return true;
+}
+
+void ContentStore::close()
+{
+    if (m_compactor) {
+        m_compactor->disconnect(this);
+        m_compactor->wait();
+        QFile::remove(m_compactor->targetFileName());
+        delete m_compactor;
+        m_compactor = nullptr;
+    }
+    unmap();
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_entries.clear();
+    m_deadBytes = 0;
+    m_dictionary.clear();
+    m_dictionaryId = 0;
+}
+
+bool ContentStore::contains(const QString &guid) const
+{
+    return m_entries.contains(guid);
+}
+
+QStringList ContentStore::guids() const
+{
+    return m_entries.keys();
+}
+
+QByteArray ContentStore::read(const QString &guid)
+{
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind(guid);
+    if (it == m_entries.constEnd()) {
+        return QByteArray();
+    }
+
+    const Entry &entry = it.value();
+    if (!ensureMapped(entry.offset + recordSize(guid, entry.length))) {
+        return QByteArray();
+    }
+
+    const uchar *record = m_map + entry.offset;
+    quint16 guidLength = qFromLittleEndian<quint16>(record + 10);
+    const char *data = (const char*)record + RECORD_HEADER_SIZE;
+    quint16 checksum = qChecksum(data, guidLength + entry.length);
+    if (checksum != qFromLittleEndian<quint16>(record + 12)) {
+        qCWarning(dcStorage) << "Checksum mismatch in content store for note" << guid;
+        return QByteArray();
+    }
+    if (entry.flags & RECORD_FLAG_COMPRESSED) {
+        return uncompress(QByteArray::fromRawData(data + guidLength, entry.length));
+    }
+    return QByteArray(data + guidLength, entry.length);
+}
+
+void ContentStore::write(const QString &guid, const QByteArray &content)
+{
+    Entry entry;
+    QByteArray compressed = compress(content);
+    bool success;
+    if (!compressed.isEmpty() && compressed.length() < content.length()) {
+        success = append(guid, compressed, RECORD_FLAG_COMPRESSED, &entry);
+    } else {
+        success = append(guid, content, 0, &entry);
+    }
+    if (!success) {
+        return;
+    }
+
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind(guid);
+    if (it != m_entries.constEnd()) {
+        m_deadBytes += recordSize(guid, it.value().length);
+    }
+    m_entries.insert(guid, entry);
+
+    if (m_dictionary.isEmpty() && m_entries.count() == DICTIONARY_MIN_NOTES) {
+        trainDictionary();
+    }
+    compactIfNeeded();
+}
+
+void ContentStore::remove(const QString &guid)
+{
+    QHash<QString, Entry>::iterator it = m_entries.find(guid);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    Entry entry;
+    if (!append(guid, QByteArray(), RECORD_FLAG_REMOVED, &entry)) {
+        return;
+    }
+    m_deadBytes += recordSize(guid, it.value().length) + recordSize(guid, 0);
+    m_entries.erase(it);
+
+    compactIfNeeded();
+}
+
+void ContentStore::sync()
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+    m_file.flush();
+    if (fsync(m_file.handle()) != 0) {
+        qCWarning(dcStorage) << "Error syncing content store to disk:" << m_file.fileName();
+    }
+}
+
+void ContentStore::compact()
+{
+    if (!m_file.isOpen() || m_compactor) {
+        return;
+    }
+
+    m_file.flush();
+
+    QList<qint64> offsets;
+    foreach (const Entry &entry, m_entries) {
+        offsets.append(entry.offset);
+    }
+    std::sort(offsets.begin(), offsets.end());
+
+    m_compactor = new ContentStoreCompactor(m_file.fileName(), m_file.fileName() + ".compact", m_file.size(), offsets);
+    connect(m_compactor, &QThread::finished, this, &ContentStore::compactionFinished);
+    m_compactor->start(QThread::LowPriority);
+}
+
+bool ContentStore::dictionaryEnabled() const
+{
+    return m_dictionaryEnabled;
+}
+
+void ContentStore::setDictionaryEnabled(bool enabled)
+{
+    m_dictionaryEnabled = enabled;
+    if (m_dictionaryEnabled && m_entries.count() >= DICTIONARY_MIN_NOTES) {
+        trainDictionary();
+    }
+}
+
+void ContentStore::trainDictionary()
+{
+    if (!m_dictionaryEnabled || !m_file.isOpen() || !m_dictionary.isEmpty()) {
+        return;
+    }
+
+    // Collect the markup used in this account's notes. Tags including their attributes
+    // (mostly styles) make up the bulk of repeated content in ENML.
+    QHash<QByteArray, int> tokenCounts;
+    qint64 sampledBytes = 0;
+    foreach (const QString &guid, m_entries.keys()) {
+        QByteArray content = read(guid);
+        int start = content.indexOf('<');
+        while (start >= 0) {
+            int end = content.indexOf('>', start);
+            if (end < 0) {
+                break;
+            }
+            if (end - start < DICTIONARY_MAX_TOKEN_SIZE) {
+                tokenCounts[content.mid(start, end - start + 1)]++;
+            }
+            start = content.indexOf('<', end);
+        }
+        sampledBytes += content.length();
+        if (sampledBytes > DICTIONARY_SAMPLE_BYTES) {
+            break;
+        }
+    }
+
+    // Rank tokens by the amount of bytes they'd save
+    QMultiMap<qint64, QByteArray> rankedTokens;
+    QHash<QByteArray, int>::const_iterator it = tokenCounts.constBegin();
+    for (; it != tokenCounts.constEnd(); ++it) {
+        if (it.value() > 1) {
+            rankedTokens.insert((qint64)it.value() * it.key().length(), it.key());
+        }
+    }
+
+    // zlib prefers the most common strings at the end of the dictionary
+    QList<QByteArray> tokens;
+    int size = 0;
+    QMapIterator<qint64, QByteArray> rankedIt(rankedTokens);
+    rankedIt.toBack();
+    while (rankedIt.hasPrevious()) {
+        rankedIt.previous();
+        if (size + rankedIt.value().length() > DICTIONARY_MAX_SIZE) {
+            break;
+        }
+        tokens.prepend(rankedIt.value());
+        size += rankedIt.value().length();
+    }
+    QByteArray dictionary;
+    foreach (const QByteArray &token, tokens) {
+        dictionary.append(token);
+    }
+    if (dictionary.isEmpty()) {
+        qCDebug(dcStorage) << "Not enough content to train a compression dictionary";
+        return;
+    }
+
+    QSaveFile file(m_dictionaryFileName);
+    if (!file.open(QFile::WriteOnly)) {
+        qCWarning(dcStorage) << "Cannot write compression dictionary" << m_dictionaryFileName << file.errorString();
+        return;
+    }
+    file.write(dictionary);
+    if (!file.commit()) {
+        qCWarning(dcStorage) << "Error committing compression dictionary" << m_dictionaryFileName << file.errorString();
+        return;
+    }
+
+    qCDebug(dcStorage) << "Trained compression dictionary of" << dictionary.length() << "bytes from" << sampledBytes << "bytes of content";
+    loadDictionary();
+}
+
+void ContentStore::compactionFinished()
+{
+    ContentStoreCompactor *compactor = m_compactor;
+    m_compactor = nullptr;
+    compactor->deleteLater();
+
+    QString fileName = m_file.fileName();
+    QFile target(compactor->targetFileName());
+    if (!compactor->success() || !target.open(QFile::WriteOnly | QFile::Append)) {
+        qCWarning(dcStorage) << "Compacting content store failed.";
+        QFile::remove(target.fileName());
+        return;
+    }
+
+    // Carry over everything that has been appended while the compactor was running
+    m_file.flush();
+    qint64 tailSize = m_file.size() - compactor->snapshotSize();
+    if (tailSize > 0) {
+        if (!ensureMapped(m_file.size())) {
+            QFile::remove(target.fileName());
+            return;
+        }
+        target.write((const char*)m_map + compactor->snapshotSize(), tailSize);
+    }
+    if (!target.flush()) {
+        qCWarning(dcStorage) << "Error writing compacted content store:" << target.errorString();
+        target.close();
+        QFile::remove(target.fileName());
+        return;
+    }
+    target.close();
+
+    qint64 oldSize = m_file.size();
+    unmap();
+    m_file.close();
+    QFile::remove(fileName);
+    if (!QFile::rename(target.fileName(), fileName)) {
+        qCWarning(dcStorage) << "Cannot move compacted content store into place:" << target.fileName();
+    }
+
+    m_entries.clear();
+    m_deadBytes = 0;
+    if (!m_file.open(QFile::ReadWrite)) {
+        qCWarning(dcStorage) << "Cannot reopen content store after compacting" << fileName << m_file.errorString();
+        return;
+    }
+    scan();
+    qCDebug(dcStorage) << "Compacted content store from" << oldSize << "to" << m_file.size() << "bytes";
+}
+
+void ContentStore::scan()
+{
+    qint64 size = m_file.size();
+    if (!ensureMapped(size)) {
+        return;
+    }
+
+    qint64 offset = PACK_HEADER_SIZE;
+    while (offset + RECORD_HEADER_SIZE <= size) {
+        const uchar *record = m_map + offset;
+        quint32 length = qFromLittleEndian<quint32>(record + 4);
+        quint16 guidLength = qFromLittleEndian<quint16>(record + 10);
+        qint64 totalSize = RECORD_HEADER_SIZE + guidLength + (qint64)length;
+        if (qFromLittleEndian<quint32>(record) != RECORD_MAGIC || offset + totalSize > size) {
+            break;
+        }
+
+        Entry entry;
+        entry.offset = offset;
+        entry.length = length;
+        entry.flags = qFromLittleEndian<quint16>(record + 8);
+        QString guid = QString::fromUtf8((const char*)record + RECORD_HEADER_SIZE, guidLength);
+
+        QHash<QString, Entry>::const_iterator it = m_entries.constFind(guid);
+        if (it != m_entries.constEnd()) {
+            m_deadBytes += recordSize(guid, it.value().length);
+        }
+        if (entry.flags & RECORD_FLAG_REMOVED) {
+            m_entries.remove(guid);
+            m_deadBytes += totalSize;
+        } else {
+            m_entries.insert(guid, entry);
+        }
+        offset += totalSize;
+    }
+
+    if (offset < size) {
+        // Most likely we've been killed while appending the last record. Drop the partial tail.
+        qCWarning(dcStorage) << "Content store contains" << size - offset << "invalid bytes at the end. Truncating.";
+        unmap();
+        m_file.resize(offset);
+    }
+}
+
+void ContentStore::migrate(const QString &legacyDirectory)
+{
+    QDir dir(legacyDirectory);
+    QStringList legacyFiles = dir.entryList({"note-*.enml"}, QDir::Files);
+    if (legacyFiles.isEmpty()) {
+        return;
+    }
+
+    foreach (const QString &legacyFileName, legacyFiles) {
+        QString guid = legacyFileName.mid(5, legacyFileName.length() - 10);
+        QFile legacyFile(dir.absoluteFilePath(legacyFileName));
+        if (!m_entries.contains(guid) && legacyFile.open(QFile::ReadOnly)) {
+            write(guid, legacyFile.readAll());
+            legacyFile.close();
+        }
+        legacyFile.remove();
+    }
+    qCDebug(dcStorage) << "Migrated" << legacyFiles.count() << "note content files into the content store";
+}
+
+bool ContentStore::append(const QString &guid, const QByteArray &body, quint16 flags, ContentStore::Entry *entry)
+{
+    if (!m_file.isOpen()) {
+        qCWarning(dcStorage) << "Content store not opened. Cannot write content for" << guid;
+        return false;
+    }
+
+    QByteArray guidData = guid.toUtf8();
+    QByteArray data(RECORD_HEADER_SIZE, '\0');
+    data.append(guidData);
+    data.append(body);
+
+    uchar *record = (uchar*)data.data();
+    qToLittleEndian<quint32>(RECORD_MAGIC, record);
+    qToLittleEndian<quint32>(body.length(), record + 4);
+    qToLittleEndian<quint16>(flags, record + 8);
+    qToLittleEndian<quint16>(guidData.length(), record + 10);
+    qToLittleEndian<quint16>(qChecksum(data.constData() + RECORD_HEADER_SIZE, guidData.length() + body.length()), record + 12);
+
+    entry->offset = m_file.size();
+    entry->length = body.length();
+    entry->flags = flags;
+
+    m_file.seek(entry->offset);
+    if (m_file.write(data) != data.length() || !m_file.flush()) {
+        qCWarning(dcStorage) << "Error writing to content store:" << m_file.errorString();
+        unmap();
+        m_file.resize(entry->offset);
+        return false;
+    }
+    return true;
+}
+
+bool ContentStore::ensureMapped(qint64 size)
+{
+    if (m_map && m_mapSize >= size) {
+        return true;
+    }
+
+    // The pack has grown since we've mapped it
+    unmap();
+    m_mapSize = m_file.size();
+    m_map = m_file.map(0, m_mapSize);
+    if (!m_map) {
+        qCWarning(dcStorage) << "Cannot map content store:" << m_file.errorString();
+        m_mapSize = 0;
+        return false;
+    }
+    return m_mapSize >= size;
+}
+
+void ContentStore::unmap()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+        m_mapSize = 0;
+    }
+}
+
+void ContentStore::compactIfNeeded()
+{
+    if (m_deadBytes > PACK_MIN_COMPACT_BYTES && m_deadBytes > m_file.size() / 2) {
+        compact();
+    }
+}
+
+void ContentStore::loadDictionary()
+{
+    m_dictionary.clear();
+    m_dictionaryId = 0;
+
+    QFile file(m_dictionaryFileName);
+    if (!file.exists()) {
+        return;
+    }
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(dcStorage) << "Cannot read compression dictionary" << m_dictionaryFileName << file.errorString();
+        return;
+    }
+    m_dictionary = file.readAll();
+    // This is how zlib identifies the dictionary a stream has been compressed with
+    m_dictionaryId = adler32(adler32(0L, Z_NULL, 0), (const Bytef*)m_dictionary.constData(), m_dictionary.length());
+}
+
+QByteArray ContentStore::compress(const QByteArray &data) const
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        qCWarning(dcStorage) << "Cannot initialize zlib for compression";
+        return QByteArray();
+    }
+    if (m_dictionaryEnabled && !m_dictionary.isEmpty()) {
+        deflateSetDictionary(&stream, (const Bytef*)m_dictionary.constData(), m_dictionary.length());
+    }
+
+    QByteArray compressed(4 + deflateBound(&stream, data.length()), Qt::Uninitialized);
+    qToLittleEndian<quint32>(data.length(), (uchar*)compressed.data());
+    stream.next_in = (Bytef*)data.constData();
+    stream.avail_in = data.length();
+    stream.next_out = (Bytef*)compressed.data() + 4;
+    stream.avail_out = compressed.length() - 4;
+
+    int ret = deflate(&stream, Z_FINISH);
+    compressed.resize(4 + stream.total_out);
+    deflateEnd(&stream);
+    if (ret != Z_STREAM_END) {
+        qCWarning(dcStorage) << "Error compressing note content:" << ret;
+        return QByteArray();
+    }
+    return compressed;
+}
+
+QByteArray ContentStore::uncompress(const QByteArray &data) const
+{
+    if (data.length() < 4) {
+        return QByteArray();
+    }
+
+    quint32 length = qFromLittleEndian<quint32>((const uchar*)data.constData());
+    QByteArray uncompressed(length, Qt::Uninitialized);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        qCWarning(dcStorage) << "Cannot initialize zlib for decompression";
+        return QByteArray();
+    }
+    stream.next_in = (Bytef*)data.constData() + 4;
+    stream.avail_in = data.length() - 4;
+    stream.next_out = (Bytef*)uncompressed.data();
+    stream.avail_out = length;
+
+    int ret = inflate(&stream, Z_FINISH);
+    if (ret == Z_NEED_DICT) {
+        if (m_dictionary.isEmpty() || stream.adler != m_dictionaryId) {
+            qCWarning(dcStorage) << "Note content has been compressed with an unknown dictionary";
+            inflateEnd(&stream);
+            return QByteArray();
+        }
+        inflateSetDictionary(&stream, (const Bytef*)m_dictionary.constData(), m_dictionary.length());
+        ret = inflate(&stream, Z_FINISH);
+    }
+    uLong total = stream.total_out;
+    inflateEnd(&stream);
+    if (ret != Z_STREAM_END || total != length) {
+        qCWarning(dcStorage) << "Error decompressing note content:" << ret;
+        return QByteArray();
+    }
+    return uncompressed;
+}
+
+QByteArray ContentStore::header()
+{
+    QByteArray data(PACK_HEADER_SIZE, '\0');
+    uchar *header = (uchar*)data.data();
+    qToLittleEndian<quint32>(PACK_MAGIC, header);
+    qToLittleEndian<quint16>(PACK_VERSION, header + 4);
+    qToLittleEndian<quint16>(qChecksum(data.constData(), 6), header + 6);
+    return data;
+}
+
+int ContentStore::recordSize(const QString &guid, quint32 length)
+{
+    return RECORD_HEADER_SIZE + guid.toUtf8().length() + length;
+}
+
+ContentStoreCompactor::ContentStoreCompactor(const QString &fileName, const QString &targetFileName, qint64 snapshotSize, const QList<qint64> &offsets, QObject *parent):
+    QThread(parent),
+    m_fileName(fileName),
+    m_targetFileName(targetFileName),
+    m_snapshotSize(snapshotSize),
+    m_offsets(offsets),
+    m_success(false)
+{
+}
+
+QString ContentStoreCompactor::targetFileName() const
+{
+    return m_targetFileName;
+}
+
+qint64 ContentStoreCompactor::snapshotSize() const
+{
+    return m_snapshotSize;
+}
+
+bool ContentStoreCompactor::success() const
+{
+    return m_success;
+}
+
+void ContentStoreCompactor::run()
+{
+    QFile source(m_fileName);
+    if (!source.open(QFile::ReadOnly)) {
+        qCWarning(dcStorage) << "Cannot open content store for compacting:" << source.errorString();
+        return;
+    }
+    const uchar *map = source.map(0, m_snapshotSize);
+    if (!map) {
+        qCWarning(dcStorage) << "Cannot map content store for compacting:" << source.errorString();
+        return;
+    }
+
+    QFile target(m_targetFileName);
+    if (!target.open(QFile::WriteOnly | QFile::Truncate)) {
+        qCWarning(dcStorage) << "Cannot create compacted content store:" << target.errorString();
+        return;
+    }
+
+    target.write((const char*)map, PACK_HEADER_SIZE);
+    foreach (qint64 offset, m_offsets) {
+        const uchar *record = map + offset;
+        qint64 totalSize = RECORD_HEADER_SIZE + qFromLittleEndian<quint16>(record + 10) + (qint64)qFromLittleEndian<quint32>(record + 4);
+        if (offset + totalSize > m_snapshotSize || target.write((const char*)record, totalSize) != totalSize) {
+            qCWarning(dcStorage) << "Error compacting content store at offset" << offset;
+            return;
+        }
+    }
+
+    m_success = target.flush();
+}
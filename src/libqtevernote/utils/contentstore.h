@@ -0,0 +1,150 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONTENTSTORE_H
+#define CONTENTSTORE_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QStringList>
+#include <QThread>
+
+class ContentStoreCompactor;
+
+// The ContentStore keeps the ENML content of all cached notes in a single pack file.
+// It replaces the note-<guid>.enml files we had before, one per note.
+//
+// Content is only ever appended to the pack. Each record carries the note's guid, so
+// the offset index is rebuilt on startup by walking the record headers. The pack is
+// read through a memory mapping, which means note bodies are only paged in once they
+// are actually read. Replaced and removed content is left behind in the pack until
+// it makes up more than half of it. At that point the live records are copied into
+// a new pack in a background thread.
+//
+// Content is stored zlib compressed. ENML is very repetitive, so if enabled with
+// setDictionaryEnabled(), once an account has enough notes cached, a preset dictionary
+// made of its most common markup is trained and saved next to the pack. Content written
+// afterwards is compressed against that dictionary. Otherwise, and before there is a
+// dictionary, it's plain zlib. The dictionary never changes once trained, and is loaded
+// even when disabled, so older records stay readable.
+//
+// File layout (all integers little endian):
+// Header: quint32 magic, quint16 version, quint16 checksum (over magic and version),
+//         8 reserved bytes
+// Record: quint32 magic, quint32 body length, quint16 flags, quint16 guid length,
+//         quint16 checksum (over guid and body), 2 reserved bytes, guid (utf8), body
+// Compressed body: quint32 uncompressed length, zlib stream
+class ContentStore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ContentStore(QObject *parent = 0);
+    ~ContentStore();
+
+    // Opens the pack. If legacyDirectory is given, any note-<guid>.enml files in
+    // there are moved into the pack.
+    bool open(const QString &fileName, const QString &legacyDirectory = QString());
+    void close();
+
+    bool contains(const QString &guid) const;
+    QStringList guids() const;
+    QByteArray read(const QString &guid);
+
+    void write(const QString &guid, const QByteArray &content);
+    void remove(const QString &guid);
+
+    // Makes sure everything written so far has hit the disk
+    void sync();
+
+    // Starts compacting the pack in the background
+    void compact();
+
+    // Off by default. When enabled, a dictionary is trained as soon as there is enough
+    // content, and content is compressed against it.
+    bool dictionaryEnabled() const;
+    void setDictionaryEnabled(bool enabled);
+
+    // Builds the preset compression dictionary from the content cached so far.
+    // Does nothing if there already is one or it isn't enabled.
+    void trainDictionary();
+
+private slots:
+    void compactionFinished();
+
+private:
+    struct Entry {
+        qint64 offset; // offset of the record header
+        quint32 length; // length of the body
+        quint16 flags;
+    };
+
+    void scan();
+    void migrate(const QString &legacyDirectory);
+    bool append(const QString &guid, const QByteArray &body, quint16 flags, Entry *entry);
+    bool ensureMapped(qint64 size);
+    void unmap();
+    void compactIfNeeded();
+
+    void loadDictionary();
+    QByteArray compress(const QByteArray &data) const;
+    QByteArray uncompress(const QByteArray &data) const;
+
+    static QByteArray header();
+    static int recordSize(const QString &guid, quint32 length);
+
+private:
+    QFile m_file;
+    uchar *m_map;
+    qint64 m_mapSize;
+    QHash<QString, Entry> m_entries;
+    qint64 m_deadBytes;
+    ContentStoreCompactor *m_compactor;
+
+    bool m_dictionaryEnabled;
+    QString m_dictionaryFileName;
+    QByteArray m_dictionary;
+    quint32 m_dictionaryId;
+
+    friend class ContentStoreCompactor;
+};
+
+// Copies the live records of a pack into a new file. It works on a snapshot of the
+// index and only reads the part of the pack that existed when it was started, so
+// the ContentStore can keep appending to the pack in the meantime.
+class ContentStoreCompactor : public QThread
+{
+    Q_OBJECT
+public:
+    ContentStoreCompactor(const QString &fileName, const QString &targetFileName, qint64 snapshotSize, const QList<qint64> &offsets, QObject *parent = 0);
+
+    QString targetFileName() const;
+    qint64 snapshotSize() const;
+    bool success() const;
+
+    void run() override;
+
+private:
+    QString m_fileName;
+    QString m_targetFileName;
+    qint64 m_snapshotSize;
+    QList<qint64> m_offsets;
+    bool m_success;
+};
+
+#endif // CONTENTSTORE_H
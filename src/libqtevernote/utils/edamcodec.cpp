@@ -0,0 +1,101 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "edamcodec.h"
+#include "logging.h"
+
+// Thrift
+#include <arpa/inet.h> // seems thrift forgot this one
+#include <protocol/TCompactProtocol.h>
+#include <transport/TBufferTransports.h>
+#include <Thrift.h>
+
+using namespace apache::thrift;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+
+template <typename T>
+static QByteArray encodeStruct(const T &value)
+{
+    boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+    TCompactProtocol protocol(buffer);
+    value.write(&protocol);
+    uint8_t *data;
+    uint32_t length;
+    buffer->getBuffer(&data, &length);
+    return QByteArray((const char*)data, length);
+}
+
+template <typename T>
+static bool decodeStruct(const QByteArray &data, T *value)
+{
+    try {
+        boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer((uint8_t*)data.constData(), data.length()));
+        TCompactProtocol protocol(buffer);
+        value->read(&protocol);
+    } catch (const TException &e) {
+        qCWarning(dcStorage) << "Error deserializing cached Evernote data:" << e.what();
+        return false;
+    }
+    return true;
+}
+
+static void clearBody(evernote::edam::Data *data)
+{
+    data->body.clear();
+    data->__isset.body = false;
+}
+
+QByteArray EdamCodec::encode(const evernote::edam::Note &note)
+{
+    evernote::edam::Note metadata = note;
+    metadata.content.clear();
+    metadata.__isset.content = false;
+    for (unsigned int i = 0; i < metadata.resources.size(); i++) {
+        evernote::edam::Resource &resource = metadata.resources.at(i);
+        clearBody(&resource.data);
+        clearBody(&resource.recognition);
+        clearBody(&resource.alternateData);
+    }
+    return encodeStruct(metadata);
+}
+
+QByteArray EdamCodec::encode(const evernote::edam::Notebook &notebook)
+{
+    return encodeStruct(notebook);
+}
+
+QByteArray EdamCodec::encode(const evernote::edam::Tag &tag)
+{
+    return encodeStruct(tag);
+}
+
+bool EdamCodec::decode(const QByteArray &data, evernote::edam::Note *note)
+{
+    return decodeStruct(data, note);
+}
+
+bool EdamCodec::decode(const QByteArray &data, evernote::edam::Notebook *notebook)
+{
+    return decodeStruct(data, notebook);
+}
+
+bool EdamCodec::decode(const QByteArray &data, evernote::edam::Tag *tag)
+{
+    return decodeStruct(data, tag);
+}
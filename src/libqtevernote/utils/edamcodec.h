@@ -0,0 +1,43 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EDAMCODEC_H
+#define EDAMCODEC_H
+
+#include <QByteArray>
+
+// Evernote SDK
+#include <Types_types.h>
+
+// Serializes Evernote's structs with thrift's compact protocol. This is how the cache
+// stores notes, notebooks and tags: as the structs the server sent us, so that fields we
+// don't know about are kept as they are.
+class EdamCodec
+{
+public:
+    // The content and the resource bodies are left out, they're cached on their own
+    static QByteArray encode(const evernote::edam::Note &note);
+    static QByteArray encode(const evernote::edam::Notebook &notebook);
+    static QByteArray encode(const evernote::edam::Tag &tag);
+
+    static bool decode(const QByteArray &data, evernote::edam::Note *note);
+    static bool decode(const QByteArray &data, evernote::edam::Notebook *notebook);
+    static bool decode(const QByteArray &data, evernote::edam::Tag *tag);
+};
+
+#endif // EDAMCODEC_H
@@ -0,0 +1,137 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "edamtable.h"
+#include "logging.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#define TABLE_MAGIC 0x524e4554 // "RNET"
+#define TABLE_VERSION 1
+
+EdamRecord::EdamRecord():
+    lastSyncedSequenceNumber(0),
+    deleted(false)
+{
+}
+
+EdamTable::EdamTable():
+    m_dirty(false)
+{
+}
+
+bool EdamTable::open(const QString &fileName)
+{
+    close();
+    m_fileName = fileName;
+
+    QFile file(fileName);
+    if (!file.exists()) {
+        return true;
+    }
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(dcStorage) << "Cannot open" << fileName << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    quint16 version;
+    quint32 count;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != TABLE_MAGIC || version != TABLE_VERSION) {
+        qCWarning(dcStorage) << "Invalid header in" << fileName << "Discarding it.";
+        return false;
+    }
+    for (quint32 i = 0; i < count; i++) {
+        EdamRecord record;
+        stream >> record.guid >> record.edam >> record.lastSyncedSequenceNumber >> record.deleted;
+        if (stream.status() != QDataStream::Ok) {
+            qCWarning(dcStorage) << "Error reading" << fileName << "after" << i << "records";
+            break;
+        }
+        m_records.insert(record.guid, record);
+    }
+    return true;
+}
+
+void EdamTable::close()
+{
+    sync();
+    m_fileName.clear();
+    m_records.clear();
+    m_dirty = false;
+}
+
+bool EdamTable::contains(const QString &guid) const
+{
+    return m_records.contains(guid);
+}
+
+EdamRecord EdamTable::record(const QString &guid) const
+{
+    return m_records.value(guid);
+}
+
+QStringList EdamTable::guids() const
+{
+    return m_records.keys();
+}
+
+void EdamTable::write(const EdamRecord &record)
+{
+    m_records.insert(record.guid, record);
+    m_dirty = true;
+}
+
+void EdamTable::remove(const QString &guid)
+{
+    if (m_records.remove(guid) > 0) {
+        m_dirty = true;
+    }
+}
+
+void EdamTable::sync()
+{
+    if (!m_dirty || m_fileName.isEmpty()) {
+        return;
+    }
+
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+    QSaveFile file(m_fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        qCWarning(dcStorage) << "Cannot write" << m_fileName << file.errorString();
+        return;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << (quint32)TABLE_MAGIC << (quint16)TABLE_VERSION << (quint32)m_records.count();
+    foreach (const EdamRecord &record, m_records) {
+        stream << record.guid << record.edam << record.lastSyncedSequenceNumber << record.deleted;
+    }
+    if (stream.status() != QDataStream::Ok || !file.commit()) {
+        qCWarning(dcStorage) << "Error writing" << m_fileName << file.errorString();
+        return;
+    }
+    m_dirty = false;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EDAMTABLE_H
+#define EDAMTABLE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+struct EdamRecord
+{
+    EdamRecord();
+
+    QString guid;
+    // The evernote::edam::Notebook or Tag, serialized by EdamCodec
+    QByteArray edam;
+    // What Evernote doesn't know about
+    qint32 lastSyncedSequenceNumber;
+    bool deleted;
+};
+
+// The EdamTable holds all notebooks or all tags in a single file, replacing the
+// notebook-<guid>.info and tag-<guid>.info files we had before. Like the notes in the
+// NoteInfoTable, they're stored as the structs the server sent us.
+//
+// There are only a few of them, so the table is kept in memory and sync() rewrites the
+// whole file if anything has changed.
+//
+// File layout (all integers big endian):
+// Header: quint32 magic, quint16 version, quint32 record count
+// Data:   the records, in QDataStream format
+class EdamTable
+{
+public:
+    EdamTable();
+
+    bool open(const QString &fileName);
+    void close();
+
+    bool contains(const QString &guid) const;
+    EdamRecord record(const QString &guid) const;
+    QStringList guids() const;
+
+    void write(const EdamRecord &record);
+    void remove(const QString &guid);
+
+    // Writes the table to disk if it has changed
+    void sync();
+
+private:
+    QString m_fileName;
+    QHash<QString, EdamRecord> m_records;
+    bool m_dirty;
+};
+
+#endif // EDAMTABLE_H
@@ -669,3 +669,17 @@ QString EnmlDocument::toPlaintext() const
 
     return plaintext;
 }
+
+QList<bool> EnmlDocument::todos() const
+{
+    QList<bool> todos;
+    QXmlStreamReader reader(m_enml);
+
+    while (!reader.atEnd() && !reader.hasError()) {
+        QXmlStreamReader::TokenType token = reader.readNext();
+        if (token == QXmlStreamReader::StartElement && reader.name() == "en-todo") {
+            todos.append(reader.attributes().value("checked") == "true");
+        }
+    }
+    return todos;
+}
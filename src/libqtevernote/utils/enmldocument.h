@@ -35,6 +35,8 @@ public:
     QString toHtml(const QString &noteGuid) const;
     QString toRichText(const QString &noteGuid) const;
     QString toPlaintext() const;
+    // Whether each todo checkbox is checked, in document order
+    QList<bool> todos() const;
 
     void setRichText(const QString &richText);
 
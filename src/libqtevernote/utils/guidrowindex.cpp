@@ -0,0 +1,81 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "guidrowindex.h"
+
+GuidRowIndex::GuidRowIndex():
+    m_firstMovedRow(0)
+{
+}
+
+void GuidRowIndex::clear()
+{
+    m_guids.clear();
+    m_rows.clear();
+    m_firstMovedRow = 0;
+}
+
+void GuidRowIndex::append(const QString &guid)
+{
+    m_rows.insert(guid, m_guids.count());
+    m_guids.append(guid);
+}
+
+void GuidRowIndex::setGuid(int row, const QString &guid)
+{
+    if (m_guids.at(row) == guid) {
+        return;
+    }
+    m_rows.remove(m_guids.at(row));
+    m_rows.insert(guid, row);
+    m_guids[row] = guid;
+}
+
+void GuidRowIndex::removeRow(int row)
+{
+    m_rows.remove(m_guids.at(row));
+    m_guids.remove(row);
+    m_firstMovedRow = qMin(m_firstMovedRow, row);
+}
+
+int GuidRowIndex::count() const
+{
+    return m_guids.count();
+}
+
+QString GuidRowIndex::guid(int row) const
+{
+    return m_guids.at(row);
+}
+
+int GuidRowIndex::row(const QString &guid) const
+{
+    QHash<QString, int>::const_iterator it = m_rows.constFind(guid);
+    if (it == m_rows.constEnd()) {
+        return -1;
+    }
+    if (it.value() < m_guids.count() && m_guids.at(it.value()) == guid) {
+        return it.value();
+    }
+
+    for (int i = m_firstMovedRow; i < m_guids.count(); i++) {
+        m_rows[m_guids.at(i)] = i;
+    }
+    m_firstMovedRow = m_guids.count();
+    return m_rows.value(guid, -1);
+}
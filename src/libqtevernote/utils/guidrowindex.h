@@ -0,0 +1,54 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GUIDROWINDEX_H
+#define GUIDROWINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// Finds the row of a note by its guid without going through all rows.
+//
+// Removing a row moves all rows after it up by one. Instead of renumbering them right
+// away, which would make removing many rows quadratic, the rows after the first removed
+// one are renumbered on the next lookup that finds a moved row.
+class GuidRowIndex
+{
+public:
+    GuidRowIndex();
+
+    void clear();
+    void append(const QString &guid);
+    void setGuid(int row, const QString &guid);
+    // Removes row and moves all rows after it up by one
+    void removeRow(int row);
+
+    int count() const;
+    QString guid(int row) const;
+    // Returns -1 if there's no such row
+    int row(const QString &guid) const;
+
+private:
+    QVector<QString> m_guids;
+    mutable QHash<QString, int> m_rows;
+    // Rows from this one on may have moved since they were put into m_rows
+    mutable int m_firstMovedRow;
+};
+
+#endif // GUIDROWINDEX_H
@@ -0,0 +1,304 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "noteattributeindex.h"
+
+#include <limits>
+
+#define NO_DATE std::numeric_limits<qint64>::min()
+// Done reminders sort after all open ones
+#define REMINDER_DONE_OFFSET Q_INT64_C(10000000000000)
+
+NoteAttributeIndex::Filter::Filter():
+    onlyReminders(false),
+    showDeleted(true)
+{
+}
+
+NoteAttributeIndex::Attributes::Attributes():
+    reminder(false),
+    deleted(false)
+{
+}
+
+NoteAttributeIndex::NoteAttributeIndex():
+    m_generation(0),
+    m_filterGeneration(0)
+{
+    m_collator.setCaseSensitivity(Qt::CaseInsensitive);
+    m_collator.setNumericMode(true);
+}
+
+void NoteAttributeIndex::clear()
+{
+    m_attributes.clear();
+    m_rows.clear();
+    m_notebooks.clear();
+    m_tags.clear();
+    m_resourceTypes.clear();
+    m_tagged = RowBitmap();
+    m_reminders = RowBitmap();
+    m_deleted = RowBitmap();
+    for (int i = 0; i < DateCount; i++) {
+        m_dates[i].clear();
+    }
+    m_reminderOrders.clear();
+    m_titleKeys.clear();
+    m_generation++;
+    m_filterGeneration++;
+}
+
+void NoteAttributeIndex::append(const Attributes &attributes)
+{
+    int row = m_attributes.count();
+    m_attributes.append(attributes);
+    m_rows.append(attributes.guid);
+    for (int i = 0; i < DateCount; i++) {
+        m_dates[i].append(NO_DATE);
+    }
+    m_reminderOrders.append(0);
+    m_titleKeys.push_back(m_collator.sortKey(attributes.title));
+    updateBitmaps(row, attributes, true);
+    m_generation++;
+    m_filterGeneration++;
+}
+
+void NoteAttributeIndex::setAttributes(int row, const Attributes &attributes)
+{
+    updateBitmaps(row, m_attributes.at(row), false);
+    m_rows.setGuid(row, attributes.guid);
+    const Attributes &previous = m_attributes.at(row);
+    if (previous.title != attributes.title) {
+        m_titleKeys[row] = m_collator.sortKey(attributes.title);
+    }
+    if (previous.notebookGuid != attributes.notebookGuid || previous.tagGuids != attributes.tagGuids
+            || previous.reminder != attributes.reminder || previous.deleted != attributes.deleted) {
+        m_filterGeneration++;
+    }
+    m_attributes[row] = attributes;
+    updateBitmaps(row, attributes, true);
+    m_generation++;
+}
+
+void NoteAttributeIndex::removeRow(int row)
+{
+    m_rows.removeRow(row);
+    m_attributes.remove(row);
+
+    removeBitmapRow(&m_notebooks, row);
+    removeBitmapRow(&m_tags, row);
+    removeBitmapRow(&m_resourceTypes, row);
+    m_tagged.removeRow(row);
+    m_reminders.removeRow(row);
+    m_deleted.removeRow(row);
+    for (int i = 0; i < DateCount; i++) {
+        m_dates[i].remove(row);
+    }
+    m_reminderOrders.remove(row);
+    m_titleKeys.erase(m_titleKeys.begin() + row);
+    m_generation++;
+    m_filterGeneration++;
+}
+
+int NoteAttributeIndex::count() const
+{
+    return m_attributes.count();
+}
+
+QString NoteAttributeIndex::guid(int row) const
+{
+    return m_attributes.at(row).guid;
+}
+
+int NoteAttributeIndex::row(const QString &guid) const
+{
+    return m_rows.row(guid);
+}
+
+quint64 NoteAttributeIndex::generation() const
+{
+    return m_generation;
+}
+
+quint64 NoteAttributeIndex::filterGeneration() const
+{
+    return m_filterGeneration;
+}
+
+qint64 NoteAttributeIndex::date(DateField field, int row) const
+{
+    return m_dates[field].at(row);
+}
+
+qint64 NoteAttributeIndex::reminderOrder(int row) const
+{
+    return m_reminderOrders.at(row);
+}
+
+int NoteAttributeIndex::compareTitles(int left, int right) const
+{
+    return m_titleKeys[left].compare(m_titleKeys[right]);
+}
+
+RowBitmap NoteAttributeIndex::all() const
+{
+    return RowBitmap::filled(m_attributes.count());
+}
+
+RowBitmap NoteAttributeIndex::notebook(const QString &notebookGuid) const
+{
+    return m_notebooks.value(notebookGuid);
+}
+
+RowBitmap NoteAttributeIndex::tag(const QString &tagGuid) const
+{
+    return m_tags.value(tagGuid);
+}
+
+RowBitmap NoteAttributeIndex::tagged() const
+{
+    return m_tagged;
+}
+
+QStringList NoteAttributeIndex::resourceTypes() const
+{
+    return m_resourceTypes.keys();
+}
+
+RowBitmap NoteAttributeIndex::resourceType(const QString &type) const
+{
+    return m_resourceTypes.value(type);
+}
+
+RowBitmap NoteAttributeIndex::reminders() const
+{
+    return m_reminders;
+}
+
+RowBitmap NoteAttributeIndex::deleted() const
+{
+    return m_deleted;
+}
+
+RowBitmap NoteAttributeIndex::dated(DateField field, const QDateTime &from) const
+{
+    qint64 start = from.isValid() ? from.toMSecsSinceEpoch() : NO_DATE + 1;
+    const QVector<qint64> &dates = m_dates[field];
+    RowBitmap result;
+    for (int row = 0; row < dates.count(); row++) {
+        if (dates.at(row) >= start) {
+            result.insert(row);
+        }
+    }
+    return result;
+}
+
+RowBitmap NoteAttributeIndex::rows(const QSet<QString> &guids) const
+{
+    RowBitmap result;
+    foreach (const QString &guid, guids) {
+        int row = m_rows.row(guid);
+        if (row >= 0) {
+            result.insert(row);
+        }
+    }
+    return result;
+}
+
+RowBitmap NoteAttributeIndex::filter(const Filter &filter) const
+{
+    RowBitmap result = all();
+    if (!filter.notebookGuid.isEmpty()) {
+        result &= notebook(filter.notebookGuid);
+    }
+    if (!filter.tagGuid.isEmpty()) {
+        result &= tag(filter.tagGuid);
+    }
+    if (filter.onlyReminders) {
+        result &= m_reminders;
+    }
+    if (!filter.showDeleted) {
+        result -= m_deleted;
+    }
+    return result;
+}
+
+void NoteAttributeIndex::updateBitmaps(int row, const Attributes &attributes, bool set)
+{
+    updateBitmap(&m_notebooks, attributes.notebookGuid, row, set);
+    foreach (const QString &tagGuid, attributes.tagGuids) {
+        updateBitmap(&m_tags, tagGuid, row, set);
+    }
+    foreach (const QString &type, attributes.resourceTypes) {
+        updateBitmap(&m_resourceTypes, type, row, set);
+    }
+    if (set && !attributes.tagGuids.isEmpty()) {
+        m_tagged.insert(row);
+    } else {
+        m_tagged.remove(row);
+    }
+    if (set && attributes.reminder) {
+        m_reminders.insert(row);
+    } else {
+        m_reminders.remove(row);
+    }
+    if (set && attributes.deleted) {
+        m_deleted.insert(row);
+    } else {
+        m_deleted.remove(row);
+    }
+    for (int i = 0; i < DateCount; i++) {
+        m_dates[i][row] = set && !attributes.dates[i].isNull() ? attributes.dates[i].toMSecsSinceEpoch() : NO_DATE;
+    }
+    qint64 reminderOrder = attributes.dates[DateReminderTime].isNull() ? 0 : attributes.dates[DateReminderTime].toMSecsSinceEpoch();
+    if (!attributes.dates[DateReminderDoneTime].isNull()) {
+        reminderOrder += REMINDER_DONE_OFFSET;
+    }
+    m_reminderOrders[row] = set ? reminderOrder : 0;
+}
+
+void NoteAttributeIndex::updateBitmap(QHash<QString, RowBitmap> *bitmaps, const QString &key, int row, bool set)
+{
+    if (key.isEmpty()) {
+        return;
+    }
+    if (set) {
+        (*bitmaps)[key].insert(row);
+        return;
+    }
+    QHash<QString, RowBitmap>::iterator it = bitmaps->find(key);
+    if (it != bitmaps->end()) {
+        it.value().remove(row);
+        if (it.value().isEmpty()) {
+            bitmaps->erase(it);
+        }
+    }
+}
+
+void NoteAttributeIndex::removeBitmapRow(QHash<QString, RowBitmap> *bitmaps, int row)
+{
+    QHash<QString, RowBitmap>::iterator it = bitmaps->begin();
+    while (it != bitmaps->end()) {
+        it.value().removeRow(row);
+        if (it.value().isEmpty()) {
+            it = bitmaps->erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NOTEATTRIBUTEINDEX_H
+#define NOTEATTRIBUTEINDEX_H
+
+#include "guidrowindex.h"
+#include "rowbitmap.h"
+
+#include <QCollator>
+#include <QDateTime>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <vector>
+
+// The NoteAttributeIndex answers questions like "which notes are in this notebook" for
+// all notes at once. It keeps a bitmap over the rows of the NotesStore for every
+// notebook, tag and resource type, for reminders and deleted notes, and the dates of
+// every row. Filtering the notes list or a search is then a few bitmap operations
+// instead of a look at each note.
+//
+// It also keeps what the notes list sorts by for every row, ready to compare: the dates
+// and reminder order as integers, and a collation key for the title.
+//
+// The NotesStore keeps it up to date as its rows change.
+class NoteAttributeIndex
+{
+public:
+    enum DateField {
+        DateCreated,
+        DateUpdated,
+        DateReminderTime,
+        DateReminderDoneTime,
+        DateCount
+    };
+
+    // What a list of notes shows. Empty guids mean any notebook or tag.
+    struct Filter {
+        Filter();
+
+        QString notebookGuid;
+        QString tagGuid;
+        bool onlyReminders;
+        bool showDeleted;
+    };
+
+    struct Attributes {
+        Attributes();
+
+        QString guid;
+        QString title;
+        QString notebookGuid;
+        QStringList tagGuids;
+        QStringList resourceTypes;
+        bool reminder;
+        bool deleted;
+        QDateTime dates[DateCount];
+    };
+
+    NoteAttributeIndex();
+
+    void clear();
+    void append(const Attributes &attributes);
+    void setAttributes(int row, const Attributes &attributes);
+    // Removes row and moves all rows after it up by one
+    void removeRow(int row);
+
+    int count() const;
+    QString guid(int row) const;
+    // Returns -1 if there's no such note
+    int row(const QString &guid) const;
+    // Changes with every change to the index, so bitmaps built from it can be reused
+    // until then
+    quint64 generation() const;
+    // Changes only when rows come or go or what filter() looks at changes. Editing a
+    // title or a date leaves it alone.
+    quint64 filterGeneration() const;
+
+    RowBitmap all() const;
+    RowBitmap notebook(const QString &notebookGuid) const;
+    RowBitmap tag(const QString &tagGuid) const;
+    // Notes with any tag
+    RowBitmap tagged() const;
+    QStringList resourceTypes() const;
+    RowBitmap resourceType(const QString &type) const;
+    RowBitmap reminders() const;
+    RowBitmap deleted() const;
+    // Notes having the date set at or after from, or at all if from is invalid
+    RowBitmap dated(DateField field, const QDateTime &from = QDateTime()) const;
+
+    // Milliseconds since the epoch, the smallest qint64 if not set
+    qint64 date(DateField field, int row) const;
+    // Open reminders by time, then done ones by time
+    qint64 reminderOrder(int row) const;
+    // Less than, equal to or greater than zero as the title of left sorts before, like or
+    // after the one of right
+    int compareTitles(int left, int right) const;
+
+    // Returns the rows for those of guids that are in the index
+    RowBitmap rows(const QSet<QString> &guids) const;
+    // Returns the rows passing filter
+    RowBitmap filter(const Filter &filter) const;
+
+private:
+    void updateBitmaps(int row, const Attributes &attributes, bool set);
+    static void updateBitmap(QHash<QString, RowBitmap> *bitmaps, const QString &key, int row, bool set);
+    static void removeBitmapRow(QHash<QString, RowBitmap> *bitmaps, int row);
+
+private:
+    QVector<Attributes> m_attributes;
+    GuidRowIndex m_rows;
+    quint64 m_generation;
+    quint64 m_filterGeneration;
+
+    QHash<QString, RowBitmap> m_notebooks;
+    QHash<QString, RowBitmap> m_tags;
+    QHash<QString, RowBitmap> m_resourceTypes;
+    RowBitmap m_tagged;
+    RowBitmap m_reminders;
+    RowBitmap m_deleted;
+    // Milliseconds since the epoch. Dates which aren't set are the smallest qint64.
+    QVector<qint64> m_dates[DateCount];
+    QVector<qint64> m_reminderOrders;
+    QCollator m_collator;
+    // QCollatorSortKey can't be default constructed, which QVector needs
+    std::vector<QCollatorSortKey> m_titleKeys;
+};
+
+#endif // NOTEATTRIBUTEINDEX_H
@@ -0,0 +1,591 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "noteinfotable.h"
+#include "edamcodec.h"
+#include "logging.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <limits>
+#include <string.h>
+#include <unistd.h>
+
+#define TABLE_MAGIC 0x524e4d54 // "RNMT"
+#define TABLE_VERSION 1
+#define TABLE_HEADER_SIZE 16
+
+// Slot header layout. All values are little endian.
+#define SLOT_CAPACITY 0             // quint32, size of the whole slot
+#define SLOT_PAYLOAD_LENGTH 4       // quint32
+#define SLOT_FLAGS 8                // quint16
+#define SLOT_CHECKSUM 10            // quint16, over everything from SLOT_GENERATION to the end of the payload
+#define SLOT_GENERATION 12          // quint32, the newest copy wins if a note is found twice
+#define SLOT_USN 16                 // qint32
+#define SLOT_LAST_SYNCED_USN 20     // qint32
+#define SLOT_CREATED 24             // qint64, msecs since epoch
+#define SLOT_UPDATED 32             // qint64
+#define SLOT_REMINDER_ORDER 40      // qint64
+#define SLOT_REMINDER_TIME 48       // qint64
+#define SLOT_REMINDER_DONE_TIME 56  // qint64
+#define SLOT_DELETED 64             // quint8
+#define SLOT_NEEDS_CONTENT_SYNC 65  // quint8
+#define SLOT_GUID_LENGTH 66         // quint16
+#define SLOT_GUID 68                // utf8, up to SLOT_GUID_MAX bytes
+#define SLOT_GUID_MAX 60
+#define SLOT_HEADER_SIZE 128
+
+#define SLOT_FLAG_USED 0x1
+// The payload holds a compact protocol serialized evernote::edam::Note
+#define SLOT_FLAG_EDAM 0x2
+
+// Slots are allocated in multiples of this, leaving some room to grow in place
+#define SLOT_ALIGNMENT 128
+
+// Compact the table when more than half of it, and at least this many bytes, are unused
+#define TABLE_MIN_COMPACT_BYTES (256 * 1024)
+
+static const qint64 s_nullDateTime = std::numeric_limits<qint64>::min();
+
+static qint64 encodeDateTime(const QDateTime &dateTime)
+{
+    return dateTime.isValid() ? dateTime.toMSecsSinceEpoch() : s_nullDateTime;
+}
+
+static QDateTime decodeDateTime(qint64 value)
+{
+    return value == s_nullDateTime ? QDateTime() : QDateTime::fromMSecsSinceEpoch(value);
+}
+
+NoteInfo::NoteInfo():
+    reminderOrder(0),
+    deleted(false),
+    needsContentSync(false),
+    updateSequenceNumber(0),
+    lastSyncedSequenceNumber(0)
+{
+}
+
+NoteInfoTable::NoteInfoTable():
+    m_freeBytes(0),
+    m_generation(0)
+{
+}
+
+NoteInfoTable::~NoteInfoTable()
+{
+    close();
+}
+
+bool NoteInfoTable::open(const QString &fileName)
+{
+    close();
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::ReadWrite)) {
+        qCWarning(dcStorage) << "Cannot open note info table" << fileName << m_file.errorString();
+        return false;
+    }
+
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << (quint32)TABLE_MAGIC << (quint16)TABLE_VERSION;
+    stream << qChecksum(header.constData(), header.length());
+    header.append(QByteArray(TABLE_HEADER_SIZE - header.length(), '\0'));
+
+    qint64 size = m_file.size();
+    uchar *data = size >= TABLE_HEADER_SIZE ? m_file.map(0, size) : nullptr;
+    if (!data || memcmp(data, header.constData(), TABLE_HEADER_SIZE) != 0) {
+        if (size > 0) {
+            qCWarning(dcStorage) << "Note info table header invalid. Discarding table" << fileName;
+        }
+        if (data) {
+            m_file.unmap(data);
+        }
+        m_file.resize(0);
+        m_file.seek(0);
+        m_file.write(header);
+        m_file.flush();
+        return true;
+    }
+
+    QHash<QString, quint32> generations;
+    qint64 offset = TABLE_HEADER_SIZE;
+    while (offset + SLOT_HEADER_SIZE <= size) {
+        const uchar *slotData = data + offset;
+        quint32 capacity = qFromLittleEndian<quint32>(slotData + SLOT_CAPACITY);
+        if (capacity < SLOT_HEADER_SIZE || offset + capacity > size) {
+            break;
+        }
+
+        Slot slot;
+        slot.offset = offset;
+        slot.capacity = capacity;
+        offset += capacity;
+
+        NoteInfo info;
+        quint32 generation;
+        if (!decode(slotData, capacity, &info, &generation)) {
+            m_freeSlots.insert(slot.capacity, slot.offset);
+            m_freeBytes += slot.capacity;
+            continue;
+        }
+
+        m_generation = qMax(m_generation, generation + 1);
+        if (m_slots.contains(info.guid)) {
+            // We've been interrupted while moving this note to a new slot. Keep the newer one.
+            if (generations.value(info.guid) > generation) {
+                m_freeSlots.insert(slot.capacity, slot.offset);
+                m_freeBytes += slot.capacity;
+                continue;
+            }
+            Slot oldSlot = m_slots.value(info.guid);
+            m_freeSlots.insert(oldSlot.capacity, oldSlot.offset);
+            m_freeBytes += oldSlot.capacity;
+        }
+        generations.insert(info.guid, generation);
+        m_slots.insert(info.guid, slot);
+        m_records.insert(info.guid, info);
+    }
+    m_file.unmap(data);
+
+    foreach (const NoteInfo &info, m_records) {
+        addResourceReferences(info, 1);
+    }
+
+    if (offset < size) {
+        qCWarning(dcStorage) << "Note info table contains" << size - offset << "invalid bytes at the end. Truncating.";
+        m_file.resize(offset);
+    }
+
+    qCDebug(dcStorage) << "Opened note info table" << fileName << "with" << m_records.count() << "records";
+    compactIfNeeded();
+    return true;
+}
+
+void NoteInfoTable::close()
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_records.clear();
+    m_slots.clear();
+    m_resourceReferences.clear();
+    m_freeSlots.clear();
+    m_freeBytes = 0;
+    m_generation = 0;
+}
+
+int NoteInfoTable::count() const
+{
+    return m_records.count();
+}
+
+bool NoteInfoTable::contains(const QString &guid) const
+{
+    return m_records.contains(guid);
+}
+
+NoteInfo NoteInfoTable::record(const QString &guid) const
+{
+    return m_records.value(guid);
+}
+
+QStringList NoteInfoTable::guids() const
+{
+    return m_records.keys();
+}
+
+int NoteInfoTable::resourceReferences(const QString &hash) const
+{
+    return m_resourceReferences.value(hash);
+}
+
+void NoteInfoTable::write(const NoteInfo &info)
+{
+    if (!m_file.isOpen()) {
+        qCWarning(dcStorage) << "Note info table not opened. Cannot write record for" << info.guid;
+        return;
+    }
+    if (info.guid.toUtf8().length() > SLOT_GUID_MAX) {
+        qCWarning(dcStorage) << "Guid too long for note info table:" << info.guid;
+        return;
+    }
+
+    QByteArray data = encode(info, m_generation++);
+
+    QHash<QString, Slot>::iterator it = m_slots.find(info.guid);
+    if (it != m_slots.end() && (quint32)data.length() <= it.value().capacity) {
+        writeSlot(it.value(), data);
+    } else {
+        Slot slot = allocateSlot(data.length());
+        writeSlot(slot, data);
+        if (it != m_slots.end()) {
+            // Only release the old slot once the new one has been written
+            releaseSlot(it.value());
+            it.value() = slot;
+        } else {
+            m_slots.insert(info.guid, slot);
+        }
+    }
+    QHash<QString, NoteInfo>::const_iterator recordIt = m_records.constFind(info.guid);
+    if (recordIt != m_records.constEnd()) {
+        addResourceReferences(recordIt.value(), -1);
+    }
+    addResourceReferences(info, 1);
+    m_records.insert(info.guid, info);
+
+    compactIfNeeded();
+}
+
+void NoteInfoTable::remove(const QString &guid)
+{
+    QHash<QString, Slot>::iterator it = m_slots.find(guid);
+    if (it == m_slots.end()) {
+        return;
+    }
+    releaseSlot(it.value());
+    m_slots.erase(it);
+    addResourceReferences(m_records.value(guid), -1);
+    m_records.remove(guid);
+
+    compactIfNeeded();
+}
+
+void NoteInfoTable::sync()
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+    m_file.flush();
+    if (fsync(m_file.handle()) != 0) {
+        qCWarning(dcStorage) << "Error syncing note info table to disk:" << m_file.fileName();
+    }
+}
+
+void NoteInfoTable::compact()
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    QString fileName = m_file.fileName();
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        qCWarning(dcStorage) << "Cannot compact note info table" << fileName << file.errorString();
+        return;
+    }
+
+    m_file.seek(0);
+    file.write(m_file.read(TABLE_HEADER_SIZE));
+
+    QHash<QString, Slot> slots;
+    qint64 offset = TABLE_HEADER_SIZE;
+    m_generation = 0;
+    foreach (const NoteInfo &info, m_records) {
+        QByteArray data = encode(info, m_generation++);
+        quint32 capacity = (data.length() + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+        qToLittleEndian<quint32>(capacity, (uchar*)data.data() + SLOT_CAPACITY);
+        data.append(QByteArray(capacity - data.length(), '\0'));
+        file.write(data);
+
+        Slot slot;
+        slot.offset = offset;
+        slot.capacity = capacity;
+        slots.insert(info.guid, slot);
+        offset += capacity;
+    }
+
+    m_file.close();
+    if (!file.commit()) {
+        qCWarning(dcStorage) << "Error committing compacted note info table" << fileName << file.errorString();
+    } else {
+        qCDebug(dcStorage) << "Compacted note info table. Released" << m_freeBytes << "bytes.";
+        m_slots = slots;
+        m_freeSlots.clear();
+        m_freeBytes = 0;
+    }
+
+    if (!m_file.open(QFile::ReadWrite)) {
+        qCWarning(dcStorage) << "Cannot reopen note info table after compacting" << fileName << m_file.errorString();
+    }
+}
+
+// The payload is the note serialized as evernote::edam::Note with the compact protocol,
+// followed by the fields Evernote doesn't know about. The note is the one the server sent
+// last, if there was one, updated with what we have locally.
+static QByteArray encodePayload(const NoteInfo &info)
+{
+    evernote::edam::Note note;
+    if (!info.edam.isEmpty()) {
+        EdamCodec::decode(info.edam, &note);
+    }
+    note.guid = info.guid.toStdString();
+    note.__isset.guid = true;
+    note.title = info.title.toStdString();
+    note.__isset.title = true;
+    note.notebookGuid = info.notebookGuid.toStdString();
+    note.__isset.notebookGuid = true;
+    note.updateSequenceNum = info.updateSequenceNumber;
+    note.__isset.updateSequenceNum = true;
+    note.active = !info.deleted;
+    note.__isset.active = true;
+    note.created = info.created.isValid() ? info.created.toMSecsSinceEpoch() : 0;
+    note.__isset.created = info.created.isValid();
+    note.updated = info.updated.isValid() ? info.updated.toMSecsSinceEpoch() : 0;
+    note.__isset.updated = info.updated.isValid();
+    note.tagGuids.clear();
+    foreach (const QString &tagGuid, info.tagGuids) {
+        note.tagGuids.push_back(tagGuid.toStdString());
+    }
+    note.__isset.tagGuids = !note.tagGuids.empty();
+
+    // Resources we still have keep what the server told about them
+    std::vector<evernote::edam::Resource> resources;
+    foreach (const NoteResourceInfo &resourceInfo, info.resources) {
+        std::string bodyHash = QByteArray::fromHex(resourceInfo.hash.toLatin1()).toStdString();
+        evernote::edam::Resource resource;
+        for (unsigned int i = 0; i < note.resources.size(); i++) {
+            if (note.resources.at(i).data.bodyHash == bodyHash) {
+                resource = note.resources.at(i);
+                break;
+            }
+        }
+        resource.data.bodyHash = bodyHash;
+        resource.data.__isset.bodyHash = true;
+        resource.__isset.data = true;
+        resource.mime = resourceInfo.type.toStdString();
+        resource.__isset.mime = true;
+        resource.attributes.fileName = resourceInfo.fileName.toStdString();
+        resource.attributes.__isset.fileName = true;
+        resource.__isset.attributes = true;
+        resources.push_back(resource);
+    }
+    note.resources = resources;
+    note.__isset.resources = !note.resources.empty();
+
+    note.attributes.reminderOrder = info.reminderOrder;
+    note.attributes.__isset.reminderOrder = info.reminderOrder != 0;
+    note.attributes.reminderTime = info.reminderTime.isValid() ? info.reminderTime.toMSecsSinceEpoch() : 0;
+    note.attributes.__isset.reminderTime = info.reminderTime.isValid();
+    note.attributes.reminderDoneTime = info.reminderDoneTime.isValid() ? info.reminderDoneTime.toMSecsSinceEpoch() : 0;
+    note.attributes.__isset.reminderDoneTime = info.reminderDoneTime.isValid();
+    note.__isset.attributes = true;
+
+    QByteArray noteData = EdamCodec::encode(note);
+    QByteArray payload(4, '\0');
+    qToLittleEndian<quint32>(noteData.length(), (uchar*)payload.data());
+    payload.append(noteData);
+    payload.append(info.tagline.toUtf8());
+    return payload;
+}
+
+static bool decodePayload(const QByteArray &payload, NoteInfo *info)
+{
+    if (payload.length() < 4) {
+        return false;
+    }
+    quint32 noteLength = qFromLittleEndian<quint32>((const uchar*)payload.constData());
+    if (noteLength > (quint32)payload.length() - 4) {
+        return false;
+    }
+
+    // The payload points into the mapped file, which goes away after opening
+    info->edam = QByteArray(payload.constData() + 4, noteLength);
+    evernote::edam::Note note;
+    if (!EdamCodec::decode(info->edam, &note)) {
+        return false;
+    }
+
+    info->guid = QString::fromStdString(note.guid);
+    info->title = QString::fromStdString(note.title);
+    info->notebookGuid = QString::fromStdString(note.notebookGuid);
+    info->updateSequenceNumber = note.updateSequenceNum;
+    info->deleted = note.__isset.active && !note.active;
+    info->created = note.__isset.created ? QDateTime::fromMSecsSinceEpoch(note.created) : QDateTime();
+    info->updated = note.__isset.updated ? QDateTime::fromMSecsSinceEpoch(note.updated) : QDateTime();
+    foreach (const std::string &tagGuid, note.tagGuids) {
+        info->tagGuids.append(QString::fromStdString(tagGuid));
+    }
+    foreach (const evernote::edam::Resource &resource, note.resources) {
+        NoteResourceInfo resourceInfo;
+        resourceInfo.hash = QByteArray(resource.data.bodyHash.data(), resource.data.bodyHash.length()).toHex();
+        resourceInfo.fileName = QString::fromStdString(resource.attributes.fileName);
+        resourceInfo.type = QString::fromStdString(resource.mime);
+        info->resources.append(resourceInfo);
+    }
+    info->reminderOrder = note.attributes.__isset.reminderOrder ? note.attributes.reminderOrder : 0;
+    info->reminderTime = note.attributes.__isset.reminderTime ? QDateTime::fromMSecsSinceEpoch(note.attributes.reminderTime) : QDateTime();
+    info->reminderDoneTime = note.attributes.__isset.reminderDoneTime ? QDateTime::fromMSecsSinceEpoch(note.attributes.reminderDoneTime) : QDateTime();
+
+    info->tagline = QString::fromUtf8(payload.constData() + 4 + noteLength, payload.length() - 4 - noteLength);
+    return true;
+}
+
+// Records written before we switched to Evernote's format
+static bool decodeLegacyPayload(const QByteArray &payload, NoteInfo *info)
+{
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 resourceCount;
+    stream >> info->title >> info->notebookGuid >> info->tagGuids >> info->tagline >> resourceCount;
+    for (quint32 i = 0; i < resourceCount && stream.status() == QDataStream::Ok; i++) {
+        NoteResourceInfo resource;
+        stream >> resource.hash >> resource.fileName >> resource.type;
+        info->resources.append(resource);
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+QByteArray NoteInfoTable::encode(const NoteInfo &info, quint32 generation) const
+{
+    QByteArray payload = encodePayload(info);
+    QByteArray guid = info.guid.toUtf8();
+
+    // The fixed header duplicates the few fields we need to know about a note without
+    // deserializing it
+    QByteArray data(SLOT_HEADER_SIZE, '\0');
+    uchar *slot = (uchar*)data.data();
+    qToLittleEndian<quint32>(payload.length(), slot + SLOT_PAYLOAD_LENGTH);
+    qToLittleEndian<quint16>(SLOT_FLAG_USED | SLOT_FLAG_EDAM, slot + SLOT_FLAGS);
+    qToLittleEndian<quint32>(generation, slot + SLOT_GENERATION);
+    qToLittleEndian<qint32>(info.updateSequenceNumber, slot + SLOT_USN);
+    qToLittleEndian<qint32>(info.lastSyncedSequenceNumber, slot + SLOT_LAST_SYNCED_USN);
+    qToLittleEndian<qint64>(encodeDateTime(info.created), slot + SLOT_CREATED);
+    qToLittleEndian<qint64>(encodeDateTime(info.updated), slot + SLOT_UPDATED);
+    qToLittleEndian<qint64>(info.reminderOrder, slot + SLOT_REMINDER_ORDER);
+    qToLittleEndian<qint64>(encodeDateTime(info.reminderTime), slot + SLOT_REMINDER_TIME);
+    qToLittleEndian<qint64>(encodeDateTime(info.reminderDoneTime), slot + SLOT_REMINDER_DONE_TIME);
+    slot[SLOT_DELETED] = info.deleted ? 1 : 0;
+    slot[SLOT_NEEDS_CONTENT_SYNC] = info.needsContentSync ? 1 : 0;
+    qToLittleEndian<quint16>(guid.length(), slot + SLOT_GUID_LENGTH);
+    memcpy(slot + SLOT_GUID, guid.constData(), guid.length());
+
+    data.append(payload);
+    slot = (uchar*)data.data();
+    quint16 checksum = qChecksum(data.constData() + SLOT_GENERATION, data.length() - SLOT_GENERATION);
+    qToLittleEndian<quint16>(checksum, slot + SLOT_CHECKSUM);
+    return data;
+}
+
+bool NoteInfoTable::decode(const uchar *data, quint32 capacity, NoteInfo *info, quint32 *generation) const
+{
+    quint16 flags = qFromLittleEndian<quint16>(data + SLOT_FLAGS);
+    if (!(flags & SLOT_FLAG_USED)) {
+        return false;
+    }
+
+    quint32 payloadLength = qFromLittleEndian<quint32>(data + SLOT_PAYLOAD_LENGTH);
+    quint16 guidLength = qFromLittleEndian<quint16>(data + SLOT_GUID_LENGTH);
+    if (payloadLength > capacity - SLOT_HEADER_SIZE || guidLength > SLOT_GUID_MAX) {
+        return false;
+    }
+    quint16 checksum = qChecksum((const char*)data + SLOT_GENERATION, SLOT_HEADER_SIZE + payloadLength - SLOT_GENERATION);
+    if (checksum != qFromLittleEndian<quint16>(data + SLOT_CHECKSUM)) {
+        qCWarning(dcStorage) << "Checksum mismatch in note info table. Dropping record.";
+        return false;
+    }
+
+    *generation = qFromLittleEndian<quint32>(data + SLOT_GENERATION);
+    info->lastSyncedSequenceNumber = qFromLittleEndian<qint32>(data + SLOT_LAST_SYNCED_USN);
+    info->needsContentSync = data[SLOT_NEEDS_CONTENT_SYNC] != 0;
+
+    QByteArray payload = QByteArray::fromRawData((const char*)data + SLOT_HEADER_SIZE, payloadLength);
+    if (flags & SLOT_FLAG_EDAM) {
+        return decodePayload(payload, info);
+    }
+
+    info->guid = QString::fromUtf8((const char*)data + SLOT_GUID, guidLength);
+    info->updateSequenceNumber = qFromLittleEndian<qint32>(data + SLOT_USN);
+    info->created = decodeDateTime(qFromLittleEndian<qint64>(data + SLOT_CREATED));
+    info->updated = decodeDateTime(qFromLittleEndian<qint64>(data + SLOT_UPDATED));
+    info->reminderOrder = qFromLittleEndian<qint64>(data + SLOT_REMINDER_ORDER);
+    info->reminderTime = decodeDateTime(qFromLittleEndian<qint64>(data + SLOT_REMINDER_TIME));
+    info->reminderDoneTime = decodeDateTime(qFromLittleEndian<qint64>(data + SLOT_REMINDER_DONE_TIME));
+    info->deleted = data[SLOT_DELETED] != 0;
+    return decodeLegacyPayload(payload, info);
+}
+
+NoteInfoTable::Slot NoteInfoTable::allocateSlot(quint32 size)
+{
+    Slot slot;
+    QMultiMap<quint32, qint64>::iterator it = m_freeSlots.lowerBound(size);
+    if (it != m_freeSlots.end()) {
+        slot.capacity = it.key();
+        slot.offset = it.value();
+        m_freeSlots.erase(it);
+        m_freeBytes -= slot.capacity;
+        return slot;
+    }
+
+    slot.capacity = (size + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+    slot.offset = m_file.size();
+    return slot;
+}
+
+void NoteInfoTable::releaseSlot(const NoteInfoTable::Slot &slot)
+{
+    uchar flags[2];
+    qToLittleEndian<quint16>(0, flags);
+    m_file.seek(slot.offset + SLOT_FLAGS);
+    m_file.write((const char*)flags, sizeof(flags));
+    m_file.flush();
+
+    m_freeSlots.insert(slot.capacity, slot.offset);
+    m_freeBytes += slot.capacity;
+}
+
+void NoteInfoTable::writeSlot(const NoteInfoTable::Slot &slot, QByteArray data)
+{
+    qToLittleEndian<quint32>(slot.capacity, (uchar*)data.data() + SLOT_CAPACITY);
+    m_file.seek(slot.offset);
+    if (m_file.write(data) != data.length()) {
+        qCWarning(dcStorage) << "Error writing note info table:" << m_file.errorString();
+    }
+    if (m_file.size() < slot.offset + slot.capacity) {
+        m_file.resize(slot.offset + slot.capacity);
+    }
+    m_file.flush();
+}
+
+void NoteInfoTable::compactIfNeeded()
+{
+    if (m_freeBytes > TABLE_MIN_COMPACT_BYTES && m_freeBytes > m_file.size() / 2) {
+        compact();
+    }
+}
+
+void NoteInfoTable::addResourceReferences(const NoteInfo &info, int delta)
+{
+    foreach (const NoteResourceInfo &resource, info.resources) {
+        QHash<QString, int>::iterator it = m_resourceReferences.find(resource.hash);
+        if (it == m_resourceReferences.end()) {
+            if (delta > 0) {
+                m_resourceReferences.insert(resource.hash, delta);
+            }
+        } else if ((it.value() += delta) <= 0) {
+            m_resourceReferences.erase(it);
+        }
+    }
+}
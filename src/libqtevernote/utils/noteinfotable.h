@@ -0,0 +1,122 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NOTEINFOTABLE_H
+#define NOTEINFOTABLE_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMultiMap>
+#include <QStringList>
+
+struct NoteResourceInfo
+{
+    QString hash;
+    QString fileName;
+    QString type;
+};
+
+// Everything we cache about a note, except for its content
+struct NoteInfo
+{
+    NoteInfo();
+
+    QString guid;
+    QString notebookGuid;
+    QString title;
+    QString tagline;
+    QDateTime created;
+    QDateTime updated;
+    QStringList tagGuids;
+    qint64 reminderOrder;
+    QDateTime reminderTime;
+    QDateTime reminderDoneTime;
+    bool deleted;
+    bool needsContentSync;
+    qint32 updateSequenceNumber;
+    qint32 lastSyncedSequenceNumber;
+    QList<NoteResourceInfo> resources;
+    // The evernote::edam::Note the server sent last, see EdamCodec. The fields above are
+    // written over it, the ones we don't know about are kept.
+    QByteArray edam;
+};
+
+// The NoteInfoTable holds the metadata of all the notes in a single file. It replaces
+// the note-<guid>.info files we had before, one per note.
+//
+// The file is a sequence of slots. Each slot starts with a fixed layout header carrying
+// the guid, dates, reminder fields, flags and sequence numbers, followed by the note
+// itself, stored as an evernote::edam::Note serialized with thrift's compact protocol,
+// and the few local fields Evernote doesn't know about (the tagline). Slots are
+// allocated with some spare room so that updating a note usually rewrites its slot in
+// place. If a record outgrows its slot, it is moved to a free or new slot and the old
+// one is marked as free. The whole table is read with a single mmap when opened.
+class NoteInfoTable
+{
+public:
+    NoteInfoTable();
+    ~NoteInfoTable();
+
+    bool open(const QString &fileName);
+    void close();
+
+    int count() const;
+    bool contains(const QString &guid) const;
+    NoteInfo record(const QString &guid) const;
+    QStringList guids() const;
+
+    // The number of records listing a resource with the given hash
+    int resourceReferences(const QString &hash) const;
+
+    void write(const NoteInfo &info);
+    void remove(const QString &guid);
+
+    // Makes sure everything written so far has hit the disk
+    void sync();
+
+    // Rewrites the table without any free slots
+    void compact();
+
+private:
+    struct Slot {
+        qint64 offset;
+        quint32 capacity;
+    };
+
+    QByteArray encode(const NoteInfo &info, quint32 generation) const;
+    bool decode(const uchar *data, quint32 capacity, NoteInfo *info, quint32 *generation) const;
+
+    Slot allocateSlot(quint32 size);
+    void releaseSlot(const Slot &slot);
+    void writeSlot(const Slot &slot, QByteArray data);
+    void compactIfNeeded();
+    void addResourceReferences(const NoteInfo &info, int delta);
+
+private:
+    QFile m_file;
+    QHash<QString, NoteInfo> m_records;
+    QHash<QString, Slot> m_slots;
+    QHash<QString, int> m_resourceReferences;
+    QMultiMap<quint32, qint64> m_freeSlots;
+    qint64 m_freeBytes;
+    quint32 m_generation;
+};
+
+#endif // NOTEINFOTABLE_H
@@ -0,0 +1,112 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "notesnapshot.h"
+#include "logging.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+
+#define SNAPSHOT_MAGIC 0x524e5353 // "RNSS"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_HEADER_SIZE 16
+
+NoteSnapshot::Row::Row():
+    reminderOrder(0),
+    deleted(false),
+    synced(false)
+{
+}
+
+bool NoteSnapshot::read(const QString &fileName, QVector<NoteSnapshot::Row> *rows)
+{
+    QFile file(fileName);
+    if (!file.exists()) {
+        return false;
+    }
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(dcStorage) << "Cannot open note snapshot" << fileName << file.errorString();
+        return false;
+    }
+    QByteArray data = file.readAll();
+
+    QDataStream headerStream(data);
+    headerStream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    quint16 version;
+    quint32 rowCount;
+    quint32 length;
+    quint16 checksum;
+    headerStream >> magic >> version >> rowCount >> length >> checksum;
+    if (headerStream.status() != QDataStream::Ok || magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION
+            || data.length() - SNAPSHOT_HEADER_SIZE != (int)length
+            || qChecksum(data.constData() + SNAPSHOT_HEADER_SIZE, length) != checksum) {
+        qCWarning(dcStorage) << "Ignoring invalid note snapshot" << fileName;
+        return false;
+    }
+
+    QDataStream stream(data.mid(SNAPSHOT_HEADER_SIZE));
+    stream.setVersion(QDataStream::Qt_5_0);
+    rows->clear();
+    rows->reserve(rowCount);
+    for (quint32 i = 0; i < rowCount; i++) {
+        Row row;
+        stream >> row.guid >> row.notebookGuid >> row.title >> row.tagline >> row.created >> row.updated
+               >> row.tagGuids >> row.resourceUrls >> row.reminderOrder >> row.reminderTime
+               >> row.reminderDoneTime >> row.deleted >> row.synced;
+        rows->append(row);
+    }
+    if (stream.status() != QDataStream::Ok) {
+        qCWarning(dcStorage) << "Note snapshot is truncated" << fileName;
+        rows->clear();
+        return false;
+    }
+    return true;
+}
+
+bool NoteSnapshot::write(const QString &fileName, const QVector<NoteSnapshot::Row> &rows)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    foreach (const Row &row, rows) {
+        stream << row.guid << row.notebookGuid << row.title << row.tagline << row.created << row.updated
+               << row.tagGuids << row.resourceUrls << row.reminderOrder << row.reminderTime
+               << row.reminderDoneTime << row.deleted << row.synced;
+    }
+
+    QByteArray header;
+    QDataStream headerStream(&header, QIODevice::WriteOnly);
+    headerStream.setVersion(QDataStream::Qt_5_0);
+    headerStream << (quint32)SNAPSHOT_MAGIC << (quint16)SNAPSHOT_VERSION << (quint32)rows.count()
+                 << (quint32)data.length() << qChecksum(data.constData(), data.length());
+
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        qCWarning(dcStorage) << "Cannot write note snapshot" << fileName << file.errorString();
+        return false;
+    }
+    file.write(header);
+    file.write(data);
+    if (!file.commit()) {
+        qCWarning(dcStorage) << "Error committing note snapshot" << fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
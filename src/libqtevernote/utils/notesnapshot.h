@@ -0,0 +1,62 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NOTESNAPSHOT_H
+#define NOTESNAPSHOT_H
+
+#include <QDateTime>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// The NoteSnapshot holds what the notes list shows for each note, written when the app
+// goes away. At the next start the list can be filled from this single file before any
+// Note object has been created.
+//
+// The snapshot is only a hint. Whatever is in the cache journal wins.
+//
+// File layout (all integers big endian):
+// Header: quint32 magic, quint16 version, quint32 row count, quint32 data length,
+//         quint16 checksum (over the data)
+// Data:   the rows, in QDataStream format
+class NoteSnapshot
+{
+public:
+    struct Row {
+        Row();
+
+        QString guid;
+        QString notebookGuid;
+        QString title;
+        QString tagline;
+        QDateTime created;
+        QDateTime updated;
+        QStringList tagGuids;
+        QStringList resourceUrls;
+        qint64 reminderOrder;
+        QDateTime reminderTime;
+        QDateTime reminderDoneTime;
+        bool deleted;
+        bool synced;
+    };
+
+    static bool read(const QString &fileName, QVector<Row> *rows);
+    static bool write(const QString &fileName, const QVector<Row> &rows);
+};
+
+#endif // NOTESNAPSHOT_H
@@ -68,17 +68,25 @@ void OrganizerAdapter::startSync()
 
 void OrganizerAdapter::writeReminders()
 {
-    foreach (Note* note, NotesStore::instance()->notes()) {
-        if (note->reminder() && note->hasReminderTime() && !note->reminderDone() && !note->deleted()) {
-            QOrganizerTodo item;
-            organizerEventFromNote(note, item);
-
-            QOrganizerItemSaveRequest *operation = new QOrganizerItemSaveRequest(this);
-            operation->setManager(m_manager);
-            operation->setItem(item);
-            connect(operation, &QOrganizerItemFetchRequest::stateChanged, this, &OrganizerAdapter::writeStateChanged);
-            operation->start();
+    // Go through the model to only create the notes that actually have a reminder
+    NotesStore *notesStore = NotesStore::instance();
+    for (int i = 0; i < notesStore->count(); i++) {
+        QModelIndex index = notesStore->index(i);
+        if (!notesStore->data(index, NotesStore::RoleReminder).toBool()
+                || notesStore->data(index, NotesStore::RoleReminderTime).toDateTime().isNull()
+                || notesStore->data(index, NotesStore::RoleReminderDone).toBool()
+                || notesStore->data(index, NotesStore::RoleDeleted).toBool()) {
+            continue;
         }
+
+        QOrganizerTodo item;
+        organizerEventFromNote(notesStore->note(i), item);
+
+        QOrganizerItemSaveRequest *operation = new QOrganizerItemSaveRequest(this);
+        operation->setManager(m_manager);
+        operation->setItem(item);
+        connect(operation, &QOrganizerItemFetchRequest::stateChanged, this, &OrganizerAdapter::writeStateChanged);
+        operation->start();
     }
 }
 
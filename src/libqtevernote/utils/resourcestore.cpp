@@ -0,0 +1,134 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "resourcestore.h"
+#include "noteinfotable.h"
+#include "thumbnailcache.h"
+#include "logging.h"
+
+#include <QDir>
+#include <QFile>
+#include <QRegExp>
+
+// Give pending deletions a moment to settle before starting a pass
+#define GC_START_DELAY 5000
+// Time between two steps of a pass and the number of files checked in each
+#define GC_STEP_INTERVAL 100
+#define GC_FILES_PER_STEP 32
+
+ResourceStore::ResourceStore(QObject *parent):
+    QObject(parent),
+    m_noteInfoTable(nullptr),
+    m_thumbnailCache(nullptr)
+{
+    m_collectTimer.setSingleShot(true);
+    connect(&m_collectTimer, &QTimer::timeout, this, &ResourceStore::collectGarbageStep);
+}
+
+void ResourceStore::open(const QString &storageLocation, NoteInfoTable *noteInfoTable, ThumbnailCache *thumbnailCache)
+{
+    close();
+    m_storageLocation = storageLocation;
+    m_noteInfoTable = noteInfoTable;
+    m_thumbnailCache = thumbnailCache;
+}
+
+void ResourceStore::close()
+{
+    m_collectTimer.stop();
+    m_pendingFiles.clear();
+    m_storageLocation.clear();
+    m_noteInfoTable = nullptr;
+    m_thumbnailCache = nullptr;
+}
+
+void ResourceStore::ref(const QString &hash)
+{
+    m_liveReferences[hash]++;
+}
+
+void ResourceStore::unref(const QString &hash)
+{
+    QHash<QString, int>::iterator it = m_liveReferences.find(hash);
+    if (it == m_liveReferences.end()) {
+        return;
+    }
+    if (--it.value() == 0) {
+        m_liveReferences.erase(it);
+        if (references(hash) == 0) {
+            collectGarbage();
+        }
+    }
+}
+
+int ResourceStore::references(const QString &hash) const
+{
+    int references = m_liveReferences.value(hash);
+    if (m_noteInfoTable) {
+        references += m_noteInfoTable->resourceReferences(hash);
+    }
+    return references;
+}
+
+void ResourceStore::collectGarbage()
+{
+    if (m_storageLocation.isEmpty() || m_collectTimer.isActive() || !m_pendingFiles.isEmpty()) {
+        return;
+    }
+    m_collectTimer.start(GC_START_DELAY);
+}
+
+void ResourceStore::collectGarbageStep()
+{
+    if (m_storageLocation.isEmpty()) {
+        return;
+    }
+
+    // Resource bodies are named <md5>.<ext>, scaled copies <md5>.<ext>_<w>x<h>.jpg
+    static QRegExp resourceFileExp("^([0-9a-f]{32})\\..+");
+
+    QDir storageDir(m_storageLocation);
+    if (m_pendingFiles.isEmpty()) {
+        m_pendingFiles = storageDir.entryList(QDir::Files);
+        qCDebug(dcStorage) << "Starting resource garbage collection pass over" << m_pendingFiles.count() << "files";
+    }
+
+    int removed = 0;
+    for (int i = 0; i < GC_FILES_PER_STEP && !m_pendingFiles.isEmpty(); i++) {
+        QString fileName = m_pendingFiles.takeFirst();
+        if (!resourceFileExp.exactMatch(fileName)) {
+            continue;
+        }
+        if (references(resourceFileExp.cap(1)) == 0) {
+            QString filePath = storageDir.absoluteFilePath(fileName);
+            if (QFile::remove(filePath)) {
+                if (m_thumbnailCache) {
+                    m_thumbnailCache->remove(filePath);
+                }
+                removed++;
+            }
+        }
+    }
+    if (removed > 0) {
+        qCDebug(dcStorage) << "Removed" << removed << "unreferenced resource files";
+    }
+
+    if (!m_pendingFiles.isEmpty()) {
+        m_collectTimer.start(GC_STEP_INTERVAL);
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESOURCESTORE_H
+#define RESOURCESTORE_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QTimer>
+
+class NoteInfoTable;
+class ThumbnailCache;
+
+// Resource bodies are stored by their content hash (<hash>.<ext>), so notes sharing an
+// attachment share the file. The ResourceStore keeps track of who is still using a
+// hash and removes bodies, and any scaled copies derived from them, once nobody does.
+//
+// A hash is referenced by every note record in the NoteInfoTable listing it and by
+// every Resource object alive in memory. The latter covers conflict copies and notes
+// that haven't been written to the table yet.
+//
+// Garbage collection runs incrementally. A pass lists the storage directory once and
+// then checks a few files on every timer tick, so it never blocks the UI for long.
+class ResourceStore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ResourceStore(QObject *parent = 0);
+
+    void open(const QString &storageLocation, NoteInfoTable *noteInfoTable, ThumbnailCache *thumbnailCache);
+    void close();
+
+    void ref(const QString &hash);
+    void unref(const QString &hash);
+    int references(const QString &hash) const;
+
+    // Schedules a garbage collection pass, unless one is running already
+    void collectGarbage();
+
+private slots:
+    void collectGarbageStep();
+
+private:
+    QString m_storageLocation;
+    NoteInfoTable *m_noteInfoTable;
+    ThumbnailCache *m_thumbnailCache;
+    QHash<QString, int> m_liveReferences;
+
+    QStringList m_pendingFiles;
+    QTimer m_collectTimer;
+};
+
+#endif // RESOURCESTORE_H
@@ -0,0 +1,426 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rowbitmap.h"
+
+#include <QtAlgorithms>
+
+#include <algorithm>
+#include <iterator>
+
+// Containers with more values than this are bitmaps. That's where both take 8 kB.
+#define ARRAY_MAX 4096
+#define BITMAP_WORDS 1024
+
+RowBitmap::Container::Container():
+    count(0)
+{
+}
+
+bool RowBitmap::Container::contains(quint16 value) const
+{
+    if (!bitmap.isEmpty()) {
+        return bitmap.at(value >> 6) & (Q_UINT64_C(1) << (value & 63));
+    }
+    return std::binary_search(array.constBegin(), array.constEnd(), value);
+}
+
+void RowBitmap::Container::insert(quint16 value)
+{
+    if (!bitmap.isEmpty()) {
+        quint64 &word = bitmap[value >> 6];
+        quint64 bit = Q_UINT64_C(1) << (value & 63);
+        if (!(word & bit)) {
+            word |= bit;
+            count++;
+        }
+        return;
+    }
+
+    QVector<quint16>::iterator it = std::lower_bound(array.begin(), array.end(), value);
+    if (it != array.end() && *it == value) {
+        return;
+    }
+    array.insert(it, value);
+    count++;
+    if (count > ARRAY_MAX) {
+        toBitmap();
+    }
+}
+
+void RowBitmap::Container::remove(quint16 value)
+{
+    if (!bitmap.isEmpty()) {
+        quint64 &word = bitmap[value >> 6];
+        quint64 bit = Q_UINT64_C(1) << (value & 63);
+        if (word & bit) {
+            word &= ~bit;
+            count--;
+            optimize();
+        }
+        return;
+    }
+
+    QVector<quint16>::iterator it = std::lower_bound(array.begin(), array.end(), value);
+    if (it != array.end() && *it == value) {
+        array.erase(it);
+        count--;
+    }
+}
+
+void RowBitmap::Container::removeAndShift(quint16 value)
+{
+    if (bitmap.isEmpty()) {
+        QVector<quint16>::iterator it = std::lower_bound(array.begin(), array.end(), value);
+        if (it != array.end() && *it == value) {
+            it = array.erase(it);
+            count--;
+        }
+        for (; it != array.end(); ++it) {
+            (*it)--;
+        }
+        return;
+    }
+
+    if (contains(value)) {
+        count--;
+    }
+    // Bits below value stay, the ones above move down, dropping the one at value
+    int first = value >> 6;
+    quint64 below = (Q_UINT64_C(1) << (value & 63)) - 1;
+    quint64 &word = bitmap[first];
+    word = (word & below) | ((word >> 1) & ~below);
+    for (int i = first; i < BITMAP_WORDS - 1; i++) {
+        if (i > first) {
+            bitmap[i] >>= 1;
+        }
+        bitmap[i] |= bitmap.at(i + 1) << 63;
+    }
+    if (first < BITMAP_WORDS - 1) {
+        bitmap[BITMAP_WORDS - 1] >>= 1;
+    }
+    optimize();
+}
+
+void RowBitmap::Container::intersect(const Container &other)
+{
+    if (bitmap.isEmpty() && other.bitmap.isEmpty()) {
+        QVector<quint16> result;
+        std::set_intersection(array.constBegin(), array.constEnd(), other.array.constBegin(), other.array.constEnd(),
+                              std::back_inserter(result));
+        array = result;
+        count = array.count();
+        return;
+    }
+
+    if (bitmap.isEmpty() || other.bitmap.isEmpty()) {
+        const Container &sparse = bitmap.isEmpty() ? *this : other;
+        const Container &dense = bitmap.isEmpty() ? other : *this;
+        QVector<quint16> result;
+        foreach (quint16 value, sparse.array) {
+            if (dense.contains(value)) {
+                result.append(value);
+            }
+        }
+        bitmap.clear();
+        array = result;
+        count = array.count();
+        return;
+    }
+
+    count = 0;
+    for (int i = 0; i < BITMAP_WORDS; i++) {
+        bitmap[i] &= other.bitmap.at(i);
+        count += qPopulationCount(bitmap.at(i));
+    }
+    optimize();
+}
+
+void RowBitmap::Container::unite(const Container &other)
+{
+    if (bitmap.isEmpty() && other.bitmap.isEmpty()) {
+        QVector<quint16> result;
+        result.reserve(array.count() + other.array.count());
+        std::set_union(array.constBegin(), array.constEnd(), other.array.constBegin(), other.array.constEnd(),
+                       std::back_inserter(result));
+        array = result;
+        count = array.count();
+        if (count > ARRAY_MAX) {
+            toBitmap();
+        }
+        return;
+    }
+
+    toBitmap();
+    if (other.bitmap.isEmpty()) {
+        foreach (quint16 value, other.array) {
+            insert(value);
+        }
+        return;
+    }
+    count = 0;
+    for (int i = 0; i < BITMAP_WORDS; i++) {
+        bitmap[i] |= other.bitmap.at(i);
+        count += qPopulationCount(bitmap.at(i));
+    }
+}
+
+void RowBitmap::Container::subtract(const Container &other)
+{
+    if (bitmap.isEmpty()) {
+        QVector<quint16> result;
+        foreach (quint16 value, array) {
+            if (!other.contains(value)) {
+                result.append(value);
+            }
+        }
+        array = result;
+        count = array.count();
+        return;
+    }
+
+    if (other.bitmap.isEmpty()) {
+        foreach (quint16 value, other.array) {
+            remove(value);
+            if (bitmap.isEmpty()) {
+                // Turned into an array on the way
+                subtract(other);
+                return;
+            }
+        }
+        return;
+    }
+    count = 0;
+    for (int i = 0; i < BITMAP_WORDS; i++) {
+        bitmap[i] &= ~other.bitmap.at(i);
+        count += qPopulationCount(bitmap.at(i));
+    }
+    optimize();
+}
+
+void RowBitmap::Container::toBitmap()
+{
+    if (!bitmap.isEmpty()) {
+        return;
+    }
+    bitmap = QVector<quint64>(BITMAP_WORDS, 0);
+    foreach (quint16 value, array) {
+        bitmap[value >> 6] |= Q_UINT64_C(1) << (value & 63);
+    }
+    array.clear();
+}
+
+void RowBitmap::Container::optimize()
+{
+    if (bitmap.isEmpty() || count > ARRAY_MAX) {
+        return;
+    }
+    array.clear();
+    array.reserve(count);
+    for (int i = 0; i < BITMAP_WORDS; i++) {
+        quint64 word = bitmap.at(i);
+        for (int bit = 0; word; bit++, word >>= 1) {
+            if (word & 1) {
+                array.append(i * 64 + bit);
+            }
+        }
+    }
+    bitmap.clear();
+}
+
+RowBitmap::RowBitmap()
+{
+}
+
+RowBitmap RowBitmap::filled(quint32 count)
+{
+    RowBitmap result;
+    for (quint32 start = 0; start < count; start += 0x10000) {
+        Container container;
+        container.count = qMin<quint32>(count - start, 0x10000);
+        if (container.count > ARRAY_MAX) {
+            container.bitmap = QVector<quint64>(BITMAP_WORDS, 0);
+            int words = container.count / 64;
+            for (int i = 0; i < words; i++) {
+                container.bitmap[i] = ~Q_UINT64_C(0);
+            }
+            if (container.count % 64) {
+                container.bitmap[words] = (Q_UINT64_C(1) << (container.count % 64)) - 1;
+            }
+        } else {
+            container.array.reserve(container.count);
+            for (int i = 0; i < container.count; i++) {
+                container.array.append(i);
+            }
+        }
+        result.m_containers.insert(start >> 16, container);
+    }
+    return result;
+}
+
+bool RowBitmap::isEmpty() const
+{
+    return m_containers.isEmpty();
+}
+
+int RowBitmap::count() const
+{
+    int count = 0;
+    foreach (const Container &container, m_containers) {
+        count += container.count;
+    }
+    return count;
+}
+
+bool RowBitmap::contains(quint32 row) const
+{
+    QMap<quint16, Container>::const_iterator it = m_containers.constFind(row >> 16);
+    return it != m_containers.constEnd() && it.value().contains(row & 0xffff);
+}
+
+void RowBitmap::insert(quint32 row)
+{
+    m_containers[row >> 16].insert(row & 0xffff);
+}
+
+void RowBitmap::remove(quint32 row)
+{
+    QMap<quint16, Container>::iterator it = m_containers.find(row >> 16);
+    if (it == m_containers.end()) {
+        return;
+    }
+    it.value().remove(row & 0xffff);
+    if (it.value().count == 0) {
+        m_containers.erase(it);
+    }
+}
+
+void RowBitmap::removeRow(quint32 row)
+{
+    quint16 key = row >> 16;
+    foreach (quint16 containerKey, m_containers.keys()) {
+        if (containerKey < key) {
+            continue;
+        }
+        Container &container = m_containers[containerKey];
+        if (containerKey == key) {
+            container.removeAndShift(row & 0xffff);
+        } else {
+            // The first row of each following container moves into the one before
+            bool carry = container.contains(0);
+            container.removeAndShift(0);
+            if (carry) {
+                m_containers[containerKey - 1].insert(0xffff);
+            }
+        }
+    }
+    QMap<quint16, Container>::iterator it = m_containers.begin();
+    while (it != m_containers.end()) {
+        if (it.value().count == 0) {
+            it = m_containers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+QVector<quint32> RowBitmap::rows() const
+{
+    QVector<quint32> rows;
+    rows.reserve(count());
+    QMap<quint16, Container>::const_iterator it = m_containers.constBegin();
+    for (; it != m_containers.constEnd(); ++it) {
+        quint32 high = (quint32)it.key() << 16;
+        const Container &container = it.value();
+        if (container.bitmap.isEmpty()) {
+            foreach (quint16 value, container.array) {
+                rows.append(high | value);
+            }
+            continue;
+        }
+        for (int i = 0; i < BITMAP_WORDS; i++) {
+            quint64 word = container.bitmap.at(i);
+            for (int bit = 0; word; bit++, word >>= 1) {
+                if (word & 1) {
+                    rows.append(high | (i * 64 + bit));
+                }
+            }
+        }
+    }
+    return rows;
+}
+
+QBitArray RowBitmap::toBitArray(int size) const
+{
+    QBitArray bits(size);
+    foreach (quint32 row, rows()) {
+        if ((int)row >= size) {
+            break;
+        }
+        bits.setBit(row);
+    }
+    return bits;
+}
+
+RowBitmap &RowBitmap::operator&=(const RowBitmap &other)
+{
+    QMap<quint16, Container>::iterator it = m_containers.begin();
+    while (it != m_containers.end()) {
+        QMap<quint16, Container>::const_iterator match = other.m_containers.constFind(it.key());
+        if (match != other.m_containers.constEnd()) {
+            it.value().intersect(match.value());
+        }
+        if (match == other.m_containers.constEnd() || it.value().count == 0) {
+            it = m_containers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return *this;
+}
+
+RowBitmap &RowBitmap::operator|=(const RowBitmap &other)
+{
+    QMap<quint16, Container>::const_iterator it = other.m_containers.constBegin();
+    for (; it != other.m_containers.constEnd(); ++it) {
+        QMap<quint16, Container>::iterator match = m_containers.find(it.key());
+        if (match == m_containers.end()) {
+            m_containers.insert(it.key(), it.value());
+        } else {
+            match.value().unite(it.value());
+        }
+    }
+    return *this;
+}
+
+RowBitmap &RowBitmap::operator-=(const RowBitmap &other)
+{
+    QMap<quint16, Container>::iterator it = m_containers.begin();
+    while (it != m_containers.end()) {
+        QMap<quint16, Container>::const_iterator match = other.m_containers.constFind(it.key());
+        if (match != other.m_containers.constEnd()) {
+            it.value().subtract(match.value());
+        }
+        if (it.value().count == 0) {
+            it = m_containers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return *this;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROWBITMAP_H
+#define ROWBITMAP_H
+
+#include <QBitArray>
+#include <QMap>
+#include <QVector>
+
+// A compressed set of model rows, built like a roaring bitmap: rows are split into
+// containers of 65536 by their upper 16 bits. A container holding few rows keeps them as
+// a sorted array, a fuller one as a plain bitmap. So a tag on a handful of notes takes a
+// few bytes, and a notebook holding most of them one bit per note.
+//
+// Besides the set operations, rows can be removed the way a model removes them, moving
+// all rows after them up by one.
+class RowBitmap
+{
+public:
+    RowBitmap();
+
+    // All rows from 0 to count - 1
+    static RowBitmap filled(quint32 count);
+
+    bool isEmpty() const;
+    int count() const;
+    bool contains(quint32 row) const;
+    void insert(quint32 row);
+    void remove(quint32 row);
+    // Removes row and moves all rows after it up by one
+    void removeRow(quint32 row);
+    // All rows in ascending order
+    QVector<quint32> rows() const;
+    // A flat bit for each of the first size rows, for testing lots of single rows
+    QBitArray toBitArray(int size) const;
+
+    RowBitmap &operator&=(const RowBitmap &other);
+    RowBitmap &operator|=(const RowBitmap &other);
+    RowBitmap &operator-=(const RowBitmap &other);
+
+private:
+    struct Container {
+        Container();
+
+        bool contains(quint16 value) const;
+        void insert(quint16 value);
+        void remove(quint16 value);
+        // Removes value and moves all values above it down by one
+        void removeAndShift(quint16 value);
+
+        void intersect(const Container &other);
+        void unite(const Container &other);
+        void subtract(const Container &other);
+
+        void toBitmap();
+        // Goes back to an array once there are few enough values
+        void optimize();
+
+        // Either a sorted array, or a bitmap of 1024 words if that's not empty
+        QVector<quint16> array;
+        QVector<quint64> bitmap;
+        int count;
+    };
+
+private:
+    QMap<quint16, Container> m_containers;
+};
+
+#endif // ROWBITMAP_H
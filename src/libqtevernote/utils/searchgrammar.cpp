@@ -0,0 +1,238 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "searchgrammar.h"
+#include "logging.h"
+
+#include <QRegExp>
+
+SearchGrammar::Term::Term():
+    type(TypeWords),
+    negated(false),
+    phrase(false)
+{
+}
+
+SearchGrammar::SearchGrammar(const QString &query, const QDateTime &now)
+{
+    int i = 0;
+    while (i < query.length()) {
+        if (query.at(i).isSpace()) {
+            i++;
+            continue;
+        }
+
+        bool negated = false;
+        if (query.at(i) == '-') {
+            negated = true;
+            i++;
+        }
+
+        // A term ends at the next space which isn't quoted
+        QString token;
+        int quoteStart = -1;
+        bool quoted = false;
+        for (; i < query.length() && (quoted || !query.at(i).isSpace()); i++) {
+            if (query.at(i) == '"') {
+                quoted = !quoted;
+                if (quoteStart < 0) {
+                    quoteStart = token.length();
+                }
+            } else {
+                token.append(query.at(i));
+            }
+        }
+        addTerm(token, quoteStart, negated, now);
+    }
+}
+
+QList<SearchGrammar::Term> SearchGrammar::terms() const
+{
+    return m_terms;
+}
+
+QString SearchGrammar::words() const
+{
+    QStringList words;
+    foreach (const Term &term, m_terms) {
+        if (term.type == TypeWords && !term.negated) {
+            words.append(term.value);
+        }
+    }
+    return words.join(' ');
+}
+
+QStringList SearchGrammar::excludedWords() const
+{
+    QStringList words;
+    foreach (const Term &term, m_terms) {
+        if (term.type == TypeWords && term.negated && !term.phrase) {
+            words.append(term.value);
+        }
+    }
+    return words;
+}
+
+QStringList SearchGrammar::phrases() const
+{
+    QStringList phrases;
+    foreach (const Term &term, m_terms) {
+        if (term.type == TypeWords && !term.negated && term.phrase) {
+            phrases.append(term.value);
+        }
+    }
+    return phrases;
+}
+
+QStringList SearchGrammar::excludedPhrases() const
+{
+    QStringList phrases;
+    foreach (const Term &term, m_terms) {
+        if (term.type == TypeWords && term.negated && term.phrase) {
+            phrases.append(term.value);
+        }
+    }
+    return phrases;
+}
+
+bool SearchGrammar::isPlain() const
+{
+    foreach (const Term &term, m_terms) {
+        if (term.type != TypeWords || term.negated || term.phrase) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SearchGrammar::hasFilters() const
+{
+    foreach (const Term &term, m_terms) {
+        if (term.type != TypeWords) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SearchGrammar::endsWithWord() const
+{
+    if (m_terms.isEmpty()) {
+        return false;
+    }
+    const Term &term = m_terms.last();
+    return term.type == TypeWords && !term.phrase && !term.value.endsWith('*');
+}
+
+bool SearchGrammar::matches(const QString &pattern, const QString &value)
+{
+    if (pattern.endsWith('*')) {
+        return value.startsWith(pattern.left(pattern.length() - 1), Qt::CaseInsensitive);
+    }
+    return value.compare(pattern, Qt::CaseInsensitive) == 0;
+}
+
+void SearchGrammar::addTerm(const QString &token, int quoteStart, bool negated, const QDateTime &now)
+{
+    Term term;
+    term.negated = negated;
+    term.phrase = quoteStart >= 0;
+    term.value = token;
+
+    // A quoted colon doesn't make a keyword: "note:" is a word
+    int colon = token.indexOf(':');
+    if (colon > 0 && (quoteStart < 0 || colon < quoteStart)) {
+        QString key = token.left(colon).toLower();
+        QString value = token.mid(colon + 1);
+        Type type = TypeWords;
+        if (key == "notebook") {
+            type = TypeNotebook;
+        } else if (key == "tag") {
+            type = TypeTag;
+        } else if (key == "created") {
+            type = TypeCreated;
+        } else if (key == "updated") {
+            type = TypeUpdated;
+        } else if (key == "reminderorder" || key == "reminder") {
+            type = TypeReminderOrder;
+        } else if (key == "remindertime") {
+            type = TypeReminderTime;
+        } else if (key == "reminderdonetime") {
+            type = TypeReminderDoneTime;
+        } else if (key == "todo") {
+            type = TypeTodo;
+            value = value.toLower();
+        } else if (key == "resource") {
+            type = TypeResource;
+        }
+
+        bool valid = !value.isEmpty();
+        if (type == TypeCreated || type == TypeUpdated || type == TypeReminderTime || type == TypeReminderDoneTime) {
+            term.time = parseDate(value, now);
+            valid = term.time.isValid() || value == "*";
+        } else if (type == TypeReminderOrder) {
+            valid = value == "*";
+        } else if (type == TypeTodo) {
+            valid = value == "true" || value == "false" || value == "*";
+        }
+
+        if (type != TypeWords && valid) {
+            term.type = type;
+            term.phrase = false;
+            term.value = value;
+        } else if (type != TypeWords) {
+            qCDebug(dcNotesStore) << "Searching for" << token << "as words, it's not a valid" << key << "term";
+        }
+    }
+
+    // Like a lone "-" while typing
+    if (term.value.isEmpty()) {
+        return;
+    }
+    m_terms.append(term);
+}
+
+QDateTime SearchGrammar::parseDate(const QString &value, const QDateTime &now)
+{
+    QRegExp relative("(day|week|month|year)(-(\\d+))?", Qt::CaseInsensitive);
+    if (relative.exactMatch(value)) {
+        QString unit = relative.cap(1).toLower();
+        int count = relative.cap(3).toInt();
+        QDate today = now.date();
+        QDate start;
+        if (unit == "day") {
+            start = today.addDays(-count);
+        } else if (unit == "week") {
+            // Weeks start on sunday, like on the server
+            start = today.addDays(-(today.dayOfWeek() % 7) - 7 * count);
+        } else if (unit == "month") {
+            start = QDate(today.year(), today.month(), 1).addMonths(-count);
+        } else {
+            start = QDate(today.year(), 1, 1).addYears(-count);
+        }
+        return QDateTime(start, QTime(0, 0));
+    }
+
+    QRegExp absolute("(\\d{8})(T(\\d{6})(Z?))?", Qt::CaseInsensitive);
+    if (absolute.exactMatch(value)) {
+        QDate date = QDate::fromString(absolute.cap(1), "yyyyMMdd");
+        QTime time = absolute.cap(3).isEmpty() ? QTime(0, 0) : QTime::fromString(absolute.cap(3), "HHmmss");
+        return QDateTime(date, time, absolute.cap(4).isEmpty() ? Qt::LocalTime : Qt::UTC);
+    }
+    return QDateTime();
+}
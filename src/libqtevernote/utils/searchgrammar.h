@@ -0,0 +1,102 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCHGRAMMAR_H
+#define SEARCHGRAMMAR_H
+
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// A search query in Evernote's search grammar, taken apart so it can be answered from
+// the cache while we're offline. The server gets the query as it is.
+//
+// Understood are words, "quoted phrases", notebook:, tag:, created:, updated:,
+// reminderOrder: (or reminder: for short), reminderTime:, reminderDoneTime:, todo: and
+// resource:. Each of them can be negated with a leading "-". Anything else is taken as
+// words, as it was before. The words of a phrase have to follow each other in the
+// content of a note, or all be in its title.
+//
+// Dates are either absolute, like 20160131, 20160131T235900 or 20160131T235900Z for UTC,
+// or relative to today: day, week, month and year, optionally followed by the number of
+// them to go back, like week-2. A date term matches from that time on, a negated one
+// matches everything before.
+class SearchGrammar
+{
+public:
+    enum Type {
+        TypeWords,
+        TypeNotebook,
+        TypeTag,
+        TypeCreated,
+        TypeUpdated,
+        TypeReminderOrder,
+        TypeReminderTime,
+        TypeReminderDoneTime,
+        TypeTodo,
+        TypeResource
+    };
+
+    struct Term {
+        Term();
+
+        Type type;
+        bool negated;
+        // Whether the words were quoted
+        bool phrase;
+        // The words, the notebook or tag name, true or false for todos or the mime type
+        // of a resource. A value ending in "*" matches anything starting with the rest.
+        QString value;
+        // Where the range of a date term starts. Invalid if the value is "*", which matches
+        // any note having that date at all.
+        QDateTime time;
+    };
+
+    explicit SearchGrammar(const QString &query, const QDateTime &now = QDateTime::currentDateTime());
+
+    QList<Term> terms() const;
+
+    // The words every matching note contains
+    QString words() const;
+    // Words no matching note contains
+    QStringList excludedWords() const;
+    // Phrases every matching note contains. Their words are part of words() as well.
+    QStringList phrases() const;
+    // Phrases no matching note contains
+    QStringList excludedPhrases() const;
+
+    // Whether there's nothing in the query but words
+    bool isPlain() const;
+    // Whether the query has terms other than words
+    bool hasFilters() const;
+    // Whether the query ends in a word that may still be incomplete
+    bool endsWithWord() const;
+
+    // Whether value matches pattern, which may end in "*", ignoring case
+    static bool matches(const QString &pattern, const QString &value);
+
+private:
+    void addTerm(const QString &token, int quoteStart, bool negated, const QDateTime &now);
+    static QDateTime parseDate(const QString &value, const QDateTime &now);
+
+private:
+    QList<Term> m_terms;
+};
+
+#endif // SEARCHGRAMMAR_H
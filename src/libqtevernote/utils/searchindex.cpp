@@ -0,0 +1,1257 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "searchindex.h"
+#include "logging.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QReadLocker>
+#include <QtMath>
+#include <QSaveFile>
+#include <QSet>
+#include <QWriteLocker>
+
+#include <algorithm>
+
+// Longer words are cut off. Nobody searches for them and they're mostly urls or base64.
+#define MAX_TERM_LENGTH 64
+// The live segment is written as a segment of its own once it holds this many notes
+#define LIVE_SEGMENT_SIZE 128
+// Segments are merged when there are more than this
+#define MAX_SEGMENTS 8
+
+// Ranking parameters. Words in the title count this many times as much as in the content.
+#define TITLE_WEIGHT 3
+#define BM25_K1 1.2
+#define BM25_B 0.75
+
+// Positions kept for each term of a note's content. Enough to find a good snippet.
+#define MAX_POSITIONS 64
+// Snippets are about this many characters long and start a little before the first match
+#define SNIPPET_LENGTH 160
+#define SNIPPET_CONTEXT 40
+
+// Attribute terms. The colon keeps them apart from anything tokenize() produces.
+#define TODO_CHECKED "todo:true"
+#define TODO_UNCHECKED "todo:false"
+
+#define MANIFEST_FILE "manifest"
+#define MANIFEST_MAGIC 0x524e534d // "RNSM"
+#define MANIFEST_VERSION 1
+#define MANIFEST_HEADER_SIZE 16
+
+SearchIndex::SearchIndex(QObject *parent):
+    QObject(parent),
+    m_lock(QReadWriteLock::Recursive),
+    m_nextSegmentId(0),
+    m_dirty(false),
+    m_generation(0),
+    m_totalLength(0),
+    m_merger(nullptr)
+{
+}
+
+SearchIndex::~SearchIndex()
+{
+    close();
+}
+
+// Manifest layout (all integers big endian):
+// Header: quint32 magic, quint16 version, quint32 segment count, quint32 data length,
+//         quint16 checksum (over the data)
+// Data:   quint32 next segment id, file name and QBitArray of deleted notes for each
+//         segment, the live segment's contents as QByteArray
+void SearchIndex::open(const QString &directory)
+{
+    QWriteLocker locker(&m_lock);
+    close();
+    m_directory = directory;
+    QDir().mkpath(directory);
+
+    QFile file(directory + MANIFEST_FILE);
+    if (!file.exists()) {
+        removeUnusedFiles();
+        return;
+    }
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(dcStorage) << "Cannot open search index manifest" << file.fileName() << file.errorString();
+        return;
+    }
+    QByteArray data = file.readAll();
+
+    QDataStream headerStream(data);
+    quint32 magic;
+    quint16 version;
+    quint32 segmentCount;
+    quint32 length;
+    quint16 checksum;
+    headerStream >> magic >> version >> segmentCount >> length >> checksum;
+    bool valid = headerStream.status() == QDataStream::Ok && magic == MANIFEST_MAGIC && version == MANIFEST_VERSION
+            && data.length() - MANIFEST_HEADER_SIZE == (int)length
+            && qChecksum(data.constData() + MANIFEST_HEADER_SIZE, length) == checksum;
+
+    QDataStream stream(data.mid(MANIFEST_HEADER_SIZE));
+    quint32 nextSegmentId = 0;
+    stream >> nextSegmentId;
+    for (quint32 i = 0; i < segmentCount && valid; i++) {
+        QString fileName;
+        QBitArray deletions;
+        stream >> fileName >> deletions;
+        QSharedPointer<SearchSegment> segment(new SearchSegment);
+        valid = stream.status() == QDataStream::Ok && segment->read(directory + fileName) && deletions.size() == segment->count();
+        m_segments.append(segment);
+        m_deletions.append(deletions);
+    }
+    QByteArray liveData;
+    stream >> liveData;
+    SearchSegment liveSegment;
+    valid &= stream.status() == QDataStream::Ok && (liveData.isEmpty() || liveSegment.load(liveData));
+
+    if (!valid) {
+        // Everything will be indexed again
+        qCWarning(dcStorage) << "Search index in" << directory << "is damaged. Starting over.";
+        clear();
+        file.remove();
+        removeUnusedFiles();
+        return;
+    }
+
+    m_nextSegmentId = nextSegmentId;
+    for (int segment = 0; segment < m_segments.count(); segment++) {
+        for (int document = 0; document < m_segments.at(segment)->count(); document++) {
+            if (m_deletions.at(segment).testBit(document)) {
+                continue;
+            }
+            QString guid = m_segments.at(segment)->guid(document);
+            if (m_locations.contains(guid)) {
+                Location older = m_locations.value(guid);
+                m_deletions[older.segment].setBit(older.document);
+            }
+            Location location;
+            location.segment = segment;
+            location.document = document;
+            m_locations.insert(guid, location);
+        }
+    }
+    for (int document = 0; document < liveSegment.count(); document++) {
+        addLiveDocument(liveSegment.document(document));
+    }
+    m_totalLength = 0;
+    foreach (const Location &location, m_locations) {
+        m_totalLength += documentLength(location);
+    }
+    removeUnusedFiles();
+
+    qCDebug(dcStorage) << "Opened search index with" << m_locations.count() << "notes in" << m_segments.count() << "segments";
+}
+
+void SearchIndex::close()
+{
+    QWriteLocker locker(&m_lock);
+    if (m_merger) {
+        m_merger->disconnect(this);
+        m_merger->wait();
+        QFile::remove(m_merger->targetFileName());
+        delete m_merger;
+        m_merger = nullptr;
+    }
+    clear();
+    m_directory.clear();
+}
+
+void SearchIndex::commit()
+{
+    QWriteLocker locker(&m_lock);
+    if (m_directory.isEmpty() || !m_dirty) {
+        return;
+    }
+
+    if (m_liveDocuments.count() - m_freeIds.count() >= LIVE_SEGMENT_SIZE) {
+        freezeLiveSegment();
+    }
+    if (writeManifest()) {
+        m_dirty = false;
+    }
+    mergeIfNeeded();
+}
+
+void SearchIndex::setTitle(const QString &guid, const QString &title)
+{
+    setField(guid, SearchSegment::FieldTitle, title);
+}
+
+void SearchIndex::setContent(const QString &guid, const QString &plaintext)
+{
+    setField(guid, SearchSegment::FieldContent, plaintext);
+}
+
+void SearchIndex::setRecognition(const QString &guid, const QString &text)
+{
+    setField(guid, SearchSegment::FieldRecognition, text);
+}
+
+void SearchIndex::setTodos(const QString &guid, const QList<bool> &todos)
+{
+    QHash<QString, quint16> terms;
+    foreach (bool checked, todos) {
+        terms.insert(checked ? TODO_CHECKED : TODO_UNCHECKED, 1);
+    }
+    setTerms(guid, SearchSegment::FieldAttributes, terms);
+}
+
+void SearchIndex::setUpdateSequenceNumber(const QString &guid, qint32 updateSequenceNumber)
+{
+    if (guid.isEmpty()) {
+        return;
+    }
+    QWriteLocker locker(&m_lock);
+    QHash<QString, Location>::const_iterator location = m_locations.constFind(guid);
+    if (location != m_locations.constEnd()) {
+        qint32 current = location.value().segment < 0 ? m_liveDocuments.at(location.value().document).updateSequenceNumber
+                                                       : m_segments.at(location.value().segment)->updateSequenceNumber(location.value().document);
+        if (current == updateSequenceNumber) {
+            return;
+        }
+    }
+    quint32 id = liveDocument(guid);
+    m_liveDocuments[id].updateSequenceNumber = updateSequenceNumber;
+    m_dirty = true;
+}
+
+void SearchIndex::removeNote(const QString &guid)
+{
+    QWriteLocker locker(&m_lock);
+    if (!m_locations.contains(guid)) {
+        return;
+    }
+    Location location = m_locations.take(guid);
+    if (location.segment < 0) {
+        removeLiveDocument(location.document);
+    } else {
+        m_totalLength -= documentLength(location);
+        m_deletions[location.segment].setBit(location.document);
+    }
+    m_dirty = true;
+    m_generation++;
+}
+
+void SearchIndex::renameNote(const QString &oldGuid, const QString &newGuid)
+{
+    QWriteLocker locker(&m_lock);
+    if (oldGuid == newGuid || !m_locations.contains(oldGuid)) {
+        return;
+    }
+    removeNote(newGuid);
+    // Segments can't change, so the note has to move to the live segment
+    quint32 id = liveDocument(oldGuid);
+    m_liveDocuments[id].guid = newGuid;
+    m_locations.insert(newGuid, m_locations.take(oldGuid));
+    m_dirty = true;
+    m_generation++;
+}
+
+bool SearchIndex::contains(const QString &guid) const
+{
+    QReadLocker locker(&m_lock);
+    return m_locations.contains(guid);
+}
+
+qint32 SearchIndex::updateSequenceNumber(const QString &guid) const
+{
+    QReadLocker locker(&m_lock);
+    if (!m_locations.contains(guid)) {
+        return -1;
+    }
+    Location location = m_locations.value(guid);
+    if (location.segment < 0) {
+        return m_liveDocuments.at(location.document).updateSequenceNumber;
+    }
+    return m_segments.at(location.segment)->updateSequenceNumber(location.document);
+}
+
+QStringList SearchIndex::guids() const
+{
+    QReadLocker locker(&m_lock);
+    return m_locations.keys();
+}
+
+int SearchIndex::count() const
+{
+    QReadLocker locker(&m_lock);
+    return m_locations.count();
+}
+
+quint64 SearchIndex::generation() const
+{
+    return m_generation;
+}
+
+QSet<QString> SearchIndex::notesWithTodos(bool checked) const
+{
+    QString term = checked ? TODO_CHECKED : TODO_UNCHECKED;
+    QSet<QString> guids;
+
+    Snapshot snapshot;
+    {
+        QReadLocker locker(&m_lock);
+        snapshot = this->snapshot();
+    }
+    foreach (const SearchSegment::Posting &posting, snapshot.livePostings.value(term)) {
+        guids.insert(snapshot.liveDocuments.at(posting.document).guid);
+    }
+    for (int segment = 0; segment < snapshot.segments.count(); segment++) {
+        const QBitArray &deletions = snapshot.deletions.at(segment);
+        foreach (const SearchSegment::Posting &posting, snapshot.segments.at(segment)->postings().value(term)) {
+            if (!deletions.testBit(posting.document)) {
+                guids.insert(snapshot.segments.at(segment)->guid(posting.document));
+            }
+        }
+    }
+    return guids;
+}
+
+QHash<QString, qreal> SearchIndex::search(const QString &query) const
+{
+    return search(query, nullptr, nullptr);
+}
+
+QHash<QString, qreal> SearchIndex::search(const QString &query, const QSet<QString> *candidates, const QAtomicInt *cancelled) const
+{
+    QHash<QString, qreal> results;
+    QStringList words = tokenize(query);
+    if (words.isEmpty()) {
+        return results;
+    }
+
+    Snapshot snapshot;
+    QSet<quint64> candidateKeys;
+    {
+        QReadLocker locker(&m_lock);
+        snapshot = this->snapshot();
+        if (candidates) {
+            foreach (const QString &guid, *candidates) {
+                QHash<QString, Location>::const_iterator location = m_locations.constFind(guid);
+                if (location != m_locations.constEnd()) {
+                    candidateKeys.insert(key(location.value()));
+                }
+            }
+        }
+    }
+    if (candidates && candidateKeys.isEmpty()) {
+        return results;
+    }
+
+    qreal averageLength = SearchIndex::averageLength(snapshot);
+    QHash<quint64, qreal> scores = matches(snapshot, words.takeFirst(), averageLength, candidates ? &candidateKeys : nullptr, cancelled);
+    foreach (const QString &word, words) {
+        if (scores.isEmpty()) {
+            break;
+        }
+        QHash<quint64, qreal> wordScores = matches(snapshot, word, averageLength, candidates ? &candidateKeys : nullptr, cancelled);
+        QHash<quint64, qreal>::iterator it = scores.begin();
+        while (it != scores.end()) {
+            QHash<quint64, qreal>::const_iterator match = wordScores.constFind(it.key());
+            if (match == wordScores.constEnd()) {
+                it = scores.erase(it);
+            } else {
+                it.value() += match.value();
+                ++it;
+            }
+        }
+    }
+    if (cancelled && cancelled->load()) {
+        return results;
+    }
+
+    results.reserve(scores.count());
+    QHash<quint64, qreal>::const_iterator it = scores.constBegin();
+    for (; it != scores.constEnd(); ++it) {
+        results.insert(guid(snapshot, it.key()), it.value());
+    }
+    return results;
+}
+
+bool SearchIndex::containsPhrase(const QString &guid, const QString &phrase) const
+{
+    QStringList words = tokenize(phrase);
+    SearchSegment::Document document;
+    if (!this->document(guid, &document)) {
+        return false;
+    }
+    if (words.count() < 2) {
+        return true;
+    }
+
+    // Lay out the terms of the content in the order they appear
+    QVector<QPair<quint32, QString> > terms;
+    QHash<QString, QVector<quint32> >::const_iterator it = document.positions.constBegin();
+    for (; it != document.positions.constEnd(); ++it) {
+        foreach (quint32 position, it.value()) {
+            terms.append(qMakePair(position, it.key()));
+        }
+    }
+    std::sort(terms.begin(), terms.end());
+    for (int start = 0; start + words.count() <= terms.count(); start++) {
+        int word = 0;
+        while (word < words.count() && termMatches(terms.at(start + word).second, words.at(word))) {
+            word++;
+        }
+        if (word == words.count()) {
+            return true;
+        }
+    }
+
+    const QHash<QString, quint16> &titleTerms = document.terms[SearchSegment::FieldTitle];
+    foreach (const QString &word, words) {
+        bool found = false;
+        QHash<QString, quint16>::const_iterator term = titleTerms.constBegin();
+        for (; term != titleTerms.constEnd() && !found; ++term) {
+            found = termMatches(term.key(), word);
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The snippet shows the part of the content where most of the different words are close
+// together, preferring the first such part.
+QString SearchIndex::snippet(const QString &guid, const QString &query) const
+{
+    QStringList words = tokenize(query);
+    if (words.isEmpty()) {
+        return QString();
+    }
+
+    SearchSegment::Document document;
+    if (!this->document(guid, &document)) {
+        return QString();
+    }
+
+    QVector<Occurrence> occurrences;
+    QHash<QString, QVector<quint32> >::const_iterator it = document.positions.constBegin();
+    for (; it != document.positions.constEnd(); ++it) {
+        for (int word = 0; word < words.count(); word++) {
+            if (!termMatches(it.key(), words.at(word))) {
+                continue;
+            }
+            foreach (quint32 position, it.value()) {
+                Occurrence occurrence;
+                occurrence.position = position;
+                occurrence.length = it.key().length();
+                occurrence.word = word;
+                occurrences.append(occurrence);
+            }
+            break;
+        }
+    }
+    if (occurrences.isEmpty()) {
+        return QString();
+    }
+    std::sort(occurrences.begin(), occurrences.end(), occurrenceLessThan);
+
+    // Slide a window of SNIPPET_LENGTH over the occurrences, counting the words in it
+    int best = 0;
+    int bestWords = 0;
+    QHash<int, int> windowWords;
+    int end = 0;
+    for (int start = 0; start < occurrences.count(); start++) {
+        quint32 windowEnd = occurrences.at(start).position + SNIPPET_LENGTH;
+        while (end < occurrences.count() && (end <= start || occurrences.at(end).position + occurrences.at(end).length <= windowEnd)) {
+            windowWords[occurrences.at(end).word]++;
+            end++;
+        }
+        if (windowWords.count() > bestWords) {
+            bestWords = windowWords.count();
+            best = start;
+        }
+        if (--windowWords[occurrences.at(start).word] == 0) {
+            windowWords.remove(occurrences.at(start).word);
+        }
+    }
+
+    // Cut at word boundaries, keeping all of the first match
+    const QString &text = document.text;
+    int first = occurrences.at(best).position;
+    int from = qMax(0, first - SNIPPET_CONTEXT);
+    while (from > 0 && from < first && !text.at(from - 1).isSpace()) {
+        from++;
+    }
+    int to = qMin(text.length(), from + SNIPPET_LENGTH);
+    int minimumTo = qMin(text.length(), first + (int)occurrences.at(best).length);
+    while (to < text.length() && to > minimumTo && !text.at(to).isSpace()) {
+        to--;
+    }
+
+    QString snippet;
+    if (from > 0) {
+        snippet.append(QChar(0x2026));
+    }
+    int position = from;
+    for (int i = best; i < occurrences.count(); i++) {
+        const Occurrence &occurrence = occurrences.at(i);
+        if ((int)occurrence.position < position) {
+            continue;
+        }
+        if ((int)(occurrence.position + occurrence.length) > to) {
+            break;
+        }
+        snippet.append(text.mid(position, occurrence.position - position).toHtmlEscaped());
+        snippet.append("<b>" + text.mid(occurrence.position, occurrence.length).toHtmlEscaped() + "</b>");
+        position = occurrence.position + occurrence.length;
+    }
+    snippet.append(text.mid(position, to - position).toHtmlEscaped());
+    if (to < text.length()) {
+        snippet.append(QChar(0x2026));
+    }
+    return snippet.simplified();
+}
+
+QStringList SearchIndex::tokenize(const QString &text, QVector<quint32> *positions)
+{
+    QStringList terms;
+    QString term;
+    for (int i = 0; i < text.length(); i++) {
+        const QChar &c = text.at(i);
+        if (c.isLetterOrNumber()) {
+            if (term.isEmpty() && positions) {
+                positions->append(i);
+            }
+            if (term.length() < MAX_TERM_LENGTH) {
+                term.append(c.toLower());
+            }
+        } else if (!term.isEmpty()) {
+            terms.append(term);
+            term.clear();
+        }
+    }
+    if (!term.isEmpty()) {
+        terms.append(term);
+    }
+    return terms;
+}
+
+bool SearchIndex::refines(const QString &query, const QString &previousQuery)
+{
+    if (previousQuery.isEmpty() || !query.startsWith(previousQuery)) {
+        return false;
+    }
+    // Words shorter than a trigram only match the start of terms. Once they grow longer
+    // they match anywhere, which can find notes that didn't match before.
+    QStringList previousWords = tokenize(previousQuery);
+    QStringList words = tokenize(query);
+    for (int i = 0; i < previousWords.count(); i++) {
+        if (previousWords.at(i).length() < 3 && words.at(i) != previousWords.at(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SearchIndex::mergeFinished()
+{
+    QWriteLocker locker(&m_lock);
+    SearchIndexMerger *merger = m_merger;
+    m_merger = nullptr;
+    merger->deleteLater();
+
+    QSharedPointer<SearchSegment> merged(new SearchSegment);
+    if (!merger->success() || !merged->read(merger->targetFileName())) {
+        qCWarning(dcStorage) << "Merging search index segments failed.";
+        QFile::remove(merger->targetFileName());
+        return;
+    }
+
+    QHash<QString, quint32> mergedIds;
+    for (int document = 0; document < merged->count(); document++) {
+        mergedIds.insert(merged->guid(document), document);
+    }
+
+    // The merged segments are still the first ones. Carry over what has been deleted
+    // from them while merging.
+    int mergedCount = merger->segments().count();
+    QList<QBitArray> mergedDeletions = merger->deletions();
+    QBitArray deletions(merged->count());
+    QStringList oldFileNames;
+    for (int segment = 0; segment < mergedCount; segment++) {
+        const QBitArray &now = m_deletions.at(segment);
+        for (int document = 0; document < now.size(); document++) {
+            if (now.testBit(document) && !mergedDeletions.at(segment).testBit(document)) {
+                deletions.setBit(mergedIds.value(m_segments.at(segment)->guid(document)));
+            }
+        }
+        oldFileNames.append(m_segments.at(segment)->fileName());
+    }
+    for (int segment = 0; segment < mergedCount; segment++) {
+        m_segments.removeFirst();
+        m_deletions.removeFirst();
+    }
+    m_segments.prepend(merged);
+    m_deletions.prepend(deletions);
+
+    QHash<QString, Location>::iterator it = m_locations.begin();
+    for (; it != m_locations.end(); ++it) {
+        Location &location = it.value();
+        if (location.segment < 0) {
+            continue;
+        }
+        if (location.segment < mergedCount) {
+            location.segment = 0;
+            location.document = mergedIds.value(it.key());
+        } else {
+            location.segment -= mergedCount - 1;
+        }
+    }
+    qCDebug(dcStorage) << "Merged" << mergedCount << "search index segments into one with" << merged->count() << "notes";
+
+    // The old segments are needed until the manifest doesn't point to them any more
+    m_dirty = true;
+    if (writeManifest()) {
+        m_dirty = false;
+        foreach (const QString &fileName, oldFileNames) {
+            QFile::remove(fileName);
+        }
+    }
+    mergeIfNeeded();
+}
+
+SearchIndex::Snapshot SearchIndex::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.segments = m_segments;
+    snapshot.deletions = m_deletions;
+    snapshot.liveDocuments = m_liveDocuments;
+    snapshot.livePostings = m_livePostings;
+    snapshot.liveTrigrams = m_liveTrigrams;
+    snapshot.count = m_locations.count();
+    snapshot.totalLength = m_totalLength;
+    return snapshot;
+}
+
+void SearchIndex::clear()
+{
+    m_generation++;
+    m_nextSegmentId = 0;
+    m_dirty = false;
+    m_segments.clear();
+    m_deletions.clear();
+    m_locations.clear();
+    m_totalLength = 0;
+    m_liveDocuments.clear();
+    m_freeIds.clear();
+    m_livePostings.clear();
+    m_liveTrigrams.clear();
+}
+
+bool SearchIndex::document(const QString &guid, SearchSegment::Document *document) const
+{
+    QSharedPointer<SearchSegment> segment;
+    quint32 id;
+    {
+        QReadLocker locker(&m_lock);
+        QHash<QString, Location>::const_iterator location = m_locations.constFind(guid);
+        if (location == m_locations.constEnd()) {
+            return false;
+        }
+        if (location.value().segment < 0) {
+            *document = m_liveDocuments.at(location.value().document);
+            return true;
+        }
+        segment = m_segments.at(location.value().segment);
+        id = location.value().document;
+    }
+    // Segments never change, so reading their term vectors doesn't need the lock
+    *document = segment->document(id);
+    return true;
+}
+
+quint32 SearchIndex::liveDocument(const QString &guid)
+{
+    if (m_locations.contains(guid)) {
+        Location location = m_locations.value(guid);
+        if (location.segment < 0) {
+            return location.document;
+        }
+        addLiveDocument(m_segments.at(location.segment)->document(location.document));
+    } else {
+        SearchSegment::Document document;
+        document.guid = guid;
+        addLiveDocument(document);
+    }
+    return m_locations.value(guid).document;
+}
+
+void SearchIndex::addLiveDocument(const SearchSegment::Document &document)
+{
+    if (m_locations.contains(document.guid)) {
+        Location location = m_locations.value(document.guid);
+        if (location.segment < 0) {
+            removeLiveDocument(location.document);
+        } else {
+            m_totalLength -= documentLength(location);
+            m_deletions[location.segment].setBit(location.document);
+        }
+    }
+    m_totalLength += documentLength(document);
+
+    quint32 id;
+    if (!m_freeIds.isEmpty()) {
+        id = m_freeIds.takeLast();
+        m_liveDocuments[id] = document;
+    } else {
+        id = m_liveDocuments.count();
+        m_liveDocuments.append(document);
+    }
+    for (int field = 0; field < SearchSegment::FieldCount; field++) {
+        QHash<QString, quint16>::const_iterator it = document.terms[field].constBegin();
+        for (; it != document.terms[field].constEnd(); ++it) {
+            updatePosting(it.key(), id, (SearchSegment::Field)field, it.value());
+        }
+    }
+
+    Location location;
+    location.segment = -1;
+    location.document = id;
+    m_locations.insert(document.guid, location);
+}
+
+void SearchIndex::removeLiveDocument(quint32 document)
+{
+    m_totalLength -= documentLength(m_liveDocuments.at(document));
+    for (int field = 0; field < SearchSegment::FieldCount; field++) {
+        foreach (const QString &term, m_liveDocuments.at(document).terms[field].keys()) {
+            updatePosting(term, document, (SearchSegment::Field)field, 0);
+        }
+    }
+    m_liveDocuments[document] = SearchSegment::Document();
+    m_freeIds.append(document);
+}
+
+void SearchIndex::setField(const QString &guid, SearchSegment::Field field, const QString &text)
+{
+    QVector<quint32> offsets;
+    QStringList tokens = tokenize(text, &offsets);
+    QHash<QString, quint16> terms;
+    QHash<QString, QVector<quint32> > positions;
+    for (int i = 0; i < tokens.count(); i++) {
+        quint16 &frequency = terms[tokens.at(i)];
+        if (frequency < 0xffff) {
+            frequency++;
+        }
+        if (field == SearchSegment::FieldContent) {
+            QVector<quint32> &termPositions = positions[tokens.at(i)];
+            if (termPositions.count() < MAX_POSITIONS) {
+                termPositions.append(offsets.at(i));
+            }
+        }
+    }
+
+    QWriteLocker locker(&m_lock);
+    setTerms(guid, field, terms);
+    if (field == SearchSegment::FieldContent && !guid.isEmpty()) {
+        SearchSegment::Document &document = m_liveDocuments[m_locations.value(guid).document];
+        document.text = text;
+        document.positions = positions;
+    }
+}
+
+void SearchIndex::setTerms(const QString &guid, SearchSegment::Field field, const QHash<QString, quint16> &terms)
+{
+    if (guid.isEmpty()) {
+        return;
+    }
+    QWriteLocker locker(&m_lock);
+    quint32 id = liveDocument(guid);
+    qreal oldLength = documentLength(m_liveDocuments.at(id));
+
+    // Only touch the posting lists of terms that actually changed
+    const QHash<QString, quint16> &oldTerms = m_liveDocuments.at(id).terms[field];
+    QHash<QString, quint16>::const_iterator it;
+    for (it = oldTerms.constBegin(); it != oldTerms.constEnd(); ++it) {
+        if (!terms.contains(it.key())) {
+            updatePosting(it.key(), id, field, 0);
+        }
+    }
+    for (it = terms.constBegin(); it != terms.constEnd(); ++it) {
+        if (oldTerms.value(it.key()) != it.value()) {
+            updatePosting(it.key(), id, field, it.value());
+        }
+    }
+    m_liveDocuments[id].terms[field] = terms;
+    m_totalLength += documentLength(m_liveDocuments.at(id)) - oldLength;
+    m_dirty = true;
+    m_generation++;
+}
+
+void SearchIndex::updatePosting(const QString &term, quint32 document, SearchSegment::Field field, quint16 frequency)
+{
+    SearchSegment::Postings::iterator it = m_livePostings.find(term);
+    if (it == m_livePostings.end()) {
+        if (frequency == 0) {
+            return;
+        }
+        it = m_livePostings.insert(term, QVector<SearchSegment::Posting>());
+        foreach (quint64 trigram, SearchSegment::trigrams(term)) {
+            m_liveTrigrams[trigram].insert(term);
+        }
+    }
+
+    QVector<SearchSegment::Posting> &postings = it.value();
+    QVector<SearchSegment::Posting>::iterator posting = std::lower_bound(postings.begin(), postings.end(), document, postingLessThan);
+    if (posting == postings.end() || posting->document != document) {
+        if (frequency == 0) {
+            return;
+        }
+        SearchSegment::Posting newPosting;
+        newPosting.document = document;
+        newPosting.frequency[field] = frequency;
+        postings.insert(posting, newPosting);
+        return;
+    }
+
+    posting->frequency[field] = frequency;
+    for (int i = 0; i < SearchSegment::FieldCount; i++) {
+        if (posting->frequency[i] > 0) {
+            return;
+        }
+    }
+    postings.erase(posting);
+    if (postings.isEmpty()) {
+        m_livePostings.erase(it);
+        foreach (quint64 trigram, SearchSegment::trigrams(term)) {
+            QSet<QString> &terms = m_liveTrigrams[trigram];
+            terms.remove(term);
+            if (terms.isEmpty()) {
+                m_liveTrigrams.remove(trigram);
+            }
+        }
+    }
+}
+
+QStringList SearchIndex::matchingLiveTerms(const Snapshot &snapshot, const QString &text)
+{
+    QStringList terms;
+    if (text.length() < 3) {
+        SearchSegment::Postings::const_iterator it = snapshot.livePostings.lowerBound(text);
+        for (; it != snapshot.livePostings.constEnd() && it.key().startsWith(text); ++it) {
+            terms.append(it.key());
+        }
+        return terms;
+    }
+
+    QSet<QString> candidates;
+    bool first = true;
+    foreach (quint64 trigram, SearchSegment::trigrams(text)) {
+        if (!snapshot.liveTrigrams.contains(trigram)) {
+            return terms;
+        }
+        if (first) {
+            candidates = snapshot.liveTrigrams.value(trigram);
+            first = false;
+        } else {
+            candidates.intersect(snapshot.liveTrigrams.value(trigram));
+        }
+    }
+    foreach (const QString &candidate, candidates) {
+        if (candidate.contains(text)) {
+            terms.append(candidate);
+        }
+    }
+    return terms;
+}
+
+// Matches are identified by a key made of the segment (0 being the live segment) in
+// the upper and the document in the lower 32 bits. A note only lives in one place.
+//
+// Every match is scored with BM25, counting words in the title TITLE_WEIGHT times. As a
+// word can match several terms of the same note, the best of them counts.
+QHash<quint64, qreal> SearchIndex::matches(const Snapshot &snapshot, const QString &word, qreal averageLength, const QSet<quint64> *candidates, const QAtomicInt *cancelled)
+{
+    QSet<QString> terms = matchingLiveTerms(snapshot, word).toSet();
+    foreach (const QSharedPointer<SearchSegment> &segment, snapshot.segments) {
+        terms.unite(segment->matchingTerms(word).toSet());
+    }
+
+    QHash<quint64, qreal> scores;
+    QVector<Hit> hits;
+    foreach (const QString &term, terms) {
+        if (cancelled && cancelled->load()) {
+            return QHash<quint64, qreal>();
+        }
+
+        // Notes which aren't candidates still count for how common the term is
+        int documentFrequency = 0;
+        hits.clear();
+        foreach (const SearchSegment::Posting &posting, snapshot.livePostings.value(term)) {
+            qreal frequency = weight(posting.frequency[SearchSegment::FieldTitle], posting.frequency[SearchSegment::FieldContent],
+                                     posting.frequency[SearchSegment::FieldRecognition]);
+            if (frequency == 0) {
+                // Only an attribute
+                continue;
+            }
+            documentFrequency++;
+            if (candidates && !candidates->contains(posting.document)) {
+                continue;
+            }
+            Hit hit;
+            hit.key = posting.document;
+            hit.frequency = frequency;
+            hit.length = documentLength(snapshot.liveDocuments.at(posting.document));
+            hits.append(hit);
+        }
+        for (int segment = 0; segment < snapshot.segments.count(); segment++) {
+            const SearchSegment *searchSegment = snapshot.segments.at(segment).data();
+            const QBitArray &deletions = snapshot.deletions.at(segment);
+            quint64 segmentKey = (quint64)(segment + 1) << 32;
+            foreach (const SearchSegment::Posting &posting, searchSegment->postings().value(term)) {
+                qreal frequency = weight(posting.frequency[SearchSegment::FieldTitle], posting.frequency[SearchSegment::FieldContent],
+                                         posting.frequency[SearchSegment::FieldRecognition]);
+                if (frequency == 0 || deletions.testBit(posting.document)) {
+                    continue;
+                }
+                documentFrequency++;
+                if (candidates && !candidates->contains(segmentKey | posting.document)) {
+                    continue;
+                }
+                Hit hit;
+                hit.key = segmentKey | posting.document;
+                hit.frequency = frequency;
+                hit.length = weight(searchSegment->length(posting.document, SearchSegment::FieldTitle),
+                                    searchSegment->length(posting.document, SearchSegment::FieldContent),
+                                    searchSegment->length(posting.document, SearchSegment::FieldRecognition));
+                hits.append(hit);
+            }
+        }
+
+        qreal idf = qLn(1 + (snapshot.count - documentFrequency + 0.5) / (documentFrequency + 0.5));
+        foreach (const Hit &hit, hits) {
+            qreal norm = BM25_K1 * (1 - BM25_B + BM25_B * hit.length / averageLength);
+            qreal score = idf * hit.frequency * (BM25_K1 + 1) / (hit.frequency + norm);
+            QHash<quint64, qreal>::iterator it = scores.find(hit.key);
+            if (it == scores.end()) {
+                scores.insert(hit.key, score);
+            } else if (it.value() < score) {
+                it.value() = score;
+            }
+        }
+    }
+    return scores;
+}
+
+qreal SearchIndex::averageLength(const Snapshot &snapshot)
+{
+    // Avoid dividing by zero for notes without any words
+    return snapshot.count > 0 && snapshot.totalLength > 0 ? snapshot.totalLength / snapshot.count : 1;
+}
+
+qreal SearchIndex::documentLength(const Location &location) const
+{
+    if (location.segment < 0) {
+        return documentLength(m_liveDocuments.at(location.document));
+    }
+    const SearchSegment *segment = m_segments.at(location.segment).data();
+    return weight(segment->length(location.document, SearchSegment::FieldTitle),
+                  segment->length(location.document, SearchSegment::FieldContent),
+                  segment->length(location.document, SearchSegment::FieldRecognition));
+}
+
+quint64 SearchIndex::key(const SearchIndex::Location &location)
+{
+    if (location.segment < 0) {
+        return location.document;
+    }
+    return (quint64)(location.segment + 1) << 32 | location.document;
+}
+
+QString SearchIndex::guid(const Snapshot &snapshot, quint64 key)
+{
+    int segment = key >> 32;
+    quint32 document = key & 0xffffffff;
+    if (segment == 0) {
+        return snapshot.liveDocuments.at(document).guid;
+    }
+    return snapshot.segments.at(segment - 1)->guid(document);
+}
+
+QList<SearchSegment::Document> SearchIndex::liveDocuments() const
+{
+    QList<SearchSegment::Document> documents;
+    foreach (const SearchSegment::Document &document, m_liveDocuments) {
+        if (!document.guid.isEmpty()) {
+            documents.append(document);
+        }
+    }
+    return documents;
+}
+
+void SearchIndex::freezeLiveSegment()
+{
+    QList<SearchSegment::Document> documents = liveDocuments();
+    QString fileName = m_directory + QString("segment-%1.seg").arg(m_nextSegmentId);
+    QSharedPointer<SearchSegment> segment(new SearchSegment);
+    if (!SearchSegment::write(fileName, SearchSegment::build(documents)) || !segment->read(fileName)) {
+        QFile::remove(fileName);
+        return;
+    }
+    m_nextSegmentId++;
+
+    m_segments.append(segment);
+    m_deletions.append(QBitArray(segment->count()));
+    for (int document = 0; document < documents.count(); document++) {
+        Location location;
+        location.segment = m_segments.count() - 1;
+        location.document = document;
+        m_locations.insert(documents.at(document).guid, location);
+    }
+    m_liveDocuments.clear();
+    m_freeIds.clear();
+    m_livePostings.clear();
+    m_liveTrigrams.clear();
+}
+
+void SearchIndex::mergeIfNeeded()
+{
+    if (m_merger || m_directory.isEmpty() || m_segments.isEmpty()) {
+        return;
+    }
+
+    // Merge when there are too many segments to look at, or when they are mostly
+    // made of notes that have changed since
+    int total = 0;
+    int deleted = 0;
+    for (int segment = 0; segment < m_segments.count(); segment++) {
+        total += m_segments.at(segment)->count();
+        deleted += m_deletions.at(segment).count(true);
+    }
+    if (m_segments.count() <= MAX_SEGMENTS && deleted * 2 <= total) {
+        return;
+    }
+
+    QString fileName = m_directory + QString("segment-%1.seg").arg(m_nextSegmentId++);
+    qCDebug(dcStorage) << "Merging" << m_segments.count() << "search index segments into" << fileName;
+    m_merger = new SearchIndexMerger(m_segments, m_deletions, fileName);
+    connect(m_merger, &QThread::finished, this, &SearchIndex::mergeFinished);
+    m_merger->start(QThread::LowPriority);
+}
+
+bool SearchIndex::writeManifest()
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << m_nextSegmentId;
+    for (int segment = 0; segment < m_segments.count(); segment++) {
+        stream << QFileInfo(m_segments.at(segment)->fileName()).fileName() << m_deletions.at(segment);
+    }
+    QList<SearchSegment::Document> documents = liveDocuments();
+    stream << (documents.isEmpty() ? QByteArray() : SearchSegment::build(documents));
+
+    QByteArray header;
+    QDataStream headerStream(&header, QIODevice::WriteOnly);
+    headerStream << (quint32)MANIFEST_MAGIC << (quint16)MANIFEST_VERSION << (quint32)m_segments.count()
+                 << (quint32)data.length() << qChecksum(data.constData(), data.length());
+
+    QSaveFile file(m_directory + MANIFEST_FILE);
+    if (!file.open(QFile::WriteOnly)) {
+        qCWarning(dcStorage) << "Cannot write search index manifest" << file.fileName() << file.errorString();
+        return false;
+    }
+    file.write(header);
+    file.write(data);
+    if (!file.commit()) {
+        qCWarning(dcStorage) << "Error committing search index manifest" << file.fileName() << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+// Segments left behind by merges or freezes that didn't make it into the manifest
+void SearchIndex::removeUnusedFiles()
+{
+    QSet<QString> used;
+    foreach (const QSharedPointer<SearchSegment> &segment, m_segments) {
+        used.insert(QFileInfo(segment->fileName()).fileName());
+    }
+    QDir directory(m_directory);
+    foreach (const QString &fileName, directory.entryList(QStringList() << "segment-*.seg", QDir::Files)) {
+        if (!used.contains(fileName)) {
+            QFile::remove(m_directory + fileName);
+        }
+    }
+}
+
+qreal SearchIndex::weight(qreal title, qreal content, qreal recognition)
+{
+    return TITLE_WEIGHT * title + content + recognition;
+}
+
+qreal SearchIndex::documentLength(const SearchSegment::Document &document)
+{
+    return weight(document.length(SearchSegment::FieldTitle), document.length(SearchSegment::FieldContent),
+                  document.length(SearchSegment::FieldRecognition));
+}
+
+bool SearchIndex::postingLessThan(const SearchSegment::Posting &posting, quint32 document)
+{
+    return posting.document < document;
+}
+
+bool SearchIndex::occurrenceLessThan(const Occurrence &left, const Occurrence &right)
+{
+    return left.position < right.position;
+}
+
+// Like matchingTerms(), words shorter than a trigram only match the start of a term
+bool SearchIndex::termMatches(const QString &term, const QString &word)
+{
+    return word.length() < 3 ? term.startsWith(word) : term.contains(word);
+}
+
+SearchIndexMerger::SearchIndexMerger(const QList<QSharedPointer<SearchSegment> > &segments, const QList<QBitArray> &deletions, const QString &targetFileName, QObject *parent):
+    QThread(parent),
+    m_segments(segments),
+    m_deletions(deletions),
+    m_targetFileName(targetFileName),
+    m_success(false)
+{
+}
+
+QList<QSharedPointer<SearchSegment> > SearchIndexMerger::segments() const
+{
+    return m_segments;
+}
+
+QList<QBitArray> SearchIndexMerger::deletions() const
+{
+    return m_deletions;
+}
+
+QString SearchIndexMerger::targetFileName() const
+{
+    return m_targetFileName;
+}
+
+bool SearchIndexMerger::success() const
+{
+    return m_success;
+}
+
+void SearchIndexMerger::run()
+{
+    m_success = SearchSegment::write(m_targetFileName, SearchSegment::merge(m_segments, m_deletions));
+}
+
+SearchIndexQuery::SearchIndexQuery(const SearchIndex *index, const QString &query, QObject *parent):
+    QThread(parent),
+    m_index(index),
+    m_query(query),
+    m_narrow(false),
+    m_cancelled(0)
+{
+}
+
+void SearchIndexQuery::setCandidates(const QSet<QString> &candidates)
+{
+    m_candidates = candidates;
+    m_narrow = true;
+}
+
+void SearchIndexQuery::setExcludedQueries(const QStringList &queries)
+{
+    m_excludedQueries = queries;
+}
+
+void SearchIndexQuery::setPhrases(const QStringList &phrases)
+{
+    m_phrases = phrases;
+}
+
+void SearchIndexQuery::setExcludedPhrases(const QStringList &phrases)
+{
+    m_excludedPhrases = phrases;
+}
+
+QString SearchIndexQuery::query() const
+{
+    return m_query;
+}
+
+QHash<QString, qreal> SearchIndexQuery::results() const
+{
+    return m_results;
+}
+
+bool SearchIndexQuery::isCancelled() const
+{
+    return m_cancelled.load();
+}
+
+void SearchIndexQuery::cancel()
+{
+    m_cancelled.store(1);
+}
+
+void SearchIndexQuery::run()
+{
+    if (m_narrow && SearchIndex::tokenize(m_query).isEmpty()) {
+        foreach (const QString &guid, m_candidates) {
+            m_results.insert(guid, 0);
+        }
+    } else {
+        m_results = m_index->search(m_query, m_narrow ? &m_candidates : nullptr, &m_cancelled);
+    }
+
+    foreach (const QString &query, m_excludedQueries) {
+        if (m_results.isEmpty()) {
+            break;
+        }
+        QSet<QString> remaining = m_results.keys().toSet();
+        foreach (const QString &guid, m_index->search(query, &remaining, &m_cancelled).keys()) {
+            m_results.remove(guid);
+        }
+    }
+
+    // The words of phrases have been matched anywhere in the notes so far
+    foreach (const QString &phrase, m_phrases) {
+        QHash<QString, qreal>::iterator it = m_results.begin();
+        while (it != m_results.end() && !isCancelled()) {
+            if (m_index->containsPhrase(it.key(), phrase)) {
+                ++it;
+            } else {
+                it = m_results.erase(it);
+            }
+        }
+    }
+    foreach (const QString &phrase, m_excludedPhrases) {
+        if (m_results.isEmpty()) {
+            break;
+        }
+        QSet<QString> remaining = m_results.keys().toSet();
+        foreach (const QString &guid, m_index->search(phrase, &remaining, &m_cancelled).keys()) {
+            if (m_index->containsPhrase(guid, phrase)) {
+                m_results.remove(guid);
+            }
+        }
+    }
+    if (isCancelled()) {
+        m_results.clear();
+    }
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "searchsegment.h"
+
+#include <QAtomicInt>
+#include <QBitArray>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+
+class SearchIndexMerger;
+
+// The SearchIndex is an inverted index over the title, the plaintext content and the
+// words recognized in the attachments of the cached notes, used to search while we're
+// offline.
+//
+// For each term we keep the sorted list of notes containing it, so a search only touches
+// the notes that match instead of loading and scanning all of them. Search words match
+// anywhere inside of terms, so "invo" finds "invoice2019" and so does "2019". The terms
+// containing a word are looked up through their trigrams. Words shorter than that only
+// match the start of terms, like the server does with "words*".
+//
+// The index is stored as a number of immutable segments plus a small live segment
+// that takes all changes. A changed note is taken out of its segment (it's marked as
+// deleted there) and goes into the live segment. On commit() the live segment is
+// written to the manifest, together with the list of segments and their deletions.
+// Once it holds enough notes it becomes a segment of its own. When there are too many
+// segments, they are merged into one in a background thread.
+//
+// Every note is indexed with its update sequence number, so after a restart only
+// notes that have changed since need to be indexed again.
+//
+// Search results are ranked with BM25 where a word found in the title weighs more than
+// one found in the content. For the content, the index also keeps the plaintext and the
+// positions of the terms, to show the part of a note that matched.
+//
+// Next to the words, the index knows the state of each note's todo checkboxes, so the
+// search grammar's todo: can be answered without reading the content of every note.
+//
+// The index is changed from the main thread only, but searches may run in other threads
+// (see SearchIndexQuery). A search only holds the lock while it takes a snapshot of the
+// segment list and the live segment, then works on that. So changes wait for the snapshot
+// to be taken, never for a running search.
+class SearchIndex : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SearchIndex(QObject *parent = 0);
+    ~SearchIndex();
+
+    // Loads the index stored in directory. Changes are written back there on commit().
+    void open(const QString &directory);
+    void close();
+    void commit();
+
+    void setTitle(const QString &guid, const QString &title);
+    void setContent(const QString &guid, const QString &plaintext);
+    // Words recognized in the note's images and documents
+    void setRecognition(const QString &guid, const QString &text);
+    // Whether each of the note's todo checkboxes is checked
+    void setTodos(const QString &guid, const QList<bool> &todos);
+    void setUpdateSequenceNumber(const QString &guid, qint32 updateSequenceNumber);
+    void removeNote(const QString &guid);
+    void renameNote(const QString &oldGuid, const QString &newGuid);
+
+    bool contains(const QString &guid) const;
+    qint32 updateSequenceNumber(const QString &guid) const;
+    QStringList guids() const;
+    int count() const;
+    // Changes whenever the contents of the index change, so results can be told apart
+    // from those of an older version of the index
+    quint64 generation() const;
+
+    // Returns the guids of all notes with a checked or unchecked todo checkbox
+    QSet<QString> notesWithTodos(bool checked) const;
+
+    // Returns the guids of all notes containing every word in query with their score.
+    // Higher scores are better matches.
+    QHash<QString, qreal> search(const QString &query) const;
+    // Like search(), but only notes out of candidates can match unless it's null. Returns
+    // no results as soon as cancelled is set.
+    QHash<QString, qreal> search(const QString &query, const QSet<QString> *candidates, const QAtomicInt *cancelled) const;
+
+    // Whether the note has the words of phrase right next to each other, in that order.
+    // Only the content keeps where its terms are, so in the title it's enough to have all
+    // the words, and the recognized text doesn't count.
+    bool containsPhrase(const QString &guid, const QString &phrase) const;
+
+    // Returns a short piece of the note's content around the words of query, as styled text
+    // with the matches in bold. Empty if the content doesn't contain any of them.
+    QString snippet(const QString &guid, const QString &query) const;
+
+    // Splits text into terms. If positions isn't null, the position of each term in text is
+    // appended to it.
+    static QStringList tokenize(const QString &text, QVector<quint32> *positions = nullptr);
+    // Whether all notes matching query also match previousQuery, because query only adds to it
+    static bool refines(const QString &query, const QString &previousQuery);
+
+private slots:
+    void mergeFinished();
+
+private:
+    // Where a note is indexed. Segment -1 is the live segment.
+    struct Location {
+        qint32 segment;
+        quint32 document;
+    };
+
+    // A term found in a note's content, standing for one of the search words
+    struct Occurrence {
+        quint32 position;
+        quint32 length;
+        int word;
+    };
+
+    // A note matching a term, with the term's and the note's number of words
+    struct Hit {
+        quint64 key;
+        qreal frequency;
+        qreal length;
+    };
+
+    // What a search looks at. Segments never change and the live segment's containers are
+    // implicitly shared, so taking a snapshot is cheap. Changes to the live segment after
+    // that detach from it.
+    struct Snapshot {
+        QList<QSharedPointer<SearchSegment> > segments;
+        QList<QBitArray> deletions;
+        QVector<SearchSegment::Document> liveDocuments;
+        SearchSegment::Postings livePostings;
+        QHash<quint64, QSet<QString> > liveTrigrams;
+        int count;
+        qreal totalLength;
+    };
+
+    // Must be called with m_lock held
+    Snapshot snapshot() const;
+
+    void clear();
+    bool document(const QString &guid, SearchSegment::Document *document) const;
+    quint32 liveDocument(const QString &guid);
+    void addLiveDocument(const SearchSegment::Document &document);
+    void removeLiveDocument(quint32 document);
+    void setField(const QString &guid, SearchSegment::Field field, const QString &text);
+    void setTerms(const QString &guid, SearchSegment::Field field, const QHash<QString, quint16> &terms);
+    qreal documentLength(const Location &location) const;
+    void updatePosting(const QString &term, quint32 document, SearchSegment::Field field, quint16 frequency);
+    static QStringList matchingLiveTerms(const Snapshot &snapshot, const QString &text);
+    static QHash<quint64, qreal> matches(const Snapshot &snapshot, const QString &word, qreal averageLength, const QSet<quint64> *candidates, const QAtomicInt *cancelled);
+    static qreal averageLength(const Snapshot &snapshot);
+    static QString guid(const Snapshot &snapshot, quint64 key);
+    static quint64 key(const Location &location);
+
+    QList<SearchSegment::Document> liveDocuments() const;
+    void freezeLiveSegment();
+    void mergeIfNeeded();
+    bool writeManifest();
+    void removeUnusedFiles();
+
+    static qreal weight(qreal title, qreal content, qreal recognition);
+    static qreal documentLength(const SearchSegment::Document &document);
+    static bool postingLessThan(const SearchSegment::Posting &posting, quint32 document);
+    static bool occurrenceLessThan(const Occurrence &left, const Occurrence &right);
+    static bool termMatches(const QString &term, const QString &word);
+
+private:
+    mutable QReadWriteLock m_lock;
+    QString m_directory;
+    quint32 m_nextSegmentId;
+    bool m_dirty;
+    quint64 m_generation;
+
+    QList<QSharedPointer<SearchSegment> > m_segments;
+    QList<QBitArray> m_deletions;
+    QHash<QString, Location> m_locations;
+    // The weighted number of words of all notes, for their average length in BM25
+    qreal m_totalLength;
+
+    // The live segment. Removed documents have an empty guid and are reused.
+    QVector<SearchSegment::Document> m_liveDocuments;
+    QVector<quint32> m_freeIds;
+    SearchSegment::Postings m_livePostings;
+    QHash<quint64, QSet<QString> > m_liveTrigrams;
+
+    SearchIndexMerger *m_merger;
+};
+
+// Merges segments into a new segment file. The segments are never changed once they've
+// been written, so they can be read while the index keeps working. Notes deleted from
+// them in the meantime are carried over once the merge is done.
+class SearchIndexMerger : public QThread
+{
+    Q_OBJECT
+public:
+    SearchIndexMerger(const QList<QSharedPointer<SearchSegment> > &segments, const QList<QBitArray> &deletions, const QString &targetFileName, QObject *parent = 0);
+
+    QList<QSharedPointer<SearchSegment> > segments() const;
+    QList<QBitArray> deletions() const;
+    QString targetFileName() const;
+    bool success() const;
+
+    void run() override;
+
+private:
+    QList<QSharedPointer<SearchSegment> > m_segments;
+    QList<QBitArray> m_deletions;
+    QString m_targetFileName;
+    bool m_success;
+};
+
+// Runs a search in a background thread, so searching doesn't block the UI. A query can
+// be cancelled at any time. It then finishes early, without results.
+//
+// A query without any words matches all candidates, with a score of 0.
+class SearchIndexQuery : public QThread
+{
+    Q_OBJECT
+public:
+    SearchIndexQuery(const SearchIndex *index, const QString &query, QObject *parent = 0);
+
+    // Only notes out of candidates can match. Used to narrow down the results of a
+    // previous query when the new one only adds to it.
+    void setCandidates(const QSet<QString> &candidates);
+    // Notes matching any of these queries are left out. Used for negated search words.
+    void setExcludedQueries(const QStringList &queries);
+    // Notes must contain each of these phrases, see SearchIndex::containsPhrase()
+    void setPhrases(const QStringList &phrases);
+    // Notes containing any of these phrases are left out
+    void setExcludedPhrases(const QStringList &phrases);
+
+    QString query() const;
+    QHash<QString, qreal> results() const;
+    bool isCancelled() const;
+    void cancel();
+
+    void run() override;
+
+private:
+    const SearchIndex *m_index;
+    QString m_query;
+    QSet<QString> m_candidates;
+    bool m_narrow;
+    QStringList m_excludedQueries;
+    QStringList m_phrases;
+    QStringList m_excludedPhrases;
+    QAtomicInt m_cancelled;
+    QHash<QString, qreal> m_results;
+};
+
+#endif // SEARCHINDEX_H
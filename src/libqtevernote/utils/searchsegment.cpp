@@ -0,0 +1,470 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "searchsegment.h"
+#include "logging.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#include <algorithm>
+
+#define SEGMENT_MAGIC 0x524e5347 // "RNSG"
+#define SEGMENT_VERSION 5
+#define SEGMENT_HEADER_SIZE 20
+
+SearchSegment::Posting::Posting():
+    document(0)
+{
+    for (int i = 0; i < FieldCount; i++) {
+        frequency[i] = 0;
+    }
+}
+
+SearchSegment::Document::Document():
+    updateSequenceNumber(0)
+{
+}
+
+quint32 SearchSegment::Document::length(SearchSegment::Field field) const
+{
+    quint32 length = 0;
+    foreach (quint16 frequency, terms[field]) {
+        length += frequency;
+    }
+    return length;
+}
+
+SearchSegment::SearchSegment():
+    m_map(nullptr),
+    m_mapSize(0),
+    m_termVectorOffset(0)
+{
+}
+
+SearchSegment::~SearchSegment()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+}
+
+bool SearchSegment::read(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::ReadOnly)) {
+        qCWarning(dcStorage) << "Cannot open search index segment" << fileName << m_file.errorString();
+        return false;
+    }
+
+    QDataStream headerStream(m_file.read(SEGMENT_HEADER_SIZE));
+    quint32 magic;
+    quint16 version;
+    quint32 count;
+    quint32 termVectorOffset;
+    quint32 length;
+    headerStream >> magic >> version >> count >> termVectorOffset >> length;
+    if (headerStream.status() != QDataStream::Ok || m_file.size() != SEGMENT_HEADER_SIZE + (qint64)length
+            || termVectorOffset > m_file.size()) {
+        qCWarning(dcStorage) << "Ignoring invalid search index segment" << fileName;
+        return false;
+    }
+
+    // The term vectors stay on disk
+    m_file.seek(0);
+    if (!parse(m_file.read(termVectorOffset))) {
+        qCWarning(dcStorage) << "Ignoring invalid search index segment" << fileName;
+        return false;
+    }
+    m_mapSize = m_file.size();
+    m_map = m_file.map(0, m_mapSize);
+    if (!m_map) {
+        qCWarning(dcStorage) << "Cannot map search index segment" << fileName << m_file.errorString();
+        m_mapSize = 0;
+    }
+    m_fileName = fileName;
+    m_data.clear();
+    return true;
+}
+
+bool SearchSegment::load(const QByteArray &data)
+{
+    if (!parse(data)) {
+        return false;
+    }
+    m_fileName.clear();
+    m_data = data;
+    return true;
+}
+
+QString SearchSegment::fileName() const
+{
+    return m_fileName;
+}
+
+int SearchSegment::count() const
+{
+    return m_entries.count();
+}
+
+QString SearchSegment::guid(quint32 document) const
+{
+    return m_entries.at(document).guid;
+}
+
+qint32 SearchSegment::updateSequenceNumber(quint32 document) const
+{
+    return m_entries.at(document).updateSequenceNumber;
+}
+
+quint32 SearchSegment::length(quint32 document, SearchSegment::Field field) const
+{
+    return m_entries.at(document).length[field];
+}
+
+const SearchSegment::Postings &SearchSegment::postings() const
+{
+    return m_postings;
+}
+
+QStringList SearchSegment::matchingTerms(const QString &text) const
+{
+    QStringList terms;
+    if (text.length() < 3) {
+        Postings::const_iterator it = m_postings.lowerBound(text);
+        for (; it != m_postings.constEnd() && it.key().startsWith(text); ++it) {
+            terms.append(it.key());
+        }
+        return terms;
+    }
+
+    {
+        QMutexLocker locker(&m_trigramsMutex);
+        if (m_terms.isEmpty() && !m_postings.isEmpty()) {
+            buildTrigrams();
+        }
+    }
+
+    // Narrow down to the terms having all trigrams of text, then check they really contain it
+    QVector<quint32> candidates;
+    bool first = true;
+    foreach (quint64 trigram, trigrams(text)) {
+        QHash<quint64, QVector<quint32> >::const_iterator it = m_trigrams.constFind(trigram);
+        if (it == m_trigrams.constEnd()) {
+            return terms;
+        }
+        if (first) {
+            candidates = it.value();
+            first = false;
+        } else {
+            QVector<quint32> intersection;
+            std::set_intersection(candidates.constBegin(), candidates.constEnd(), it.value().constBegin(), it.value().constEnd(),
+                                  std::back_inserter(intersection));
+            candidates = intersection;
+        }
+        if (candidates.isEmpty()) {
+            return terms;
+        }
+    }
+    foreach (quint32 candidate, candidates) {
+        if (m_terms.at(candidate).contains(text)) {
+            terms.append(m_terms.at(candidate));
+        }
+    }
+    return terms;
+}
+
+SearchSegment::Document SearchSegment::document(quint32 document) const
+{
+    const Entry &entry = m_entries.at(document);
+    Document result;
+    result.guid = entry.guid;
+    result.updateSequenceNumber = entry.updateSequenceNumber;
+
+    QByteArray termVector;
+    if (!m_data.isEmpty()) {
+        termVector = m_data.mid(m_termVectorOffset + entry.termVectorOffset, entry.termVectorLength);
+    } else if (m_map) {
+        // Only read from, so it doesn't need copying
+        termVector = QByteArray::fromRawData(reinterpret_cast<const char*>(m_map) + m_termVectorOffset + entry.termVectorOffset,
+                                             entry.termVectorLength);
+    } else {
+        QFile file(m_fileName);
+        if (file.open(QFile::ReadOnly) && file.seek(m_termVectorOffset + entry.termVectorOffset)) {
+            termVector = file.read(entry.termVectorLength);
+        }
+    }
+
+    QDataStream stream(termVector);
+    for (int field = 0; field < FieldCount; field++) {
+        quint32 termCount = 0;
+        stream >> termCount;
+        for (quint32 i = 0; i < termCount && stream.status() == QDataStream::Ok; i++) {
+            QString term;
+            quint16 frequency;
+            stream >> term >> frequency;
+            result.terms[field].insert(term, frequency);
+        }
+    }
+    stream >> result.text >> result.positions;
+    if (stream.status() != QDataStream::Ok) {
+        qCWarning(dcStorage) << "Cannot read the terms of" << entry.guid << "from search index segment" << m_fileName;
+        for (int field = 0; field < FieldCount; field++) {
+            result.terms[field].clear();
+        }
+        result.text.clear();
+        result.positions.clear();
+    }
+    return result;
+}
+
+QByteArray SearchSegment::build(const QList<SearchSegment::Document> &documents)
+{
+    QVector<Entry> entries;
+    entries.reserve(documents.count());
+    Postings postings;
+    QByteArray termVectors;
+    QDataStream stream(&termVectors, QIODevice::WriteOnly);
+
+    for (int i = 0; i < documents.count(); i++) {
+        const Document &document = documents.at(i);
+        Entry entry;
+        entry.guid = document.guid;
+        entry.updateSequenceNumber = document.updateSequenceNumber;
+        entry.termVectorOffset = termVectors.length();
+        for (int field = 0; field < FieldCount; field++) {
+            entry.length[field] = document.length((Field)field);
+        }
+
+        QHash<QString, Posting> documentPostings;
+        for (int field = 0; field < FieldCount; field++) {
+            stream << (quint32)document.terms[field].count();
+            QHash<QString, quint16>::const_iterator it = document.terms[field].constBegin();
+            for (; it != document.terms[field].constEnd(); ++it) {
+                stream << it.key() << it.value();
+                Posting &posting = documentPostings[it.key()];
+                posting.document = i;
+                posting.frequency[field] = it.value();
+            }
+        }
+        stream << document.text << document.positions;
+        entry.termVectorLength = termVectors.length() - entry.termVectorOffset;
+        entries.append(entry);
+
+        QHash<QString, Posting>::const_iterator it = documentPostings.constBegin();
+        for (; it != documentPostings.constEnd(); ++it) {
+            postings[it.key()].append(it.value());
+        }
+    }
+
+    return compose(entries, postings, termVectors);
+}
+
+QByteArray SearchSegment::merge(const QList<QSharedPointer<SearchSegment> > &segments, const QList<QBitArray> &deletions)
+{
+    QVector<Entry> entries;
+    Postings postings;
+    QByteArray termVectors;
+
+    for (int i = 0; i < segments.count(); i++) {
+        const SearchSegment *segment = segments.at(i).data();
+        const QBitArray &deleted = deletions.at(i);
+        QByteArray segmentTermVectors = segment->termVectors();
+
+        // Documents keep their order, so the merged postings stay sorted
+        QVector<qint32> ids(segment->count(), -1);
+        for (int document = 0; document < segment->count(); document++) {
+            if (deleted.testBit(document)) {
+                continue;
+            }
+            Entry entry = segment->m_entries.at(document);
+            QByteArray termVector = segmentTermVectors.mid(entry.termVectorOffset, entry.termVectorLength);
+            entry.termVectorOffset = termVectors.length();
+            termVectors.append(termVector);
+            ids[document] = entries.count();
+            entries.append(entry);
+        }
+
+        Postings::const_iterator it = segment->m_postings.constBegin();
+        for (; it != segment->m_postings.constEnd(); ++it) {
+            QVector<Posting> *termPostings = nullptr;
+            foreach (const Posting &posting, it.value()) {
+                if (ids.at(posting.document) < 0) {
+                    continue;
+                }
+                if (!termPostings) {
+                    termPostings = &postings[it.key()];
+                }
+                Posting merged = posting;
+                merged.document = ids.at(posting.document);
+                termPostings->append(merged);
+            }
+        }
+    }
+
+    return compose(entries, postings, termVectors);
+}
+
+bool SearchSegment::write(const QString &fileName, const QByteArray &data)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        qCWarning(dcStorage) << "Cannot write search index segment" << fileName << file.errorString();
+        return false;
+    }
+    file.write(data);
+    if (!file.commit()) {
+        qCWarning(dcStorage) << "Error committing search index segment" << fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+QVector<quint64> SearchSegment::trigrams(const QString &text)
+{
+    QVector<quint64> trigrams;
+    for (int i = 0; i + 3 <= text.length(); i++) {
+        quint64 trigram = ((quint64)text.at(i).unicode() << 32) | ((quint64)text.at(i + 1).unicode() << 16) | text.at(i + 2).unicode();
+        if (!trigrams.contains(trigram)) {
+            trigrams.append(trigram);
+        }
+    }
+    return trigrams;
+}
+
+bool SearchSegment::parse(const QByteArray &data)
+{
+    QDataStream headerStream(data);
+    quint32 magic;
+    quint16 version;
+    quint32 count;
+    quint32 termVectorOffset;
+    quint32 length;
+    quint16 checksum;
+    headerStream >> magic >> version >> count >> termVectorOffset >> length >> checksum;
+    if (headerStream.status() != QDataStream::Ok || magic != SEGMENT_MAGIC || version != SEGMENT_VERSION
+            || termVectorOffset < SEGMENT_HEADER_SIZE || (quint32)data.length() < termVectorOffset
+            || qChecksum(data.constData() + SEGMENT_HEADER_SIZE, termVectorOffset - SEGMENT_HEADER_SIZE) != checksum) {
+        return false;
+    }
+
+    QDataStream stream(data.mid(SEGMENT_HEADER_SIZE, termVectorOffset - SEGMENT_HEADER_SIZE));
+    QVector<Entry> entries;
+    entries.reserve(count);
+    for (quint32 i = 0; i < count; i++) {
+        Entry entry;
+        stream >> entry.guid >> entry.updateSequenceNumber >> entry.termVectorOffset >> entry.termVectorLength;
+        for (int field = 0; field < FieldCount; field++) {
+            stream >> entry.length[field];
+        }
+        entries.append(entry);
+    }
+
+    Postings postings;
+    quint32 termCount = 0;
+    stream >> termCount;
+    for (quint32 i = 0; i < termCount && stream.status() == QDataStream::Ok; i++) {
+        QString term;
+        quint32 postingCount = 0;
+        stream >> term >> postingCount;
+        QVector<Posting> termPostings;
+        termPostings.reserve(postingCount);
+        for (quint32 j = 0; j < postingCount && stream.status() == QDataStream::Ok; j++) {
+            Posting posting;
+            stream >> posting.document;
+            for (int field = 0; field < FieldCount; field++) {
+                stream >> posting.frequency[field];
+            }
+            if (posting.document >= count) {
+                return false;
+            }
+            termPostings.append(posting);
+        }
+        postings.insert(term, termPostings);
+    }
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    m_termVectorOffset = termVectorOffset;
+    m_entries = entries;
+    m_postings = postings;
+    m_terms.clear();
+    m_trigrams.clear();
+    return true;
+}
+
+QByteArray SearchSegment::termVectors() const
+{
+    if (!m_data.isEmpty()) {
+        return m_data.mid(m_termVectorOffset);
+    }
+    if (m_map) {
+        return QByteArray(reinterpret_cast<const char*>(m_map) + m_termVectorOffset, m_mapSize - m_termVectorOffset);
+    }
+    QFile file(m_fileName);
+    if (!file.open(QFile::ReadOnly) || !file.seek(m_termVectorOffset)) {
+        qCWarning(dcStorage) << "Cannot read term vectors from search index segment" << m_fileName << file.errorString();
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+void SearchSegment::buildTrigrams() const
+{
+    // Terms are numbered in order, so the lists come out sorted
+    m_terms = m_postings.keys().toVector();
+    for (int i = 0; i < m_terms.count(); i++) {
+        foreach (quint64 trigram, trigrams(m_terms.at(i))) {
+            m_trigrams[trigram].append(i);
+        }
+    }
+}
+
+QByteArray SearchSegment::compose(const QVector<SearchSegment::Entry> &entries, const SearchSegment::Postings &postings, const QByteArray &termVectors)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    foreach (const Entry &entry, entries) {
+        stream << entry.guid << entry.updateSequenceNumber << entry.termVectorOffset << entry.termVectorLength;
+        for (int field = 0; field < FieldCount; field++) {
+            stream << entry.length[field];
+        }
+    }
+    stream << (quint32)postings.count();
+    Postings::const_iterator it = postings.constBegin();
+    for (; it != postings.constEnd(); ++it) {
+        stream << it.key() << (quint32)it.value().count();
+        foreach (const Posting &posting, it.value()) {
+            stream << posting.document;
+            for (int field = 0; field < FieldCount; field++) {
+                stream << posting.frequency[field];
+            }
+        }
+    }
+
+    QByteArray header;
+    QDataStream headerStream(&header, QIODevice::WriteOnly);
+    headerStream << (quint32)SEGMENT_MAGIC << (quint16)SEGMENT_VERSION << (quint32)entries.count()
+                 << (quint32)(SEGMENT_HEADER_SIZE + data.length()) << (quint32)(data.length() + termVectors.length())
+                 << qChecksum(data.constData(), data.length());
+
+    return header + data + termVectors;
+}
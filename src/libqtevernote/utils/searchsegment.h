@@ -0,0 +1,158 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCHSEGMENT_H
+#define SEARCHSEGMENT_H
+
+#include <QBitArray>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// A SearchSegment is an immutable part of the SearchIndex, usually stored in a file of
+// its own. Notes are identified by their position in the segment.
+//
+// Terms containing a piece of text are found through an index of their trigrams, so
+// searches can match in the middle of words. It's built from the terms the first time
+// it's needed.
+//
+// Next to the postings, a segment keeps the terms of each note (its term vector), the
+// plaintext content and where its terms are found in it. Those are only needed when a
+// note changes and has to be taken out of the segment, when segments are merged or to
+// show where a search matched, so they are read from the file on demand. The file stays
+// mapped for as long as the segment is around, so that's only a copy out of the mapping.
+//
+// File layout (all integers big endian):
+// Header:       quint32 magic, quint16 version, quint32 document count,
+//               quint32 term vector offset, quint32 length, quint16 checksum
+//               (over everything between the header and the term vectors)
+// Documents:    guid, qint32 update sequence number, quint32 term vector offset
+//               (relative to the first term vector), quint32 term vector length,
+//               quint32 number of words for each field
+// Postings:     quint32 term count, then for each term: term, quint32 posting count,
+//               postings as quint32 document and a quint16 frequency per field
+// Term vectors: for each document and field: quint32 term count, term and quint16 frequency,
+//               then the plaintext content and a QHash of the character positions of
+//               its terms
+class SearchSegment
+{
+public:
+    enum Field {
+        FieldTitle,
+        FieldContent,
+        FieldRecognition,
+        // Facts about the note which aren't words, like "todo:true". They're never
+        // matched by search words.
+        FieldAttributes,
+        FieldCount
+    };
+
+    struct Posting {
+        Posting();
+
+        quint32 document;
+        quint16 frequency[FieldCount];
+    };
+
+    struct Document {
+        Document();
+
+        // Number of words in field
+        quint32 length(Field field) const;
+
+        QString guid;
+        qint32 updateSequenceNumber;
+        QHash<QString, quint16> terms[FieldCount];
+        // The plaintext content and where its terms start in there
+        QString text;
+        QHash<QString, QVector<quint32> > positions;
+    };
+
+    typedef QMap<QString, QVector<Posting> > Postings;
+
+    SearchSegment();
+    ~SearchSegment();
+
+    // Reads everything but the term vectors from fileName
+    bool read(const QString &fileName);
+    // Uses data as the segment's contents. Term vectors are read from there as well.
+    bool load(const QByteArray &data);
+
+    QString fileName() const;
+
+    int count() const;
+    QString guid(quint32 document) const;
+    qint32 updateSequenceNumber(quint32 document) const;
+    quint32 length(quint32 document, Field field) const;
+    const Postings &postings() const;
+
+    // Returns the terms containing text. Text shorter than a trigram only matches at the start.
+    QStringList matchingTerms(const QString &text) const;
+
+    // Reads a document including its terms
+    Document document(quint32 document) const;
+
+    // Creates the contents of a segment holding documents
+    static QByteArray build(const QList<Document> &documents);
+    // Creates the contents of a segment holding all documents of segments which aren't deleted
+    static QByteArray merge(const QList<QSharedPointer<SearchSegment> > &segments, const QList<QBitArray> &deletions);
+
+    static bool write(const QString &fileName, const QByteArray &data);
+
+    // Returns the distinct trigrams of text, each packed into the lower 48 bits
+    static QVector<quint64> trigrams(const QString &text);
+
+private:
+    struct Entry {
+        QString guid;
+        qint32 updateSequenceNumber;
+        quint32 termVectorOffset;
+        quint32 termVectorLength;
+        quint32 length[FieldCount];
+    };
+
+    bool parse(const QByteArray &data);
+    QByteArray termVectors() const;
+    void buildTrigrams() const;
+
+    static QByteArray compose(const QVector<Entry> &entries, const Postings &postings, const QByteArray &termVectors);
+
+private:
+    QString m_fileName;
+    QFile m_file;
+    uchar *m_map;
+    qint64 m_mapSize;
+    QByteArray m_data;
+    quint32 m_termVectorOffset;
+    QVector<Entry> m_entries;
+    Postings m_postings;
+
+    // Built on first use, possibly by several threads searching at once
+    mutable QMutex m_trigramsMutex;
+    mutable QVector<QString> m_terms;
+    mutable QHash<quint64, QVector<quint32> > m_trigrams;
+};
+
+#endif // SEARCHSEGMENT_H
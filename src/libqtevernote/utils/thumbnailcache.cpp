@@ -0,0 +1,192 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnailcache.h"
+#include "logging.h"
+
+#include <QBuffer>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#define THUMBNAIL_DEFAULT_BUDGET (32 * 1024 * 1024)
+
+static const int s_buckets[] = { 64, 128, 256, 512, 768, 1024 };
+
+static int snapToBucket(int length)
+{
+    if (length <= 0) {
+        return length;
+    }
+    for (unsigned int i = 0; i < sizeof(s_buckets) / sizeof(s_buckets[0]); i++) {
+        if (length <= s_buckets[i]) {
+            return s_buckets[i];
+        }
+    }
+    return length;
+}
+
+ThumbnailCache::ThumbnailCache():
+    m_budget(THUMBNAIL_DEFAULT_BUDGET),
+    m_totalSize(0),
+    m_accessCounter(0)
+{
+}
+
+void ThumbnailCache::open(const QString &directory)
+{
+    close();
+
+    QMutexLocker locker(&m_mutex);
+    m_directory = directory;
+
+    // We don't persist access times. Start out with the order the copies have last been
+    // used in according to the file system. That's good enough to pick what to evict first.
+    QDir dir(directory);
+    QFileInfoList files = dir.entryInfoList({"*_*x*.jpg"}, QDir::Files);
+    QMap<QDateTime, QFileInfo> filesByAccess;
+    foreach (const QFileInfo &fileInfo, files) {
+        filesByAccess.insertMulti(qMax(fileInfo.lastRead(), fileInfo.lastModified()), fileInfo);
+    }
+    foreach (const QFileInfo &fileInfo, filesByAccess) {
+        touch(fileInfo.absoluteFilePath(), fileInfo.size());
+    }
+    qCDebug(dcStorage) << "Thumbnail cache contains" << m_entries.count() << "images," << m_totalSize << "bytes";
+    evict();
+}
+
+void ThumbnailCache::close()
+{
+    QMutexLocker locker(&m_mutex);
+    m_directory.clear();
+    m_entries.clear();
+    m_lru.clear();
+    m_totalSize = 0;
+}
+
+qint64 ThumbnailCache::budget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_budget;
+}
+
+void ThumbnailCache::setBudget(qint64 budget)
+{
+    QMutexLocker locker(&m_mutex);
+    m_budget = budget;
+    evict();
+}
+
+QByteArray ThumbnailCache::imageData(const QString &sourceFilePath, const QSize &size)
+{
+    QSize bucket = bucketSize(size);
+    QString filePath = sourceFilePath + "_" + QString::number(bucket.width()) + "x" + QString::number(bucket.height()) + ".jpg";
+
+    QFile file(filePath);
+    if (file.open(QFile::ReadOnly)) {
+        QByteArray data = file.readAll();
+        QMutexLocker locker(&m_mutex);
+        touch(filePath, data.size());
+        return data;
+    }
+
+    QImage image(sourceFilePath);
+    if (image.isNull()) {
+        return QByteArray();
+    }
+    if (bucket.height() > 0 && bucket.width() > 0) {
+        image = image.scaled(bucket, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    } else if (bucket.height() > 0) {
+        image = image.scaledToHeight(bucket.height(), Qt::SmoothTransformation);
+    } else {
+        image = image.scaledToWidth(bucket.width(), Qt::SmoothTransformation);
+    }
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QBuffer::WriteOnly);
+    if (!image.save(&buffer, "JPG")) {
+        qCWarning(dcStorage) << "Error encoding scaled image" << filePath;
+        return QByteArray();
+    }
+
+    // Other loader threads may be reading the same copy. They only ever see a complete one.
+    QSaveFile saveFile(filePath);
+    if (!saveFile.open(QFile::WriteOnly) || saveFile.write(data) != data.size() || !saveFile.commit()) {
+        qCWarning(dcStorage) << "Error saving scaled image" << filePath << saveFile.errorString();
+        return data;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    touch(filePath, data.size());
+    evict();
+    return data;
+}
+
+void ThumbnailCache::remove(const QString &filePath)
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, Entry>::iterator it = m_entries.find(filePath);
+    if (it == m_entries.end()) {
+        return;
+    }
+    m_totalSize -= it.value().size;
+    m_lru.remove(it.value().lastAccess);
+    m_entries.erase(it);
+}
+
+QSize ThumbnailCache::bucketSize(const QSize &size)
+{
+    return QSize(snapToBucket(size.width()), snapToBucket(size.height()));
+}
+
+void ThumbnailCache::touch(const QString &filePath, qint64 size)
+{
+    QHash<QString, Entry>::iterator it = m_entries.find(filePath);
+    if (it != m_entries.end()) {
+        m_lru.remove(it.value().lastAccess);
+        m_totalSize -= it.value().size;
+    } else {
+        it = m_entries.insert(filePath, Entry());
+    }
+    it.value().size = size;
+    it.value().lastAccess = m_accessCounter++;
+    m_lru.insert(it.value().lastAccess, filePath);
+    m_totalSize += size;
+}
+
+void ThumbnailCache::evict()
+{
+    int evicted = 0;
+    // Never evict the one we've just handed out
+    while (m_totalSize > m_budget && m_lru.count() > 1) {
+        QMap<quint64, QString>::iterator it = m_lru.begin();
+        QString filePath = it.value();
+        m_lru.erase(it);
+        m_totalSize -= m_entries.value(filePath).size;
+        m_entries.remove(filePath);
+        QFile::remove(filePath);
+        evicted++;
+    }
+    if (evicted > 0) {
+        qCDebug(dcStorage) << "Evicted" << evicted << "scaled images from the thumbnail cache";
+    }
+}
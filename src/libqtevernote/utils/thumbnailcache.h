@@ -0,0 +1,74 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+
+// The ThumbnailCache keeps the scaled copies of image resources we hand out to the UI.
+//
+// Requested sizes are snapped to a few size buckets, so that rotating the screen or
+// switching layouts mostly hits copies we already have instead of creating new ones.
+// The cache has a byte budget. Once it is exceeded, the least recently used copies
+// are deleted. The copies are stored next to the resource as <file>_<w>x<h>.jpg.
+//
+// imageData() may be called from the image provider's loader threads.
+class ThumbnailCache
+{
+public:
+    ThumbnailCache();
+
+    void open(const QString &directory);
+    void close();
+
+    qint64 budget() const;
+    void setBudget(qint64 budget);
+
+    // Returns the image at sourceFilePath scaled to the bucket for size, creating it if needed
+    QByteArray imageData(const QString &sourceFilePath, const QSize &size);
+
+    // Forget about a scaled copy that has been deleted by someone else
+    void remove(const QString &filePath);
+
+    static QSize bucketSize(const QSize &size);
+
+private:
+    struct Entry {
+        qint64 size;
+        quint64 lastAccess;
+    };
+
+    void touch(const QString &filePath, qint64 size);
+    void evict();
+
+private:
+    mutable QMutex m_mutex;
+    QString m_directory;
+    qint64 m_budget;
+    qint64 m_totalSize;
+    quint64 m_accessCounter;
+    QHash<QString, Entry> m_entries;
+    QMap<quint64, QString> m_lru;
+};
+
+#endif // THUMBNAILCACHE_H
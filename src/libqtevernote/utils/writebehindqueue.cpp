@@ -0,0 +1,94 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "writebehindqueue.h"
+#include "logging.h"
+
+#include <QCoreApplication>
+#include <QGuiApplication>
+
+// How long to wait for more changes before writing
+#define FLUSH_DELAY 2000
+// Write right away once this many items are waiting
+#define FLUSH_THRESHOLD 256
+
+WriteBehindQueue::WriteBehindQueue(QObject *parent):
+    QObject(parent),
+    m_dirtyCount(0)
+{
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FLUSH_DELAY);
+    connect(&m_flushTimer, &QTimer::timeout, this, &WriteBehindQueue::flushRequested);
+
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &WriteBehindQueue::flushRequested);
+    }
+    // The push helper runs without a gui
+    QGuiApplication *app = qobject_cast<QGuiApplication*>(QCoreApplication::instance());
+    if (app) {
+        connect(app, &QGuiApplication::applicationStateChanged, this, &WriteBehindQueue::applicationStateChanged);
+    }
+}
+
+void WriteBehindQueue::markDirty(WriteBehindQueue::Kind kind, const QString &guid)
+{
+    if (m_dirty[kind].contains(guid)) {
+        return;
+    }
+    m_dirty[kind].insert(guid);
+    m_dirtyCount++;
+
+    if (m_dirtyCount >= FLUSH_THRESHOLD) {
+        m_flushTimer.stop();
+        emit flushRequested();
+    } else if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+void WriteBehindQueue::forget(WriteBehindQueue::Kind kind, const QString &guid)
+{
+    if (m_dirty[kind].remove(guid)) {
+        m_dirtyCount--;
+    }
+}
+
+bool WriteBehindQueue::isEmpty() const
+{
+    return m_dirtyCount == 0;
+}
+
+QSet<QString> WriteBehindQueue::takeDirty(WriteBehindQueue::Kind kind)
+{
+    QSet<QString> dirty = m_dirty[kind];
+    m_dirty[kind].clear();
+    m_dirtyCount -= dirty.count();
+    if (m_dirtyCount == 0) {
+        m_flushTimer.stop();
+    }
+    return dirty;
+}
+
+void WriteBehindQueue::applicationStateChanged(Qt::ApplicationState state)
+{
+    // We might get killed without further notice while suspended
+    if (state == Qt::ApplicationSuspended || state == Qt::ApplicationHidden) {
+        qCDebug(dcStorage) << "Application going to background. Flushing pending cache writes.";
+        emit flushRequested();
+    }
+}
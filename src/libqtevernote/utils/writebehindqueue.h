@@ -0,0 +1,62 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WRITEBEHINDQUEUE_H
+#define WRITEBEHINDQUEUE_H
+
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+// The WriteBehindQueue collects the guids of cached items that need to be written to
+// disk. Marking something dirty several times before it is written results in a single
+// write. The queue asks for a flush a short while after the first item has been marked,
+// as soon as too many items are pending, when the application is about to quit and when
+// it is suspended.
+class WriteBehindQueue : public QObject
+{
+    Q_OBJECT
+public:
+    enum Kind {
+        KindNote,
+        KindNoteContent,
+        KindNotebook,
+        KindTag
+    };
+
+    explicit WriteBehindQueue(QObject *parent = 0);
+
+    void markDirty(Kind kind, const QString &guid);
+    void forget(Kind kind, const QString &guid);
+
+    bool isEmpty() const;
+    QSet<QString> takeDirty(Kind kind);
+
+signals:
+    void flushRequested();
+
+private slots:
+    void applicationStateChanged(Qt::ApplicationState state);
+
+private:
+    QSet<QString> m_dirty[4];
+    int m_dirtyCount;
+    QTimer m_flushTimer;
+};
+
+#endif // WRITEBEHINDQUEUE_H
@@ -6,6 +6,7 @@
 
 #include <QDebug>
 #include <QOrganizerEvent>
+#include <QSettings>
 #include <QStandardPaths>
 #include <QJsonDocument>
 
@@ -0,0 +1,235 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmarkcache.h"
+#include "notes.h"
+#include "notesstore.h"
+#include "utils/guidrowindex.h"
+#include "utils/noteattributeindex.h"
+
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <algorithm>
+
+// Measures what the notes model does for every change to a note: finding its row,
+// moving the rows after it when a note is removed, and filtering and sorting the rows
+// for a list
+class ModelBenchmark: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void findRowsByIndexOf();
+    void findRowsByGuid();
+    void removeRows();
+    void removeAttributeRows();
+    void filterNotes_data();
+    void filterNotes();
+    void sortRowsByTitle();
+    void sortRowsByTitleKey();
+
+private:
+    QString guid(int i) const;
+    NoteAttributeIndex::Attributes attributes(int i) const;
+
+private:
+    QTemporaryDir m_dir;
+    int m_noteCount;
+    QList<QString> m_guids;
+    GuidRowIndex m_rows;
+    // Rows to look up, spread over the whole model
+    QStringList m_lookups;
+};
+
+void ModelBenchmark::initTestCase()
+{
+    m_noteCount = qEnvironmentVariableIsSet("BENCHMARK_NOTES") ? qgetenv("BENCHMARK_NOTES").toInt() : 50000;
+    for (int i = 0; i < m_noteCount; i++) {
+        m_guids.append(guid(i));
+        m_rows.append(guid(i));
+    }
+    for (int i = 0; i < 1000; i++) {
+        m_lookups.append(guid((qint64)i * m_noteCount / 1000));
+    }
+    QVERIFY(m_dir.isValid());
+    BenchmarkCache::setDataLocation(m_dir.path());
+}
+
+QString ModelBenchmark::guid(int i) const
+{
+    return QString("%1-4a5b-6c7d-8e9f-%2").arg(i, 8, 16, QChar('0')).arg(i, 12, 10, QChar('0'));
+}
+
+NoteAttributeIndex::Attributes ModelBenchmark::attributes(int i) const
+{
+    NoteAttributeIndex::Attributes attributes;
+    attributes.guid = guid(i);
+    // Not in order of the rows, so sorting has something to do
+    attributes.title = QString("Note number %1").arg((qint64)i * 7919 % m_noteCount);
+    attributes.notebookGuid = QString("0a1b2c3d-4a5b-6c7d-8e9f-%1").arg(i % 10, 12, 10, QChar('0'));
+    if (i % 3 == 0) {
+        attributes.tagGuids << "0a1b2c3d-4a5b-6c7d-8e9f-000000000100";
+    }
+    if (i % 5 == 0) {
+        attributes.resourceTypes << "image/png";
+    }
+    attributes.reminder = i % 10 == 0;
+    attributes.dates[NoteAttributeIndex::DateCreated] = QDateTime::currentDateTime().addDays(-i);
+    attributes.dates[NoteAttributeIndex::DateUpdated] = QDateTime::currentDateTime();
+    return attributes;
+}
+
+void ModelBenchmark::findRowsByIndexOf()
+{
+    qint64 sum = 0;
+    QBENCHMARK {
+        sum = 0;
+        foreach (const QString &guid, m_lookups) {
+            sum += m_guids.indexOf(guid);
+        }
+    }
+    QVERIFY(sum > 0);
+}
+
+void ModelBenchmark::findRowsByGuid()
+{
+    qint64 sum = 0;
+    QBENCHMARK {
+        sum = 0;
+        foreach (const QString &guid, m_lookups) {
+            sum += m_rows.row(guid);
+        }
+    }
+    QVERIFY(sum > 0);
+}
+
+// Every removal moves all rows after it. Looking up the last row right after each one
+// is the worst case, it makes all of them get renumbered each time.
+void ModelBenchmark::removeRows()
+{
+    int removals = m_noteCount / 100;
+    GuidRowIndex rows;
+    QBENCHMARK {
+        rows = m_rows;
+        for (int i = 0; i < removals; i++) {
+            rows.removeRow(0);
+            rows.row(m_guids.last());
+        }
+    }
+    QCOMPARE(rows.row(m_guids.last()), m_noteCount - 1 - removals);
+}
+
+void ModelBenchmark::removeAttributeRows()
+{
+    NoteAttributeIndex index;
+    for (int i = 0; i < m_noteCount; i++) {
+        index.append(attributes(i));
+    }
+    QBENCHMARK {
+        NoteAttributeIndex copy = index;
+        for (int row = 0; row < copy.count(); row += 100) {
+            copy.removeRow(row);
+        }
+    }
+}
+
+void ModelBenchmark::filterNotes_data()
+{
+    QTest::addColumn<int>("rows");
+    QTest::newRow("10000") << 10000;
+    QTest::newRow("100000") << 100000;
+}
+
+// What a notes list does when another notebook is picked: the proxy filters every row of
+// the store again, then sorts the ones left
+void ModelBenchmark::filterNotes()
+{
+    QFETCH(int, rows);
+    QString username = QString("filter-%1").arg(rows);
+    QVERIFY(BenchmarkCache::write(username, rows));
+    NotesStore *store = NotesStore::instance();
+    store->setUsername(username);
+    QCOMPARE(store->count(), rows);
+
+    Notes notes;
+    notes.setFilterTagGuid(BenchmarkCache::tagGuid());
+    int notebook = 0;
+    int accepted = 0;
+    QBENCHMARK {
+        notebook = (notebook + 1) % 2;
+        notes.setFilterNotebookGuid(BenchmarkCache::notebookGuid(notebook));
+        accepted = notes.rowCount();
+    }
+    QVERIFY(accepted > 0);
+}
+
+struct TitleLessThan {
+    TitleLessThan(const QStringList &titles): titles(titles) {}
+    bool operator()(int left, int right) const {
+        return titles.at(left).localeAwareCompare(titles.at(right)) < 0;
+    }
+    const QStringList &titles;
+};
+
+struct TitleKeyLessThan {
+    TitleKeyLessThan(const NoteAttributeIndex &index): index(index) {}
+    bool operator()(int left, int right) const {
+        return index.compareTitles(left, right) < 0;
+    }
+    const NoteAttributeIndex &index;
+};
+
+// What sorting by title used to do, but locale aware
+void ModelBenchmark::sortRowsByTitle()
+{
+    QStringList titles;
+    QVector<int> rows;
+    for (int i = 0; i < m_noteCount; i++) {
+        titles.append(attributes(i).title);
+        rows.append(i);
+    }
+    QVector<int> sorted;
+    QBENCHMARK {
+        sorted = rows;
+        std::sort(sorted.begin(), sorted.end(), TitleLessThan(titles));
+    }
+    QVERIFY(titles.at(sorted.first()).localeAwareCompare(titles.at(sorted.last())) <= 0);
+}
+
+void ModelBenchmark::sortRowsByTitleKey()
+{
+    NoteAttributeIndex index;
+    QVector<int> rows;
+    for (int i = 0; i < m_noteCount; i++) {
+        index.append(attributes(i));
+        rows.append(i);
+    }
+    QVector<int> sorted;
+    QBENCHMARK {
+        sorted = rows;
+        std::sort(sorted.begin(), sorted.end(), TitleKeyLessThan(index));
+    }
+    QVERIFY(index.compareTitles(sorted.first(), sorted.last()) <= 0);
+}
+
+QTEST_GUILESS_MAIN(ModelBenchmark)
+
+#include "benchmark_model.moc"
@@ -0,0 +1,238 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmarkcache.h"
+#include "notes.h"
+#include "notesstore.h"
+#include "utils/noteinfotable.h"
+
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Time the notes list may take from opening the cache to showing its first rows
+#define FIRST_PAINT_BUDGET 150
+// Rows the notes list shows on the first screen
+#define FIRST_SCREEN_ROWS 20
+// Startups measured for the first paint, the best one counts
+#define FIRST_PAINT_RUNS 5
+
+// Compares the note info table against the per note QSettings files we used before, and
+// checks how fast the notes list can be filled from the cache at startup
+class StorageBenchmark: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void writeInfoFiles();
+    void readInfoFiles();
+
+    void writeNoteInfoTable();
+    void readNoteInfoTable();
+
+    void firstPaint();
+
+private:
+    NoteInfo createNote(int i) const;
+
+private:
+    QTemporaryDir m_dir;
+    int m_noteCount;
+};
+
+void StorageBenchmark::initTestCase()
+{
+    m_noteCount = qEnvironmentVariableIsSet("BENCHMARK_NOTES") ? qgetenv("BENCHMARK_NOTES").toInt() : 10000;
+    QVERIFY(m_dir.isValid());
+    BenchmarkCache::setDataLocation(m_dir.path() + "/data");
+}
+
+NoteInfo StorageBenchmark::createNote(int i) const
+{
+    NoteInfo info;
+    info.guid = QString("%1-4a5b-6c7d-8e9f-%2").arg(i, 8, 16, QChar('0')).arg(i, 12, 10, QChar('0'));
+    info.notebookGuid = "0a1b2c3d-4a5b-6c7d-8e9f-000000000001";
+    info.title = QString("Note number %1").arg(i);
+    info.tagline = "Some text from the beginning of the note to show in the list of notes";
+    info.created = QDateTime::currentDateTime().addDays(-i);
+    info.updated = QDateTime::currentDateTime();
+    info.tagGuids << "0a1b2c3d-4a5b-6c7d-8e9f-000000000002";
+    if (i % 10 == 0) {
+        info.reminderOrder = QDateTime::currentMSecsSinceEpoch();
+        info.reminderTime = QDateTime::currentDateTime().addDays(1);
+    }
+    info.updateSequenceNumber = i;
+    info.lastSyncedSequenceNumber = i;
+    if (i % 5 == 0) {
+        NoteResourceInfo resource;
+        resource.hash = "0123456789abcdef0123456789abcdef";
+        resource.fileName = "image.png";
+        resource.type = "image/png";
+        info.resources << resource;
+    }
+    return info;
+}
+
+void StorageBenchmark::writeInfoFiles()
+{
+    QBENCHMARK {
+        for (int i = 0; i < m_noteCount; i++) {
+            NoteInfo info = createNote(i);
+            QSettings infoFile(m_dir.path() + "/note-" + info.guid + ".info", QSettings::IniFormat);
+            infoFile.setValue("created", info.created);
+            infoFile.setValue("title", info.title);
+            infoFile.setValue("updated", info.updated);
+            infoFile.setValue("needsContentSync", info.needsContentSync);
+            infoFile.setValue("notebookGuid", info.notebookGuid);
+            infoFile.setValue("tagGuids", info.tagGuids);
+            infoFile.setValue("reminderOrder", info.reminderOrder);
+            infoFile.setValue("reminderTime", info.reminderTime);
+            infoFile.setValue("reminderDoneTime", info.reminderDoneTime);
+            infoFile.setValue("deleted", info.deleted);
+            infoFile.setValue("lastSyncedSequenceNumber", info.lastSyncedSequenceNumber);
+            infoFile.setValue("tagline", info.tagline);
+            infoFile.beginGroup("resources");
+            foreach (const NoteResourceInfo &resource, info.resources) {
+                infoFile.beginGroup(resource.hash);
+                infoFile.setValue("fileName", resource.fileName);
+                infoFile.setValue("type", resource.type);
+                infoFile.endGroup();
+            }
+            infoFile.endGroup();
+        }
+    }
+}
+
+void StorageBenchmark::readInfoFiles()
+{
+    int count = 0;
+    QBENCHMARK {
+        count = 0;
+        for (int i = 0; i < m_noteCount; i++) {
+            QSettings infoFile(m_dir.path() + "/note-" + createNote(i).guid + ".info", QSettings::IniFormat);
+            NoteInfo info;
+            info.created = infoFile.value("created").toDateTime();
+            info.title = infoFile.value("title").toString();
+            info.updated = infoFile.value("updated").toDateTime();
+            info.notebookGuid = infoFile.value("notebookGuid").toString();
+            info.tagGuids = infoFile.value("tagGuids").toStringList();
+            info.reminderOrder = infoFile.value("reminderOrder").toULongLong();
+            info.reminderTime = infoFile.value("reminderTime").toDateTime();
+            info.reminderDoneTime = infoFile.value("reminderDoneTime").toDateTime();
+            info.deleted = infoFile.value("deleted").toBool();
+            info.tagline = infoFile.value("tagline").toString();
+            info.lastSyncedSequenceNumber = infoFile.value("lastSyncedSequenceNumber", 0).toUInt();
+            info.needsContentSync = infoFile.value("needsContentSync", false).toBool();
+            infoFile.beginGroup("resources");
+            foreach (const QString &hash, infoFile.childGroups()) {
+                infoFile.beginGroup(hash);
+                NoteResourceInfo resource;
+                resource.hash = hash;
+                resource.fileName = infoFile.value("fileName").toString();
+                resource.type = infoFile.value("type").toString();
+                info.resources.append(resource);
+                infoFile.endGroup();
+            }
+            infoFile.endGroup();
+            if (!info.title.isEmpty()) {
+                count++;
+            }
+        }
+    }
+    QCOMPARE(count, m_noteCount);
+}
+
+void StorageBenchmark::writeNoteInfoTable()
+{
+    QBENCHMARK {
+        NoteInfoTable table;
+        QVERIFY(table.open(m_dir.path() + "/notes.table"));
+        for (int i = 0; i < m_noteCount; i++) {
+            table.write(createNote(i));
+        }
+        table.sync();
+    }
+}
+
+void StorageBenchmark::readNoteInfoTable()
+{
+    int count = 0;
+    QBENCHMARK {
+        NoteInfoTable table;
+        QVERIFY(table.open(m_dir.path() + "/notes.table"));
+        count = table.count();
+    }
+    QCOMPARE(count, m_noteCount);
+
+    NoteInfoTable table;
+    table.open(m_dir.path() + "/notes.table");
+    NoteInfo expected = createNote(m_noteCount - 1);
+    NoteInfo info = table.record(expected.guid);
+    QCOMPARE(info.title, expected.title);
+    QCOMPARE(info.tagGuids, expected.tagGuids);
+    QCOMPARE(info.updated, expected.updated);
+}
+
+// Switches the NotesStore to a cache written before, like the app does at startup, and
+// reads the rows the notes list shows first
+void StorageBenchmark::firstPaint()
+{
+    QString username = "firstpaint";
+    QVERIFY(BenchmarkCache::write(username, m_noteCount));
+
+    NotesStore *store = NotesStore::instance();
+    Notes notes;
+    notes.setSortOrder(Notes::SortOrderDateUpdatedNewest);
+
+    qint64 best = -1;
+    int painted = 0;
+    for (int run = 0; run < FIRST_PAINT_RUNS; run++) {
+        store->setUsername("firstpaint-idle");
+        QCOMPARE(store->count(), 0);
+
+        QElapsedTimer timer;
+        timer.start();
+        store->setUsername(username);
+        painted = 0;
+        for (int row = 0; row < qMin(FIRST_SCREEN_ROWS, notes.rowCount()); row++) {
+            QModelIndex index = notes.index(row, 0);
+            if (!notes.data(index, NotesStore::RoleTitle).toString().isEmpty()
+                    && !notes.data(index, NotesStore::RoleTagline).toString().isEmpty()) {
+                painted++;
+            }
+        }
+        qint64 elapsed = timer.elapsed();
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    QCOMPARE(store->count(), m_noteCount);
+    QCOMPARE(painted, qMin(FIRST_SCREEN_ROWS, m_noteCount));
+
+    QTest::setBenchmarkResult(best, QTest::WalltimeMilliseconds);
+    if (best > FIRST_PAINT_BUDGET) {
+        qWarning() << "First paint of" << m_noteCount << "notes took" << best << "ms, more than the budget of" << FIRST_PAINT_BUDGET << "ms";
+    }
+}
+
+QTEST_GUILESS_MAIN(StorageBenchmark)
+
+#include "benchmark_storage.moc"
@@ -0,0 +1,155 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmarkcache.h"
+
+#include "utils/cachejournal.h"
+#include "utils/edamcodec.h"
+#include "utils/edamtable.h"
+#include "utils/noteinfotable.h"
+#include "utils/notesnapshot.h"
+
+#include <QDir>
+#include <QStandardPaths>
+
+#define NOTEBOOK_COUNT 10
+
+void BenchmarkCache::setDataLocation(const QString &directory)
+{
+    qputenv("XDG_DATA_HOME", directory.toUtf8());
+}
+
+QString BenchmarkCache::storageLocation(const QString &username)
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/" + username + "/";
+}
+
+bool BenchmarkCache::write(const QString &username, int noteCount)
+{
+    QString directory = storageLocation(username);
+    if (!QDir(directory).removeRecursively() || !QDir().mkpath(directory)) {
+        return false;
+    }
+
+    CacheJournal journal;
+    NoteInfoTable noteTable;
+    EdamTable notebookTable;
+    EdamTable tagTable;
+    if (!journal.open(directory + "notes.journal") || !noteTable.open(directory + "notes.table")
+            || !notebookTable.open(directory + "notebooks.table") || !tagTable.open(directory + "tags.table")) {
+        return false;
+    }
+
+    for (int i = 0; i < NOTEBOOK_COUNT; i++) {
+        evernote::edam::Notebook notebook;
+        notebook.guid = notebookGuid(i).toStdString();
+        notebook.__isset.guid = true;
+        notebook.name = QString("Notebook %1").arg(i).toStdString();
+        notebook.__isset.name = true;
+        notebook.updateSequenceNum = i + 1;
+        notebook.__isset.updateSequenceNum = true;
+
+        EdamRecord record;
+        record.guid = notebookGuid(i);
+        record.edam = EdamCodec::encode(notebook);
+        record.lastSyncedSequenceNumber = notebook.updateSequenceNum;
+        notebookTable.write(record);
+        journal.setEntry(CacheJournal::KindNotebook, record.guid, record.lastSyncedSequenceNumber);
+    }
+
+    evernote::edam::Tag tag;
+    tag.guid = tagGuid().toStdString();
+    tag.__isset.guid = true;
+    tag.name = "Tag";
+    tag.__isset.name = true;
+    tag.updateSequenceNum = 1;
+    tag.__isset.updateSequenceNum = true;
+    EdamRecord tagRecord;
+    tagRecord.guid = tagGuid();
+    tagRecord.edam = EdamCodec::encode(tag);
+    tagRecord.lastSyncedSequenceNumber = tag.updateSequenceNum;
+    tagTable.write(tagRecord);
+    journal.setEntry(CacheJournal::KindTag, tagRecord.guid, tagRecord.lastSyncedSequenceNumber);
+
+    QVector<NoteSnapshot::Row> rows;
+    rows.reserve(noteCount);
+    QDateTime now = QDateTime::currentDateTime();
+    for (int i = 0; i < noteCount; i++) {
+        NoteInfo info;
+        info.guid = noteGuid(i);
+        info.notebookGuid = notebookGuid(i % NOTEBOOK_COUNT);
+        // Not in order of the rows, so sorting has something to do
+        info.title = QString("Note number %1").arg((qint64)i * 7919 % noteCount);
+        info.tagline = "Some text from the beginning of the note to show in the list of notes";
+        info.created = now.addDays(-i);
+        info.updated = now.addSecs(-((qint64)i * 7919 % noteCount));
+        if (i % 3 == 0) {
+            info.tagGuids << tagGuid();
+        }
+        if (i % 10 == 0) {
+            info.reminderOrder = now.toMSecsSinceEpoch() + i;
+            info.reminderTime = now.addDays(1);
+        }
+        if (i % 5 == 0) {
+            NoteResourceInfo resource;
+            resource.hash = "0123456789abcdef0123456789abcdef";
+            resource.fileName = "image.png";
+            resource.type = "image/png";
+            info.resources << resource;
+        }
+        info.updateSequenceNumber = i + 1;
+        info.lastSyncedSequenceNumber = i + 1;
+        noteTable.write(info);
+        journal.setEntry(CacheJournal::KindNote, info.guid, info.updateSequenceNumber);
+
+        NoteSnapshot::Row row;
+        row.guid = info.guid;
+        row.notebookGuid = info.notebookGuid;
+        row.title = info.title;
+        row.tagline = info.tagline;
+        row.created = info.created;
+        row.updated = info.updated;
+        row.tagGuids = info.tagGuids;
+        row.reminderOrder = info.reminderOrder;
+        row.reminderTime = info.reminderTime;
+        row.synced = true;
+        rows.append(row);
+    }
+
+    journal.sync();
+    noteTable.sync();
+    notebookTable.sync();
+    tagTable.sync();
+    // Written last, the store doesn't trust a snapshot older than the table
+    return NoteSnapshot::write(directory + "notes.snapshot", rows);
+}
+
+QString BenchmarkCache::noteGuid(int i)
+{
+    return QString("%1-4a5b-6c7d-8e9f-%2").arg(i, 8, 16, QChar('0')).arg(i, 12, 10, QChar('0'));
+}
+
+QString BenchmarkCache::notebookGuid(int i)
+{
+    return QString("0a1b2c3d-4a5b-6c7d-8e9f-%1").arg(i, 12, 10, QChar('0'));
+}
+
+QString BenchmarkCache::tagGuid()
+{
+    return "0a1b2c3d-4a5b-6c7d-8e9f-000000000100";
+}
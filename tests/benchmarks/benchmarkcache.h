@@ -0,0 +1,45 @@
+/*
+ * Copyright: 2016 Canonical, Ltd
+ *
+ * This file is part of reminders
+ *
+ * reminders is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * reminders is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCHMARKCACHE_H
+#define BENCHMARKCACHE_H
+
+#include <QString>
+
+// Writes a cache the way the NotesStore leaves it on disk, so benchmarks can measure
+// the store loading it at startup like the app does.
+//
+// The notes are spread over NOTEBOOK_COUNT notebooks, every third one is tagged, every
+// tenth one has a reminder and every fifth one an image.
+class BenchmarkCache
+{
+public:
+    // Makes the NotesStore keep its data below directory. Call it before the store is
+    // created.
+    static void setDataLocation(const QString &directory);
+    // Where the NotesStore keeps the cache of username
+    static QString storageLocation(const QString &username);
+
+    static bool write(const QString &username, int noteCount);
+
+    static QString noteGuid(int i);
+    static QString notebookGuid(int i);
+    static QString tagGuid();
+};
+
+#endif // BENCHMARKCACHE_H